@@ -12,25 +12,73 @@
 #ifndef _algorithm_types_h_included
 #define _algorithm_types_h_included
 
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
 struct crypto_context_s;
 typedef struct crypto_context_s crypto_context;
 
-struct crypto_context_s {
-    uint32_t algorithm;
-    int16_t size;
-	int16_t block_size;
-    uint32_t flags;
+/**
+ * \brief The operations of an algorithm. There is one constant table per
+ *   algorithm implementation shared by all of its contexts.
+ */
 
-	int (*reset)(   crypto_context *, ... );
-	void (*update)( crypto_context *, const void *, int );
+typedef struct crypto_ops_s {
+	int (*reset)(   crypto_context *, va_list );
+	void (*update)( crypto_context *, const void *, size_t );
 	void (*finish)( crypto_context *, uint8_t* );
-	/* free points to NULL if a context is allocated in a stack */ 
+	/* copy into the given storage, or into a heap allocation if NULL */
+	crypto_context *(*clone)( const crypto_context *, crypto_context * );
+	/* intermediate state as a blob, see midstate.h */
+	int (*export_state)( const crypto_context *, uint8_t *, size_t * );
+	int (*import_state)( crypto_context *, const uint8_t *, size_t );
+	/* releases a heap context, see CFLAG_STATIC_ALLOC */
 	void (*free)( crypto_context *);
+} crypto_ops;
+
+struct crypto_context_s {
+	const crypto_ops *ops;
+    uint32_t algorithm;
+    int32_t size;       /* digest size in bits */
+	int32_t block_size;
+    uint32_t flags;
 
 	/* Context specific data follows.. */
 	uint8_t private[0];
 };
 
+/**
+ * \brief Calls through the operations table.
+ *
+ */
+
+int crypto_reset( crypto_context *, ... );
+
+static inline void crypto_update( crypto_context *ctx, const void *buf, size_t len ) {
+	ctx->ops->update(ctx,buf,len);
+}
+
+static inline void crypto_finish( crypto_context *ctx, uint8_t *out ) {
+	ctx->ops->finish(ctx,out);
+}
+
+static inline crypto_context *crypto_clone( const crypto_context *ctx, crypto_context *dst ) {
+	return ctx->ops->clone(ctx,dst);
+}
+
+static inline int crypto_export_state( const crypto_context *ctx, uint8_t *out, size_t *len ) {
+	return ctx->ops->export_state(ctx,out,len);
+}
+
+static inline int crypto_import_state( crypto_context *ctx, const uint8_t *in, size_t len ) {
+	return ctx->ops->import_state(ctx,in,len);
+}
+
+static inline void crypto_free( crypto_context *ctx ) {
+	ctx->ops->free(ctx);
+}
+
 /**
  * \brief Tags for reset() function.
  *
@@ -51,7 +99,9 @@ enum crypto_tags {
 
 #define CFLAG_STATIC_ALLOC	0x00000001	/**< All context pointers are statically allocated
 										 * i.e. the free() function must not free individual
-										 * contexts.. */
+										 * contexts.. Set by the *_init() functions. */
+#define CFLAG_KEYED			0x00000002	/**< A MAC context holds a key, thus it can be
+										 * reset without giving the key again. */
 
 /**
  * \brief A rundown of digest, crypto, MAC etc algorithm identifiers.
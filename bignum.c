@@ -2,6 +2,8 @@
  * \file bignum.c
  * \brief Minimalistic Bignum implementation. Currently supported
  *   methods are: add, sub, mul, div, mod and exp (and exp+mod).
+ *   The arithmetic works on limbs of BM_LIMB_BITS bits with double
+ *   limb intermediate products, see bignum.h.
  *
  * \author Jouni Korhonen
  * \version 0.2
@@ -17,20 +19,60 @@
 #include <stdint.h>
 #include <assert.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 
 #include "bignum.h"
+#include "cpu_features.h"
+
+#if defined(CPU_X86_KERNELS) && defined(__x86_64__) && BM_LIMB_BITS == 64
+#define BM_ADX_KERNELS
+#endif
+
+#define BM_LIMB_MASK ((bm_limb_t)~0)
+
+/* The temporaries of functions on bignums without an arena come from
+ * an arena on the stack and spill to the heap when it is full. It fits
+ * e.g. a division of 8000-bit numbers or a Montgomery multiplication
+ * of 2048-bit ones. Without the heap it fits the scratch of an
+ * exponentiation with the widest window and an inline modulus.
+ */
+
+#if defined(BM_STATIC_ALLOC)
+#define BM_STACK_SIZE (36 * BM_INLINE_SIZE)
+#else
+#define BM_STACK_SIZE (2048 * 8 / BM_LIMB_BITS)
+#endif
+
+/* The operand sizes in limbs from which on the multiplication switches
+ * to Karatsuba and to Toom-3, measured on x86-64. The crossovers in limbs
+ * are about the same with 32-bit and 64-bit limbs. Toom-3 only breaks
+ * even with Karatsuba at the largest operands. The schoolbook square is
+ * cheaper than the schoolbook multiplication and stays longer.
+ */
+
+#if !defined(BM_KARATSUBA_THRESHOLD)
+#define BM_KARATSUBA_THRESHOLD 40
+#endif
+#if !defined(BM_TOOM3_THRESHOLD)
+#define BM_TOOM3_THRESHOLD 256
+#endif
+#if !defined(BM_SQR_KARATSUBA_THRESHOLD)
+#define BM_SQR_KARATSUBA_THRESHOLD 64
+#endif
+
+static int bm_resize( bm_t *, int );
 
 /**
  * \brief A helper function to calculate the number of
- *   long words needed for an array of octets.
+ *   limbs needed for an array of octets.
  *
  * \param n The number of octets.
  *
- * \return The number of needed long words.
+ * \return The number of needed limbs.
  */
 
-static inline get_size_in_longs( int n ) {
-	return (n+sizeof(uint32_t)-1) / sizeof(uint32_t);
+static inline int get_size_in_longs( int n ) {
+	return (n+sizeof(bm_limb_t)-1) / sizeof(bm_limb_t);
 }
 
 static inline uint32_t ror8( uint32_t a, int n ) {
@@ -41,6 +83,223 @@ static inline uint32_t rol8( uint32_t a, int n ) {
 	return (a << n*8) | (a >> (32-n*8));
 }
 
+/**
+ * \brief Add two limb arrays of equal length, i.e. r = a + b.
+ *   The result may overlap with the inputs.
+ *
+ * \param r A pointer to the result limbs.
+ * \param a A pointer to the first limbs.
+ * \param b A pointer to the second limbs.
+ * \param n The number of limbs.
+ *
+ * \return The carry out, 0 or 1.
+ */
+
+static bm_limb_t bm_add_n( bm_limb_t *r, const bm_limb_t *a, const bm_limb_t *b, int n ) {
+	bm_dlimb_t c = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		c = (bm_dlimb_t)a[i] + b[i] + c;
+		r[i] = (bm_limb_t)c;
+		c >>= BM_LIMB_BITS;
+	}
+	return (bm_limb_t)c;
+}
+
+/**
+ * \brief Subtract two limb arrays of equal length, i.e. r = a - b.
+ *   The result may overlap with the inputs.
+ *
+ * \param r A pointer to the result limbs.
+ * \param a A pointer to the limbs to subtract from.
+ * \param b A pointer to the limbs to subtract.
+ * \param n The number of limbs.
+ *
+ * \return The borrow out, 0 or 1.
+ */
+
+static bm_limb_t bm_sub_n( bm_limb_t *r, const bm_limb_t *a, const bm_limb_t *b, int n ) {
+	bm_limb_t c = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		bm_limb_t A = a[i];
+		bm_limb_t B = b[i] + c;
+
+		c = (B < c) | (A < B);
+		r[i] = A - B;
+	}
+	return c;
+}
+
+/**
+ * \brief Propagate a carry through a limb array, i.e. r = a + c.
+ *
+ * \param r A pointer to the result limbs.
+ * \param a A pointer to the input limbs.
+ * \param n The number of limbs.
+ * \param c The carry in.
+ *
+ * \return The carry out.
+ */
+
+static bm_limb_t bm_add_1( bm_limb_t *r, const bm_limb_t *a, int n, bm_limb_t c ) {
+	int i;
+
+	for (i = 0; i < n; i++) {
+		r[i] = a[i] + c;
+		c = r[i] < c;
+	}
+	return c;
+}
+
+/**
+ * \brief Propagate a borrow through a limb array, i.e. r = a - c.
+ *
+ * \param r A pointer to the result limbs.
+ * \param a A pointer to the input limbs.
+ * \param n The number of limbs.
+ * \param c The borrow in.
+ *
+ * \return The borrow out.
+ */
+
+static bm_limb_t bm_sub_1( bm_limb_t *r, const bm_limb_t *a, int n, bm_limb_t c ) {
+	int i;
+
+	for (i = 0; i < n; i++) {
+		bm_limb_t A = a[i];
+
+		r[i] = A - c;
+		c = A < c;
+	}
+	return c;
+}
+
+/**
+ * \brief Multiply a limb array with a limb and subtract the product
+ *   from the result, i.e. r = r - a * b.
+ *
+ * \param r A pointer to the result limbs.
+ * \param a A pointer to the input limbs.
+ * \param n The number of limbs.
+ * \param b The multiplier.
+ *
+ * \return The borrow out limb.
+ */
+
+static bm_limb_t bm_submul_1( bm_limb_t *r, const bm_limb_t *a, int n, bm_limb_t b ) {
+	bm_limb_t c = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		bm_dlimb_t p = (bm_dlimb_t)a[i] * b + c;
+		bm_limb_t L = (bm_limb_t)p;
+		bm_limb_t R = r[i];
+
+		c = (bm_limb_t)(p >> BM_LIMB_BITS) + (R < L);
+		r[i] = R - L;
+	}
+	return c;
+}
+
+/**
+ * \brief Multiply a limb array with a limb and add the product to the
+ *   result, i.e. r = r + a * b. This is the inner loop of the
+ *   multiplication.
+ *
+ * \param r A pointer to the result limbs.
+ * \param a A pointer to the input limbs.
+ * \param n The number of limbs.
+ * \param b The multiplier.
+ *
+ * \return The carry out limb.
+ */
+
+static bm_limb_t bm_addmul_1_generic( bm_limb_t *r, const bm_limb_t *a, int n, bm_limb_t b ) {
+	bm_dlimb_t c = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		c = (bm_dlimb_t)a[i] * b + r[i] + (bm_limb_t)c;
+		r[i] = (bm_limb_t)c;
+		c >>= BM_LIMB_BITS;
+	}
+	return (bm_limb_t)c;
+}
+
+#if defined(BM_ADX_KERNELS)
+/**
+ * \brief See bm_addmul_1_generic(). The mulx product leaves the flags
+ *   alone, thus the high halves of the products are added with adcx
+ *   in the carry flag chain and the result limbs with adox in the
+ *   overflow flag chain. The loop counts up to zero and only uses
+ *   instructions that keep both flags. Compilers spill the flags of
+ *   the intrinsics, hence the inline assembly.
+ */
+
+static bm_limb_t bm_addmul_1_adx( bm_limb_t *r, const bm_limb_t *a, int n, bm_limb_t b ) {
+	bm_limb_t h = 0, L, H, z;
+	long i = -(long)n;
+
+	if (n <= 0) {
+		return 0;
+	}
+
+	__asm__ volatile (
+		"xorl %k[z],%k[z]\n\t"
+		"1:\n\t"
+		"mulxq (%[a],%[i],8),%[L],%[H]\n\t"
+		"adcxq %[h],%[L]\n\t"
+		"adoxq (%[r],%[i],8),%[L]\n\t"
+		"movq %[L],(%[r],%[i],8)\n\t"
+		"movq %[H],%[h]\n\t"
+		"leaq 1(%[i]),%[i]\n\t"
+		"jrcxz 2f\n\t"
+		"jmp 1b\n\t"
+		"2:\n\t"
+		"adcxq %[z],%[h]\n\t"
+		"adoxq %[z],%[h]\n\t"
+		: [h] "+&r" (h), [L] "=&r" (L), [H] "=&r" (H), [z] "=&r" (z), [i] "+c" (i)
+		: [a] "r" (a+n), [r] "r" (r+n), "d" (b)
+		: "cc", "memory");
+
+	/* the high half of a product is at most 2^64-2 */
+	return h;
+}
+#endif
+
+/* The kernel is selected on the first use. Until then the pointer
+ * refers to the selector itself. The pointer is atomic since threads
+ * may select concurrently, every selector stores the same kernel.
+ */
+
+static bm_limb_t bm_addmul_1_select( bm_limb_t *, const bm_limb_t *, int, bm_limb_t );
+static bm_limb_t (*_Atomic bm_addmul_1_kernel)( bm_limb_t *, const bm_limb_t *, int, bm_limb_t ) = bm_addmul_1_select;
+
+static inline bm_limb_t bm_addmul_1( bm_limb_t *r, const bm_limb_t *a, int n, bm_limb_t b ) {
+	return atomic_load_explicit(&bm_addmul_1_kernel,memory_order_relaxed)(r,a,n,b);
+}
+
+/**
+ * \brief Pick the fastest multiply-accumulate kernel the CPU supports
+ *   and run it.
+ */
+
+static bm_limb_t bm_addmul_1_select( bm_limb_t *r, const bm_limb_t *a, int n, bm_limb_t b ) {
+	bm_limb_t (*f)( bm_limb_t *, const bm_limb_t *, int, bm_limb_t ) = bm_addmul_1_generic;
+#if defined(BM_ADX_KERNELS)
+	uint32_t req = CPU_FEATURE_BMI2 | CPU_FEATURE_ADX;
+
+	if ((cpu_features() & req) == req) {
+		f = bm_addmul_1_adx;
+	}
+#endif
+	atomic_store_explicit(&bm_addmul_1_kernel,f,memory_order_relaxed);
+	return f(r,a,n,b);
+}
+
 static int bm_is_zero( const bm_t * a ) {
 	int n;
 
@@ -52,15 +311,44 @@ static int bm_is_zero( const bm_t * a ) {
 	return 1;
 }
 
+/**
+ * \brief Drop the leading zero limbs. A zero keeps one limb and
+ *   is always positive.
+ *
+ * \param r A pointer to the bignum.
+ * \param n The number of limbs in use.
+ *
+ * \return Nothing.
+ */
+
 static void bm_trim( bm_t *r, int n ) {
 	assert(n > 0);
 
-	while (r->b[n-1] == 0) {
+	while (n > 1 && r->b[n-1] == 0) {
 		n--;
 	}
+	if (n == 1 && r->b[0] == 0) {
+		r->sign = BM_POS;
+	}
 	r->size = n;
 }
 
+/**
+ * \brief Make sure a bignum has room for a number of limbs.
+ *
+ * \param a A pointer to the bignum.
+ * \param s The number of limbs.
+ *
+ * \return BM_SUCCESS if ok, error otherwise.
+ */
+
+static inline int bm_reserve( bm_t *a, int s ) {
+	if (s > a->maxs) {
+		return bm_resize(a,s);
+	}
+	return BM_SUCCESS;
+}
+
 /**
  * \brief Set bignum size.
  *
@@ -68,49 +356,123 @@ static void bm_trim( bm_t *r, int n ) {
  */
 
 static int bm_set_size( bm_t *a, int s ) {
-    int n;
+	int n;
 
-#if !defined(BM_STATIC_ALLOC)
-    while (s > a->maxs) {
-        if ((n = bm_resize(a)) != BM_SUCCESS) {
-            return n;
-        }
-    }
-#else
-    if (a->maxs > 0 && s > a->maxs) {
-        return -BM_ERROR_NUMBER_TOO_BIG;
-    } else {
-        a->maxs = BM_MAX_SIZE;
-    }
-#endif
-    a->size = s;
-    return BM_SUCCESS;
+	if ((n = bm_reserve(a,s)) != BM_SUCCESS) {
+		return n;
+	}
+	a->size = s;
+	return BM_SUCCESS;
+}
+
+/**
+ * \brief Check if the limbs of a bignum are the topmost allocation
+ *   of its arena.
+ *
+ * \param r A pointer to the bignum.
+ *
+ * \return Non-zero if the limbs are on the top of the arena.
+ */
+
+static inline int bm_arena_top( const bm_t *r ) {
+	return r->arena && r->b != r->l && r->b + r->maxs == r->arena->base + r->arena->used;
+}
+
+/**
+ * \brief Check if the limbs of a bignum are in its arena.
+ *
+ * \param r A pointer to the bignum.
+ *
+ * \return Non-zero if the limbs are in the arena.
+ */
+
+static inline int bm_in_arena( const bm_t *r ) {
+	return r->arena && r->b >= r->arena->base && r->b < r->arena->base + r->arena->size;
+}
+
+/* The stack arena of the temporaries of a function */
+
+typedef struct bm_stack_s {
+	bm_arena_t ar;
+	bm_limb_t l[BM_STACK_SIZE];
+} bm_stack_t;
+
+/**
+ * \brief Get the arena for the temporaries of a function, i.e. the
+ *   arena of the result bignum, or the stack arena if it has none.
+ *
+ * \param r A pointer to the result bignum.
+ * \param st A pointer to the stack arena of the function.
+ * \return A pointer to the arena.
+ */
+
+static inline bm_arena_t *bm_temp_arena( const bm_t *r, bm_stack_t *st ) {
+	if (r->arena) {
+		return r->arena;
+	}
+
+	bm_arena_init(&st->ar,st->l,sizeof(st->l));
+	return &st->ar;
 }
 
 
 /**
  * \brief Resize i.e. grow the internal buffer to hold the
- *   bignum. In case of statically allocated memory this
- *   function always fails.
+ *   bignum. The buffer at least doubles, thus a bignum that keeps
+ *   growing is moved only a few times. The limbs are kept.
  *
- * \param A pointer to a bignum to resize.
+ * \param r A pointer to a bignum to resize.
+ * \param s The number of limbs needed.
  * \return BM_SUCCESS if ok, error otherwise.
  */
 
-static int bm_resize( bm_t *r ) {
+static int bm_resize( bm_t *r, int s ) {
+	bm_arena_t *ar = r->arena;
+	bm_limb_t *b = NULL;
+	int n;
+
+	if (s < 2 * r->maxs) {
+		s = 2 * r->maxs;
+	}
+
+	if (ar) {
+		if (bm_arena_top(r) && ar->used + s - r->maxs <= ar->size) {
+			/* grow in place */
+			ar->used += s - r->maxs;
+			r->maxs = s;
+			return BM_SUCCESS;
+		}
+		if (ar->used + s <= ar->size) {
+			b = ar->base + ar->used;
+			ar->used += s;
+		}
+	}
+	if (b == NULL) {
+		/* no arena or it is full */
 #if defined(BM_STATIC_ALLOC)
-	if (r->maxs == 0) {
-        r->maxs = BM_MAX_SIZE;
-    } else {    
-        return -BM_ERROR_NUMBER_TOO_BIG;
-    }
+		return -BM_ERROR_NUMBER_TOO_BIG;
 #else
-	if ((r->b = realloc(r->b,BM_RESIZE(r->maxs))) == NULL) {
-		return -BM_ERROR_ALLOC_FAILED;
+		if (r->b != r->l && !bm_in_arena(r)) {
+			if ((b = realloc(r->b,s * sizeof(bm_limb_t))) == NULL) {
+				return -BM_ERROR_ALLOC_FAILED;
+			}
+			r->b = b;
+			r->maxs = s;
+			return BM_SUCCESS;
+		}
+		if ((b = malloc(s * sizeof(bm_limb_t))) == NULL) {
+			return -BM_ERROR_ALLOC_FAILED;
+		}
+#endif
 	}
 
-	r->maxs = BM_RESIZE(r->maxs);
-#endif
+	/* move out of the inline limbs or an arena block */
+	for (n = 0; n < r->maxs; n++) {
+		b[n] = r->b[n];
+	}
+
+	r->b = b;
+	r->maxs = s;
 	return BM_SUCCESS;
 }
 
@@ -125,10 +487,22 @@ static int bm_resize( bm_t *r ) {
 void bm_init( bm_t *m ) {
     m->size = 0;
     m->sign = BM_NAN;
-    m->maxs = 0;
-#if !defined(BM_STATIC_ALLOC)
-    m->b = NULL;
-#endif
+    m->maxs = BM_INLINE_SIZE;
+    m->b = m->l;
+    m->arena = NULL;
+}
+
+/**
+ * \brief Initialize a bignum that spills to an arena.
+ *
+ * \param m A pointer to a bignum structure.
+ * \param ar A pointer to the arena, NULL for the heap.
+ * \return Nothing.
+ */
+
+void bm_init_arena( bm_t *m, bm_arena_t *ar ) {
+    bm_init(m);
+    m->arena = ar;
 }
 
 /**
@@ -156,21 +530,65 @@ void bm_inits( bm_t *s, ... ) {
 
 
 /**
- * \brief Free memory reserver for the bignum structure.
+ * \brief Free memory reserver for the bignum structure. The arena
+ *   memory is given back only if the bignum is on the top of it.
  *
  * \param m A pointer to the bignum structure.
  * \return Nothing.
  */
 
 void bm_done( bm_t *m ) {
+    if (bm_arena_top(m)) {
+        m->arena->used -= m->maxs;
+    }
 #if !defined(BM_STATIC_ALLOC)
-    if (m->b) {
+    else if (m->b != m->l && !bm_in_arena(m)) {
         free(m->b);
-        m->b = NULL;
     }
 #endif
+    m->b = m->l;
     m->size = 0;
-    m->maxs = 0;
+    m->maxs = BM_INLINE_SIZE;
+}
+
+/**
+ * \brief Initialize an arena over a caller supplied memory area.
+ *
+ * \param ar A pointer to the arena.
+ * \param mem A pointer to the memory, aligned for the limbs.
+ * \param len The size of the memory in octets.
+ * \return Nothing.
+ */
+
+void bm_arena_init( bm_arena_t *ar, void *mem, size_t len ) {
+    ar->base = mem;
+    ar->size = len / sizeof(bm_limb_t);
+    ar->used = 0;
+}
+
+/**
+ * \brief Get the current top of an arena.
+ *
+ * \param ar A pointer to the arena.
+ * \return The mark for bm_arena_release().
+ */
+
+int bm_arena_mark( const bm_arena_t *ar ) {
+    return ar->used;
+}
+
+/**
+ * \brief Free all arena memory taken after a mark. The bignums using
+ *   the memory must not be used after this, other than initialized
+ *   again.
+ *
+ * \param ar A pointer to the arena.
+ * \param mark The mark from bm_arena_mark().
+ * \return Nothing.
+ */
+
+void bm_arena_release( bm_arena_t *ar, int mark ) {
+    ar->used = mark;
 }
 
 /**
@@ -198,8 +616,7 @@ void bm_dones( bm_t *s, ... ) {
 
 
 /**
- * \brief Sub two bignumers and neglect the sign. Note that the output
- *   bignumber must not be any of the input bignumbers. This function
+ * \brief Sub two bignumers and neglect the sign. This function
  *   also assumes 'a' is always greater or equal than 'b'.
  *   The result bignum may overlap with input bignums.
  *
@@ -211,53 +628,25 @@ void bm_dones( bm_t *s, ... ) {
  */
 
 static int bm_sub_nosign( bm_t *r, const bm_t *a, const bm_t *b ) {
-    int n, m;
-    uint64_t c;   /**< Used also as a carry */
-
-    m = BM_MAX(a->size,b->size); 
-	c = 0ULL;
+	bm_limb_t c;
+	int n;
 
-	if (m >= r->maxs) {
-		/* make sure stuff fits into the destination bignum */
-		if ((n = bm_resize(r)) != BM_SUCCESS) {
-			return n;
-		}
+	if ((n = bm_reserve(r,a->size)) != BM_SUCCESS) {
+		return n;
 	}
-    for (n = 0; n < m; n++) {
-		uint64_t A=0ULL, B=0ULL;
-
-		if (n < a->maxs) {
-			A = a->b[n];
-		}
-		if (n < b->maxs) {
-			B = b->b[n];
-		}
 
-		c = A - B + c;
-        r->b[n] = c;
-        c >>= 32;
-    }
-	while (n > 1) {
-		if (r->b[n-1] == 0) {
-			/* check if the highest long word is zero, i.e. we can 
- 			 * make the number "size" smaller.. this just ensures
-			 * prettier output so that less leading zeroes are
-			 * output when printing the bignum.
-			 */
-			n--;
-		} else {
-			break;
-		}
-    }
+	c = bm_sub_n(r->b,a->b,b->b,b->size);
+	bm_sub_1(r->b+b->size,a->b+b->size,a->size-b->size,c);
 
-	r->size = n;
-    return BM_SUCCESS;
+	/* drop leading zero limbs so that the size stays exact */
+	bm_trim(r,a->size);
+	return BM_SUCCESS;
 }
 
 /**
  * \brief Add two bignums and neglect the sign, just do the required
  *   binary arithmetic. The target bignum gets "reset" and adjusted to 
- *   a required size.
+ *   a required size. The result bignum may overlap with input bignums.
  *
  * \param r A pointer to the target bignum.
  * \param a A pointer to a bignum to add.
@@ -266,38 +655,34 @@ static int bm_sub_nosign( bm_t *r, const bm_t *a, const bm_t *b ) {
  */
 
 static int bm_add_nosign( bm_t *r, const bm_t *a, const bm_t *b ) {
-    int n, m;
-    uint64_t c;   /**< Used also as a carry */
+	bm_limb_t c;
+	int n, m;
 
-    m = BM_MAX(a->size,b->size); 
-	c = 0ULL;
-    
-	if (m >= r->maxs) {
-		/* make sure stuff fits into the destination bignum */
-		if ((n = bm_resize(r)) != BM_SUCCESS) {
-			return n;
-		}
+	if (a->size < b->size) {
+		const bm_t *t = a;
+		a = b;
+		b = t;
 	}
-    for (n = 0; n < m; n++) {
-		uint64_t A=0ULL, B=0ULL;
 
-		if (n < a->maxs) {
-			A = a->b[n];
-		}
-		if (n < b->maxs) {
-			B = b->b[n];
-		}
+	n = a->size;
 
-		c = A + B + c;
-        r->b[n] = c;
-        c >>= 32;
-    }
-    if (c) {
-		r->b[n++] = c;
+	/* make sure stuff fits into the destination bignum */
+	if ((m = bm_reserve(r,n)) != BM_SUCCESS) {
+		return m;
+	}
+
+	c = bm_add_n(r->b,a->b,b->b,b->size);
+	c = bm_add_1(r->b+b->size,a->b+b->size,n-b->size,c);
+
+	if (c) {
+		if ((m = bm_reserve(r,n+1)) != BM_SUCCESS) {
+			return m;
+		}
+		r->b[n++] = 1;
 	}
 
 	r->size = n;
-    return BM_SUCCESS;
+	return BM_SUCCESS;
 }
 
 /**
@@ -343,8 +728,6 @@ static int bm_cmp_nosign( const bm_t *a, const bm_t *b ) {
  */
 
 int bm_cmp( const bm_t *a, const bm_t *b ) {
-    int m,n;
-
 	if (a->sign != b->sign) {
 		if (a->sign == BM_NEG) {
 			return -1;
@@ -352,12 +735,6 @@ int bm_cmp( const bm_t *a, const bm_t *b ) {
 			return 1;
 		}
 	}
-	if (a->size < b->size) {
-		return -1 * a->sign;
-	}
-	if (a->size > b->size) {
-		return 1 * a->sign;
-	}
 
 	return a->sign * bm_cmp_nosign(a,b);
 }
@@ -371,6 +748,9 @@ int bm_cmp( const bm_t *a, const bm_t *b ) {
  */
 
 int bm_cmp_ui( const bm_t *a, uint32_t v ) {
+	if (a->sign == BM_NEG) {
+		return -1;
+	}
 	if (a->size > 1) {
 		return 1;
 	}
@@ -397,8 +777,7 @@ int bm_cmp_ui( const bm_t *a, uint32_t v ) {
  */
 
 int bm_add( bm_t *r, const bm_t *a, const bm_t *b ) {
-	int m,n;
-	uint64_t c;
+	int m;
 
 	/*
 	 * 1) r = a + b
@@ -410,15 +789,15 @@ int bm_add( bm_t *r, const bm_t *a, const bm_t *b ) {
     if (a->sign != b->sign) {
 		m = bm_cmp_nosign(a,b);
 
-		if (a->sign == BM_POS) {
-            /* case 2)..  */
-			r->sign = m >= 0 ? BM_POS : BM_NEG;
-			return bm_sub_nosign(r,a,b); 
-        } else {
-            /* case 3)..  */
-			r->sign = m > 0 ? BM_NEG : BM_POS;
-            return bm_sub_nosign(r,b,a);
-        }
+		if (m < 0) {
+			const bm_t *t = a;
+			a = b;
+			b = t;
+		}
+
+		/* cases 2) and 3), the bigger magnitude gives the sign */
+		r->sign = a->sign;
+		return bm_sub_nosign(r,a,b);
     }
 
     /* cases 1) and 4) */
@@ -438,30 +817,21 @@ int bm_add( bm_t *r, const bm_t *a, const bm_t *b ) {
  */
 
 int bm_add_ui( bm_t * a, uint32_t v ) {
-    int m,n;
-    uint64_t c = 0;
-    uint64_t d = (uint64_t)v;
-
-    for (n = 0; n < a->size; n++) {
-        uint64_t A = a->b[n];
-        c = A + d + c;
-        a->b[n] = c;
-        c >>= 32;
-    }
-    if (c > 0) {
-        if (a->size == a->maxs) {
-            if ((m = bm_resize(a)) != BM_SUCCESS) {
-                return m;
-            }
-        }
-        a->b[a->size++] = c;
-    }
+	bm_t t;
+	int n;
 
-    return BM_SUCCESS;
-}
+	bm_init(&t);
 
-/**
- * \brief Add a signed integer to a bignum. 
+	if ((n = bm_set_ui(&t,v)) == BM_SUCCESS) {
+		n = bm_add(a,a,&t);
+	}
+
+	bm_done(&t);
+	return n;
+}
+
+/**
+ * \brief Add a signed integer to a bignum. 
  *
  * \param[inout] a A pointer to a destination bignum.
  * \param[in] v A signed integer to add.
@@ -470,34 +840,17 @@ int bm_add_ui( bm_t * a, uint32_t v ) {
  */
 
 int bm_add_si( bm_t * a, int32_t v ) {
-    int m,n;
-    uint64_t c = 0;
-    uint64_t d = (uint64_t)v;
-	int sign = v >= 0 ? BM_POS : BM_NEG;
+	bm_t t;
+	int n;
 
-	/* The obly case where sign can change is when the size of the bignum is 1 */
+	bm_init(&t);
 
-	if (a->size == 1 && a->sign != sign) {
-		a->sign *= sign;
+	if ((n = bm_set_si(&t,v)) == BM_SUCCESS) {
+		n = bm_add(a,a,&t);
 	}
-    for (n = 0; n < a->size; n++) {
-        uint64_t A = a->b[n];
-        c = A + d + c;
-        a->b[n] = c;
-        c >>= 32;
-    }
-    if (c > 0) {
-		if (a->sign == BM_NEG && c != 0xffffffff) {
-			if (a->size == a->maxs) {
-				if ((m = bm_resize(a)) != BM_SUCCESS) {
-					return m;
-				}
-			}
-			a->b[a->size++] = c;
-		}
-    }
 
-    return BM_SUCCESS;
+	bm_done(&t);
+	return n;
 }
 
 
@@ -513,9 +866,6 @@ int bm_add_si( bm_t * a, int32_t v ) {
  */
 
 int bm_sub( bm_t *r, const bm_t *a, const bm_t *b ) {
-    int m,n;
-	uint64_t c;
-
     /* test signess cases. There are four case:
      * 1) r = a - b       -> r = a - b
      * 2) r = a - (-b)    -> r = a + b
@@ -564,7 +914,7 @@ int bm_set_si( bm_t *r, int32_t l ) {
         r->b[0] = (uint32_t)l;
         r->sign = BM_POS;
     } else {
-        r->b[0] = (uint32_t)(-l);
+        r->b[0] = 0U - (uint32_t)l;
         r->sign = BM_NEG;
     }
 
@@ -604,43 +954,34 @@ int bm_set_ui( bm_t *r, uint32_t l ) {
  */
 
 int bm_set_b( bm_t *r, const unsigned char *b, int i ) {
-    int n,m;
-	uint32_t l;
+	int n,m,k;
+	bm_limb_t l;
 
 	if (i < 1) {
 		return -BM_ERROR_NOT_A_NUMBER;
 	}
 
-	/* get the number of long words the number is going to take */
-    m = get_size_in_longs(i);
+	/* get the number of limbs the number is going to take */
+	m = get_size_in_longs(i);
 
-    if (m > r->maxs) {
-		if ((m = bm_resize(r)) != BM_SUCCESS) {
-			return m;
-		}
+	if (m > BM_MAX_SIZE) {
+		return -BM_ERROR_NUMBER_TOO_BIG;
 	}
 
-	l = 0;
-	m = 0;
-	n = 0;
-
-	while (i > 0) {
-		l >>= 8;
-		l |= b[--i] << 24;
-		n++;
+	if ((n = bm_reserve(r,m)) != BM_SUCCESS) {
+		return n;
+	}
 
-		if ((n & 3) == 0) {
-			r->b[m++] = l;
-			l = 0;
+	/* the octets are big endian, the limbs least significant first */
+	for (n = 0; n < m; n++) {
+		for (k = 0, l = 0; k < sizeof(bm_limb_t) && i > 0; k++) {
+			l |= (bm_limb_t)b[--i] << (k*8);
 		}
-	}
-	if ((n & 3) != 0) { 
-		l >>= (32 - (n & 3) * 8);
-		r->b[m++] = l;
+		r->b[n] = l;
 	}
 
-	r->size = m;
     r->sign = BM_POS;
+	bm_trim(r,m);
     return BM_SUCCESS;
 }
 
@@ -657,10 +998,11 @@ int bm_set_b( bm_t *r, const unsigned char *b, int i ) {
 int bm_set( bm_t *d, const bm_t *a ) {
 	int n;
 	
-	if (a->maxs > d->maxs) {
-	    if ((n = bm_set_size(d,a->maxs)) != BM_SUCCESS) {
-            return n;
-        }
+	if (d == a) {
+		return BM_SUCCESS;
+	}
+	if ((n = bm_reserve(d,a->size)) != BM_SUCCESS) {
+		return n;
 	}
 
 	d->size = a->size;
@@ -735,61 +1077,38 @@ static void bm_neg_b( uint8_t *b, int l ) {
  */
 
 int bm_get_b( const bm_t *a, unsigned char *b, int i ) {
-    int n,m;
-	uint32_t l;
+    int n,m,k;
+	bm_limb_t l;
 	uint8_t *b2 = b;
 
 	if (i < 1) {
 		return -BM_ERROR_INTERNAL_ERROR;
 	}
 
-	m = get_size_in_longs(i);
-
-	if (m < a->size) {
-		return -BM_ERROR_NUMBER_TOO_BIG;
-	}
-	
-	/* the highest long word gets special treatment mostly
+	/* the highest limb gets special treatment mostly
 	 * to trim the output nicely i.e. no leading zeroes
 	 */
 
 	m = a->size;
 	l = a->b[--m];
 
-	if (l > 0x00ffffff) {
-		n = 4;
-	} else if (l > 0x0000ffff) {
-		n = 3;
-	} else if (l > 0x000000ff) {
-		n = 2;
-	} else if (l > 0x00000000) {
-		n = 1;
-	} else if (m > 0) {
-		n = 0;
-	} else {
-		n = 1;
+	for (n = 1; n < sizeof(bm_limb_t) && (l >> (n*8)); n++);
+
+	if (n + m * (int)sizeof(bm_limb_t) > i) {
+		return -BM_ERROR_NUMBER_TOO_BIG;
 	}
 
-	switch (n) {
-	case 4:
-		*b++ = l >> 24;
-	case 3:
-		*b++ = l >> 16;
-	case 2:
-		*b++ = l >> 8;
-	case 1:
-		*b++ = l;
-	default:
-		break;
+	for (k = n; k > 0; k--) {
+		*b++ = l >> ((k-1)*8);
 	}
 		
 	while (--m >= 0) {
 		l = a->b[m];
-		*b++ = l >> 24;
-		*b++ = l >> 16;
-		*b++ = l >> 8;
-		*b++ = l;
-		n += 4;
+
+		for (k = sizeof(bm_limb_t); k > 0; k--) {
+			*b++ = l >> ((k-1)*8);
+		}
+		n += sizeof(bm_limb_t);
 	}
 
 	/* check the sign */
@@ -802,277 +1121,1535 @@ int bm_get_b( const bm_t *a, unsigned char *b, int i ) {
 }
 
 /**
- * \brief A signed multiplication. This can be considered an elementary school
- *   level algorithm :) Note that the result bignum can be the same as either
- *   one of the input bignums. Also both input bignums can be the same. This is
- *   done at the expense of a temporary bignum, which takes some more space and
- *   slows down the function slightly.
+ * \brief Shift a limb array left, i.e. r = a << s. The result may be
+ *   the input.
  *
- * \param r A pointer to a result bignumber.
- * \param a A pointer to a bignumber to multiply.
- * \param b A pointer to a bignumber to multiplicant.
+ * \param r A pointer to the result limbs.
+ * \param a A pointer to the input limbs.
+ * \param n The number of limbs.
+ * \param s The number of bits to shift (0 to BM_LIMB_BITS-1).
  *
- * \return BM_SUCCESS if multiplication succeeded. Note that
- *   if there is an error, the target bignun will be in inconsistent
- *   state, i.e. one cannot expect it to contain a valid number.
+ * \return The bits shifted out of the highest limb.
  */
 
-int bm_mul( bm_t *r, const bm_t *a, const bm_t *b ) {
-	int i,o,n,m;
-	const bm_t *a1,*b1;
-	bm_t rr;
-    uint64_t c;
+static bm_limb_t bm_lshift( bm_limb_t *r, const bm_limb_t *a, int n, int s ) {
+	bm_limb_t c;
+	int i;
 
-	/* make sure we got enough space for the result */
+	if (s == 0) {
+		for (i = n-1; i >= 0; i--) {
+			r[i] = a[i];
+		}
+		return 0;
+	}
 
-	m = a->size + b->size;
+	c = a[n-1] >> (BM_LIMB_BITS-s);
 
-	/* check for pathetic cases */
+	for (i = n-1; i > 0; i--) {
+		r[i] = a[i] << s | a[i-1] >> (BM_LIMB_BITS-s);
+	}
+	r[0] = a[0] << s;
+	return c;
+}
 
-	if (bm_is_zero(a) || bm_is_zero(b)) {
-		return bm_set_si(r,0);
+/**
+ * \brief Shift a limb array right, i.e. r = a >> s. The result may be
+ *   the input.
+ *
+ * \param r A pointer to the result limbs.
+ * \param a A pointer to the input limbs.
+ * \param n The number of limbs.
+ * \param s The number of bits to shift (0 to BM_LIMB_BITS-1).
+ *
+ * \return Nothing.
+ */
+
+static void bm_rshift( bm_limb_t *r, const bm_limb_t *a, int n, int s ) {
+	int i;
+
+	if (s == 0) {
+		for (i = 0; i < n; i++) {
+			r[i] = a[i];
+		}
+		return;
 	}
+	for (i = 0; i < n-1; i++) {
+		r[i] = a[i] >> s | a[i+1] << (BM_LIMB_BITS-s);
+	}
+	r[n-1] = a[n-1] >> s;
+}
 
-    /* set the temp bignum.. */
+/**
+ * \brief Add a shorter limb array to a longer one, i.e. x = x + y.
+ *
+ * \param x A pointer to the limbs to add to.
+ * \param xn The number of limbs in x.
+ * \param y A pointer to the limbs to add.
+ * \param yn The number of limbs in y, at most xn.
+ *
+ * \return The carry out.
+ */
 
-    bm_init(&rr);
+static bm_limb_t bm_addto( bm_limb_t *x, int xn, const bm_limb_t *y, int yn ) {
+	bm_limb_t c = bm_add_n(x,x,y,yn);
 
-	/* we will have a non-zero result */
+	return bm_add_1(x+yn,x+yn,xn-yn,c);
+}
 
-	rr.sign = a->sign * b->sign;
+/**
+ * \brief The absolute difference of limb arrays, i.e. d = |x - y|.
+ *
+ * \param d A pointer to the result limbs, h limbs.
+ * \param x A pointer to the first limbs, h limbs.
+ * \param h The number of limbs in x.
+ * \param y A pointer to the second limbs, h or h-1 limbs.
+ * \param k The number of limbs in y.
+ *
+ * \return 1 if x >= y, -1 otherwise.
+ */
 
-	while (m > rr.maxs) {
-		if ((n = bm_resize(&rr)) != BM_SUCCESS) {
-			return n;
-		}
-	}
-	
-	/* initialize the target bignum to all zeroes to ease the calculations */
-	while (--m >= 0) {
-		rr.b[m] = 0;
+static int bm_absdiff( bm_limb_t *d, const bm_limb_t *x, int h, const bm_limb_t *y, int k ) {
+	int i;
+
+	if (h > k && x[k]) {
+		d[k] = x[k] - bm_sub_n(d,x,y,k);
+		return 1;
 	}
-	if (a->size >= b->size) {
-		a1 = a; 
-		b1 = b;
-	} else {
-		a1 = b;
-		b1 = a;
+	for (i = k-1; i >= 0 && x[i] == y[i]; i--);
+
+	if (h > k) {
+		d[k] = 0;
 	}
-	for (o = 0; o < b1->size; o++) {
-		uint64_t B=(uint64_t)b1->b[o];
-		c = 0ULL;
-		
-		if (B == 0) {
-			continue;
-		}
-		for (i = 0; i < a1->size; i++) {
-			uint64_t A = a1->b[i];
-			uint64_t R = rr.b[o+i];
-			c = A * B + R + c;
-			rr.b[o+i] = c;
-			c >>= 32;
-		}
-		if (c) {
-			rr.b[o+i] = c;
-		}
+	if (i < 0 || x[i] > y[i]) {
+		bm_sub_n(d,x,y,k);
+		return 1;
 	}
 
-	bm_trim(&rr,o+i);
-	o = bm_set(r,&rr);
-    bm_done(&rr);
-
-    return n;
+	bm_sub_n(d,y,x,k);
+	return -1;
 }
 
 /**
- * \brief Bitwise logical shift left.  Note that the result bignum
- *   can also be the input bignum.
+ * \brief The schoolbook multiplication of limb arrays, r = a * b.
  *
- * \param[out] r A pointer to a result bignum.
- * \param[in] a A pointer to a bignum to shift.
- * \param[in] n Number of bits to shift (0 to 31).
- * \return BM_SUCCESS if OK, error otherwise.
+ * \param r A pointer to the result limbs, an+bn limbs.
+ * \param a A pointer to the first limbs.
+ * \param an The number of limbs in a.
+ * \param b A pointer to the second limbs.
+ * \param bn The number of limbs in b.
+ *
+ * \return Nothing.
  */
 
-int bm_asl( bm_t *r, const bm_t *a, int n ) {
-	uint32_t c;
-	int i;
+static void bm_mul_basecase( bm_limb_t *r, const bm_limb_t *a, int an, const bm_limb_t *b, int bn ) {
+	int o;
 
-	n %= 32;
+	for (o = 0; o < an+bn; o++) {
+		r[o] = 0;
+	}
 
-	if (a->size >= r->maxs) {
-		if ((i = bm_resize(r)) != BM_SUCCESS) {
-			return i;
+	/* one row of a times a limb of b at a time */
+	for (o = 0; o < bn; o++) {
+		if (b[o]) {
+			r[o+an] = bm_addmul_1(r+o,a,an,b[o]);
 		}
 	}
-	for (i = 0, c = 0; i < a->size; i++) {
-		uint32_t A = a->b[n];
-		r->b[i] = A << n | c;
-		c = A >> 32-n;
+}
+
+/**
+ * \brief Square a limb array. Each cross product a_i a_j, i < j, is
+ *   computed once, the sum of them is doubled with a shift and the
+ *   squares a_i^2 are added on the diagonal.
+ *
+ * \param r A pointer to the result limbs, 2n limbs. Must not overlap a.
+ * \param a A pointer to the limbs.
+ * \param n The number of limbs in a.
+ *
+ * \return Nothing.
+ */
+
+static void bm_sqr_basecase( bm_limb_t *r, const bm_limb_t *a, int n ) {
+	bm_dlimb_t p, s;
+	bm_limb_t c;
+	int o;
+
+	for (o = 0; o < 2*n; o++) {
+		r[o] = 0;
 	}
-	if (c) {
-		r->b[i++] = c;
+
+	/* the cross products above the diagonal */
+	for (o = 0; o < n-1; o++) {
+		if (a[o]) {
+			r[o+n] = bm_addmul_1(r+2*o+1,a+o+1,n-o-1,a[o]);
+		}
 	}
 
-	r->size = i;
-	r->sign = a->sign;
-	return BM_SUCCESS;
+	bm_lshift(r,r,2*n,1);
+
+	/* the diagonal */
+	for (c = 0, o = 0; o < n; o++) {
+		p = (bm_dlimb_t)a[o] * a[o];
+		s = (bm_dlimb_t)r[2*o] + (bm_limb_t)p + c;
+		r[2*o] = (bm_limb_t)s;
+		s = (bm_dlimb_t)r[2*o+1] + (bm_limb_t)(p >> BM_LIMB_BITS) + (s >> BM_LIMB_BITS);
+		r[2*o+1] = (bm_limb_t)s;
+		c = s >> BM_LIMB_BITS;
+	}
 }
 
+static void bm_mul_n( bm_limb_t *, const bm_limb_t *, const bm_limb_t *, int, bm_limb_t * );
+static void bm_sqr_n( bm_limb_t *, const bm_limb_t *, int, bm_limb_t * );
+
 /**
- * \brief Bitwise arithmetic shift right. Note that the result bignum
- *   can be the input bignum.
+ * \brief The number of scratch limbs bm_mul_n() needs.
  *
- * \param[out] r A pointer to a result bignum.
- * \param[in] a A pointer to a bignum to shift.
- * \param[in] n Number of bits to shift (0 to 31).
- * \return BM_SUCCESS if OK, error otherwise.
+ * \param n The number of limbs in the operands.
+ *
+ * \return The number of limbs.
  */
 
-int bm_asr( bm_t *r, const bm_t *a, int n ) {
-	uint32_t c;
-	int i;
+static int bm_mul_n_scratch( int n ) {
+	int k;
+
+	if (n < BM_KARATSUBA_THRESHOLD) {
+		return 0;
+	}
+	if (n < BM_TOOM3_THRESHOLD) {
+		k = n - n / 2;
+		return 6 * k + 1 + bm_mul_n_scratch(k);
+	}
+
+	k = (n + 2) / 3;
+	return 19 * (k + 1) + bm_mul_n_scratch(k + 1);
+}
+
+/**
+ * \brief The number of scratch limbs bm_sqr_n() needs.
+ *
+ * \param n The number of limbs in the operand.
+ *
+ * \return The number of limbs.
+ */
 
-	n %= 32;
-    c = 0;
+static int bm_sqr_n_scratch( int n ) {
+	int k;
 
-	for (i = a->size-1; i >= 0; i--) {
-		uint32_t A = a->b[i];
-		r->b[i]  = A >> n | c;
-		c = A << 32-n;
+	if (n < BM_SQR_KARATSUBA_THRESHOLD) {
+		return 0;
+	}
+	if (n < BM_TOOM3_THRESHOLD) {
+		k = n - n / 2;
+		return 5 * k + 1 + bm_sqr_n_scratch(k);
 	}
 
-	bm_trim(r,a->size);
-	r->sign = a->sign;
-	return BM_SUCCESS;
+	k = (n + 2) / 3;
+	return 19 * (k + 1) + bm_sqr_n_scratch(k + 1);
 }
 
 /**
- * \brief A signed division. This can be considered an elementary school
- *   level algorithm, which takes a lousy O(n^2) time.
+ * \brief Karatsuba multiplication of limb arrays of equal length. With
+ *   a = a1 B^k + a0 and b = b1 B^k + b0 the middle product is
+ *   a0 b1 + a1 b0 = a0 b0 + a1 b1 - (a1 - a0)(b1 - b0), i.e. three
+ *   half size products instead of four.
  *
- * \param[out] q A pointer to a quotient bignumber.
- * \param[out] r A pointer to s reminder bignumber.
- * \param[in] n A pointer to a bignumber to numerator.
- * \param[in] d A pointer to a bignumber to denominator.
+ * \param r A pointer to the result limbs, 2n limbs.
+ * \param a A pointer to the first limbs.
+ * \param b A pointer to the second limbs.
+ * \param n The number of limbs in a and b.
+ * \param t A pointer to bm_mul_n_scratch(n) scratch limbs.
  *
- * \return BM_SUCCESS if multiplication succeeded. Note that
- *   if there is an error, the target bignun will be in inconsistent
- *   state, i.e. one cannot expect it to contain a valid number.
+ * \return Nothing.
  */
 
-int bm_div( bm_t *q, bm_t *r, const bm_t *n, const bm_t *d ) {
-	int i,o,m;
+static void bm_mul_karatsuba( bm_limb_t *r, const bm_limb_t *a, const bm_limb_t *b, int n, bm_limb_t *t ) {
+	int k = n / 2, h = n - k;
+	bm_limb_t *da = t, *db = t + h, *m = t + 2*h, *w = t + 4*h;
+	int i, s;
 
-	/* check for pathetic cases */
+	s = bm_absdiff(da,a+k,h,a,k);
+	s *= bm_absdiff(db,b+k,h,b,k);
 
-	if (bm_is_zero(d)) {
-		return BM_ERROR_DIV_BY_ZERO;
+	bm_mul_n(r,a,b,k,w+2*h+1);
+	bm_mul_n(r+2*k,a+k,b+k,h,w+2*h+1);
+	bm_mul_n(m,da,db,h,w+2*h+1);
+
+	/* w = a0 b0 + a1 b1 -+ |a1 - a0| |b1 - b0| */
+	for (i = 0; i < 2*h; i++) {
+		w[i] = i < 2*k ? r[i] : 0;
 	}
+	w[2*h] = bm_addto(w,2*h,r+2*k,2*h);
 
-    m = bm_cmp_nosign(n,d);
+	if (s > 0) {
+		w[2*h] -= bm_sub_n(w,w,m,2*h);
+	} else {
+		w[2*h] += bm_add_n(w,w,m,2*h);
+	}
 
-    if (m == 0) {
-        if ((m = bm_set_si(r,0)) != BM_SUCCESS) {
-            return m;
-        }
-        m = n->sign * d->sign;
-        return bm_set_si(q,m);
-    }
-    if (m < 0) {
-        if ((m = bm_set_si(q,0)) != BM_SUCCESS) {
-            return m;
-        }
-        return bm_set(r,n);
-    }
+	/* the product fits into 2n limbs, thus the carry out is zero */
+	bm_addto(r+k,2*n-k,w,2*h+1);
+}
+
+/**
+ * \brief Karatsuba squaring. With a = a1 B^k + a0 the middle product is
+ *   2 a0 a1 = a0^2 + a1^2 - (a1 - a0)^2, where the last square is never
+ *   negative.
+ *
+ * \param r A pointer to the result limbs, 2n limbs.
+ * \param a A pointer to the limbs.
+ * \param n The number of limbs in a.
+ * \param t A pointer to bm_sqr_n_scratch(n) scratch limbs.
+ *
+ * \return Nothing.
+ */
 
-	/* we will probably have a non-zero result */
+static void bm_sqr_karatsuba( bm_limb_t *r, const bm_limb_t *a, int n, bm_limb_t *t ) {
+	int k = n / 2, h = n - k;
+	bm_limb_t *da = t, *m = t + h, *w = t + 3*h;
+	int i;
 
-    m = n->size - d->size + 1;
+	bm_absdiff(da,a+k,h,a,k);
 
-	while (m > r->maxs) {
-		if ((i = bm_resize(r)) != BM_SUCCESS) {
-            return i;
-		}
-    }
-    while (m > q->maxs) {
-        if ((i = bm_resize(q)) != BM_SUCCESS) {
-            return i;
-        }
+	bm_sqr_n(r,a,k,w+2*h+1);
+	bm_sqr_n(r+2*k,a+k,h,w+2*h+1);
+	bm_sqr_n(m,da,h,w+2*h+1);
+
+	/* w = a0^2 + a1^2 - (a1 - a0)^2 */
+	for (i = 0; i < 2*h; i++) {
+		w[i] = i < 2*k ? r[i] : 0;
 	}
+	w[2*h] = bm_addto(w,2*h,r+2*k,2*h);
+	w[2*h] -= bm_sub_n(w,w,m,2*h);
 
-    /* long divide algorithm.. not the greatest ;-) The algorithm is
-	 * basically the normal school division algorithm shifting in 
-	 * long words of numerator as needed.
-	 *
-     * Shift in denominator size of long words of nominator for division
-	 */
-	
-    bm_set_si(q,0);
-    i = n->size;
-    
-	/* this is special, we are hand crafting remainder bignum.. */
-	r->size = 0;
-
-    while (i > 0) {
-        uint32_t c = 0;
-      
-		for (m = r->size; m > 0; m--) {
-			r->b[m] = r->b[m-1];
-		}
-		r->b[0] = n->b[--i];
-		r->size++;
+	bm_addto(r+k,2*n-k,w,2*h+1);
+}
 
-		while ((m = bm_cmp_nosign(r,d)) >= 0) {
-			c++;
-			bm_sub_nosign(r,r,d);
-		}
-        if (c > 0) {
-            if ((m = bm_add_ui(q,c)) != BM_SUCCESS) {
-                return m;
-            }
-        }
-    }
+/**
+ * \brief Arithmetic shift right by one of a two's complement limb array.
+ *
+ * \param x A pointer to the limbs.
+ * \param n The number of limbs.
+ *
+ * \return Nothing.
+ */
 
-    /* and last fix the sign */
+static void bm_sar1( bm_limb_t *x, int n ) {
+	bm_limb_t s = x[n-1] & ((bm_limb_t)1 << (BM_LIMB_BITS-1));
 
-    r->sign = n->sign * d->sign;
-    q->sign = r->sign;
-	return BM_SUCCESS;
+	bm_rshift(x,x,n,1);
+	x[n-1] |= s;
 }
 
+/**
+ * \brief Exact division by 3 of a two's complement limb array. The
+ *   quotient limbs are the limbs times the inverse of 3 modulo the limb
+ *   base, the borrows are propagated upwards.
+ *
+ * \param x A pointer to the limbs.
+ * \param n The number of limbs.
+ *
+ * \return Nothing.
+ */
+
+static void bm_divexact_3( bm_limb_t *x, int n ) {
+	const bm_limb_t inv = BM_LIMB_MASK / 3 * 2 + 1;
+	const bm_limb_t one = BM_LIMB_MASK / 3 + 1;
+	const bm_limb_t two = BM_LIMB_MASK / 3 * 2 + 1;
+	bm_limb_t c = 0, l, q;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		l = x[i] - c;
+		c = x[i] < c;
+		q = l * inv;
+		x[i] = q;
+		c += (q >= one) + (q >= two);
+	}
+}
 
 /**
- * \brief Calculate a modular exponentiation.
- * \param[out] r A pointer to a result bignum.
- * \param[in] b A pointer to a base bignum value.
- * \param[in] e A pointer to an exponent bignum value.
- * \param[in] m A pointer to a modulus bignum value.
+ * \brief A signed product of two magnitudes as a two's complement limb
+ *   array.
  *
- * \return BM_SUCCESS if OK. Negative error code otherwise.
+ * \param r A pointer to the result limbs, 2n limbs.
+ * \param a A pointer to the first limbs.
+ * \param b A pointer to the second limbs.
+ * \param n The number of limbs in a and b.
+ * \param s The sign of the product.
+ * \param t A pointer to the scratch limbs for bm_mul_n().
+ *
+ * \return Nothing.
+ */
+
+static void bm_mul_signed( bm_limb_t *r, const bm_limb_t *a, const bm_limb_t *b, int n, int s, bm_limb_t *t ) {
+	int i;
+
+	bm_mul_n(r,a,b,n,t);
+
+	if (s < 0) {
+		for (i = 0; i < 2*n; i++) {
+			r[i] = ~r[i];
+		}
+		bm_add_1(r,r,2*n,1);
+	}
+}
+
+/**
+ * \brief Evaluate a three part split of a limb array at 1, -1 and 2.
  *
- * The following algorithm is used for calculating the modular
- * exponentiation.
+ * \param e A pointer to the output, three values of k+1 limbs: a(1),
+ *   |a(-1)| and a(2).
+ * \param a A pointer to the limbs, a = a2 B^2k + a1 B^k + a0.
+ * \param k The number of limbs in a0 and a1.
+ * \param r The number of limbs in a2.
  *
+ * \return The sign of a(-1).
+ */
+
+static int bm_toom3_eval( bm_limb_t *e, const bm_limb_t *a, int k, int r ) {
+	const bm_limb_t *a0 = a, *a1 = a + k, *a2 = a + 2*k;
+	bm_limb_t *p1 = e, *m1 = e + k + 1, *p2 = e + 2*k + 2;
+	int i, s;
+
+	/* p2 is used for a0 + a2 first */
+	for (i = 0; i < k; i++) {
+		p2[i] = a0[i];
+	}
+	p2[k] = bm_addto(p2,k,a2,r);
+
+	for (i = 0; i <= k; i++) {
+		p1[i] = p2[i];
+	}
+	p1[k] += bm_addto(p1,k,a1,k);
+	s = bm_absdiff(m1,p2,k+1,a1,k);
+
+	/* a(2) = ((a2 2) + a1) 2 + a0 */
+	for (i = 0; i <= k; i++) {
+		p2[i] = i < r ? a2[i] : 0;
+	}
+	bm_lshift(p2,p2,k+1,1);
+	bm_addto(p2,k+1,a1,k);
+	bm_lshift(p2,p2,k+1,1);
+	bm_addto(p2,k+1,a0,k);
+	return s;
+}
+
+/**
+ * \brief Toom-3 multiplication of limb arrays of equal length. The
+ *   operands are split into three parts, i.e. into polynomials of
+ *   degree 2 at B^k, which are evaluated at 0, 1, -1, 2 and infinity.
+ *   The five products of the values give the five coefficients of the
+ *   product polynomial.
  *
- * function modular_pow(base, exponent, modulus)
- *   result := 1
- *	while exponent > 0
- *		if (exponent mod 2 == 1):
- *		   result := (result * base) mod modulus
- *	   exponent := exponent >> 1
- *	   base = (base * base) mod modulus
- *   return result
+ * \param r A pointer to the result limbs, 2n limbs.
+ * \param a A pointer to the first limbs.
+ * \param b A pointer to the second limbs.
+ * \param n The number of limbs in a and b.
+ * \param t A pointer to bm_mul_n_scratch(n) scratch limbs.
  *
+ * \return Nothing.
  */
 
-int bm_powm( bm_t *res, const bm_t *b, const bm_t *e, const bm_t *m ) {
-	int n;
-	bm_t nil, exp, bas, tmp;
-    
-	bm_inits(&nil,&exp,&bas,&tmp,NULL);
+static void bm_mul_toom3( bm_limb_t *r, const bm_limb_t *a, const bm_limb_t *b, int n, bm_limb_t *t ) {
+	int k = (n + 2) / 3, l = 2*k + 2, q = n - 2*k;
+	bm_limb_t *ea = t, *eb = t + 3*(k+1);
+	bm_limb_t *w0 = eb + 3*(k+1), *w1 = w0 + l, *wm = w1 + l, *w2 = wm + l, *w4 = w2 + l;
+	bm_limb_t *u = w4 + l, *tt = u + l;
+	int i, s;
 
-    if ((n = bm_set_ui(res,1)) != BM_SUCCESS) {
+	/* a square evaluates its operand once, the point products are then
+	 * squares too
+	 */
+	s = bm_toom3_eval(ea,a,k,q);
+
+	if (a == b) {
+		eb = ea;
+		s = 1;
+	} else {
+		s *= bm_toom3_eval(eb,b,k,q);
+	}
+
+	/* the values at 0 and infinity */
+	for (i = 0; i < l; i++) {
+		w0[i] = 0;
+		w4[i] = 0;
+	}
+	bm_mul_n(w0,a,b,k,tt);
+	bm_mul_n(w4,a+2*k,b+2*k,q,tt);
+
+	/* the values at 1, -1 and 2 */
+	bm_mul_n(w1,ea,eb,k+1,tt);
+	bm_mul_signed(wm,ea+k+1,eb+k+1,k+1,s,tt);
+	bm_mul_n(w2,ea+2*k+2,eb+2*k+2,k+1,tt);
+
+	/* interpolate in two's complement, the coefficients are c0 = w0,
+	 * c4 = w4 and
+	 *   w1 = (w(1) - w(-1)) / 2 = c1 + c3
+	 *   wm = (w(1) + w(-1)) / 2 - c0 - c4 = c2
+	 *   w2 = (w(2) - c0 - 4 c2 - 16 c4) / 2 = c1 + 4 c3
+	 *   w2 = (w2 - w1) / 3 = c3
+	 *   w1 = w1 - c3 = c1
+	 */
+	bm_add_n(u,w1,wm,l);
+	bm_sub_n(w1,w1,wm,l);
+	bm_sar1(w1,l);
+	bm_sar1(u,l);
+	bm_sub_n(u,u,w0,l);
+	bm_sub_n(wm,u,w4,l);
+
+	bm_sub_n(w2,w2,w0,l);
+	bm_lshift(u,wm,l,2);
+	bm_sub_n(w2,w2,u,l);
+	bm_lshift(u,w4,l,4);
+	bm_sub_n(w2,w2,u,l);
+	bm_sar1(w2,l);
+	bm_sub_n(w2,w2,w1,l);
+	bm_divexact_3(w2,l);
+	bm_sub_n(w1,w1,w2,l);
+
+	/* recompose, all coefficients are non-negative and fit into the
+	 * result together
+	 */
+	for (i = 0; i < 2*n; i++) {
+		r[i] = 0;
+	}
+	for (i = 0; i < 2*k; i++) {
+		r[i] = w0[i];
+	}
+	for (i = 0; i < 2*q; i++) {
+		r[4*k+i] = w4[i];
+	}
+	bm_addto(r+k,2*n-k,w1,l);
+	bm_addto(r+2*k,2*n-2*k,wm,l < 2*n-2*k ? l : 2*n-2*k);
+	bm_addto(r+3*k,2*n-3*k,w2,l < 2*n-3*k ? l : 2*n-3*k);
+}
+
+/**
+ * \brief Multiply limb arrays of equal length with the algorithm the
+ *   size calls for.
+ *
+ * \param r A pointer to the result limbs, 2n limbs.
+ * \param a A pointer to the first limbs.
+ * \param b A pointer to the second limbs.
+ * \param n The number of limbs in a and b.
+ * \param t A pointer to bm_mul_n_scratch(n) scratch limbs.
+ *
+ * \return Nothing.
+ */
+
+static void bm_mul_n( bm_limb_t *r, const bm_limb_t *a, const bm_limb_t *b, int n, bm_limb_t *t ) {
+	if (a == b) {
+		bm_sqr_n(r,a,n,t);
+	} else if (n < BM_KARATSUBA_THRESHOLD) {
+		bm_mul_basecase(r,a,n,b,n);
+	} else if (n < BM_TOOM3_THRESHOLD) {
+		bm_mul_karatsuba(r,a,b,n,t);
+	} else {
+		bm_mul_toom3(r,a,b,n,t);
+	}
+}
+
+/**
+ * \brief Square a limb array with the algorithm the size calls for.
+ *
+ * \param r A pointer to the result limbs, 2n limbs.
+ * \param a A pointer to the limbs.
+ * \param n The number of limbs in a.
+ * \param t A pointer to bm_sqr_n_scratch(n) scratch limbs.
+ *
+ * \return Nothing.
+ */
+
+static void bm_sqr_n( bm_limb_t *r, const bm_limb_t *a, int n, bm_limb_t *t ) {
+	if (n < BM_SQR_KARATSUBA_THRESHOLD) {
+		bm_sqr_basecase(r,a,n);
+	} else if (n < BM_TOOM3_THRESHOLD) {
+		bm_sqr_karatsuba(r,a,n,t);
+	} else {
+		bm_mul_toom3(r,a,a,n,t);
+	}
+}
+
+/**
+ * \brief The number of scratch limbs bm_mul_limbs() needs.
+ *
+ * \param an The number of limbs in the longer operand.
+ * \param bn The number of limbs in the shorter operand.
+ *
+ * \return The number of limbs.
+ */
+
+static int bm_mul_scratch( int an, int bn ) {
+	if (bn < BM_KARATSUBA_THRESHOLD) {
+		return 0;
+	}
+	if (an == bn) {
+		return bm_mul_n_scratch(bn);
+	}
+
+	/* the pieces and the pieces of the last short piece.. */
+	return 10 * bn + bm_mul_n_scratch(bn);
+}
+
+/**
+ * \brief Multiply limb arrays. An unbalanced product is done in pieces
+ *   of the shorter operand.
+ *
+ * \param r A pointer to the result limbs, an+bn limbs.
+ * \param a A pointer to the longer limbs.
+ * \param an The number of limbs in a.
+ * \param b A pointer to the shorter limbs.
+ * \param bn The number of limbs in b, at most an.
+ * \param t A pointer to bm_mul_scratch(an,bn) scratch limbs.
+ *
+ * \return Nothing.
+ */
+
+static void bm_mul_limbs( bm_limb_t *r, const bm_limb_t *a, int an, const bm_limb_t *b, int bn, bm_limb_t *t ) {
+	int o, m;
+
+	if (bn < BM_KARATSUBA_THRESHOLD) {
+		bm_mul_basecase(r,a,an,b,bn);
+		return;
+	}
+
+	if (an == bn) {
+		bm_mul_n(r,a,b,bn,t);
+		return;
+	}
+
+	bm_mul_n(r,a,b,bn,t+2*bn);
+
+	for (o = 2*bn; o < an+bn; o++) {
+		r[o] = 0;
+	}
+	for (o = bn; o < an; o += bn) {
+		m = an - o < bn ? an - o : bn;
+
+		if (m == bn) {
+			bm_mul_n(t,a+o,b,bn,t+2*bn);
+		} else {
+			bm_mul_limbs(t,b,bn,a+o,m,t+2*bn);
+		}
+		bm_addto(r+o,an+bn-o,t,m+bn);
+	}
+}
+
+/**
+ * \brief A signed multiplication. Short operands use the schoolbook
+ *   algorithm, longer ones Karatsuba and the longest Toom-3, see
+ *   bm_mul_n(). Note that the result bignum can be the same as either
+ *   one of the input bignums. This is done at the expense of a temporary
+ *   bignum, which takes some more space and slows down the function
+ *   slightly. Also both input bignums can be the same, which is a square
+ *   and done with bm_sqr().
+ *
+ * \param r A pointer to a result bignumber.
+ * \param a A pointer to a bignumber to multiply.
+ * \param b A pointer to a bignumber to multiplicant.
+ *
+ * \return BM_SUCCESS if multiplication succeeded. Note that
+ *   if there is an error, the target bignun will be in inconsistent
+ *   state, i.e. one cannot expect it to contain a valid number.
+ */
+
+int bm_mul( bm_t *r, const bm_t *a, const bm_t *b ) {
+	int n,m;
+	const bm_t *a1,*b1;
+	bm_t rr, sc, *t = r;
+	bm_stack_t st;
+
+	/* check for pathetic cases */
+
+	if (bm_is_zero(a) || bm_is_zero(b)) {
+		return bm_set_si(r,0);
+	}
+	if (a == b) {
+		return bm_sqr(r,a);
+	}
+
+	/* make sure we got enough space for the result. This is done
+	 * before the temp bignums are taken so that arena temps stay
+	 * on the top and are given back by bm_done()
+	 */
+
+	m = a->size + b->size;
+
+	if (m > BM_MAX_SIZE) {
+		return -BM_ERROR_NUMBER_TOO_BIG;
+	}
+	if ((n = bm_reserve(r,m)) != BM_SUCCESS) {
+		return n;
+	}
+	if (a->size >= b->size) {
+		a1 = a; 
+		b1 = b;
+	} else {
+		a1 = b;
+		b1 = a;
+	}
+
+	bm_init_arena(&rr,bm_temp_arena(r,&st));
+	bm_init_arena(&sc,rr.arena);
+
+    /* the temp bignum is only needed if the result is an input */
+
+	if (r == a || r == b) {
+		if ((n = bm_reserve(&rr,m)) != BM_SUCCESS) {
+			goto mul_err;
+		}
+		t = &rr;
+	}
+	if ((n = bm_reserve(&sc,bm_mul_scratch(a1->size,b1->size))) != BM_SUCCESS) {
+		goto mul_err;
+	}
+
+	/* we will have a non-zero result */
+
+	t->sign = a->sign * b->sign;
+	bm_mul_limbs(t->b,a1->b,a1->size,b1->b,b1->size,sc.b);
+	bm_trim(t,m);
+
+	if (t == &rr) {
+		n = bm_set(r,&rr);
+	}
+
+mul_err:
+	bm_done(&sc);
+	bm_done(&rr);
+    return n;
+}
+
+/**
+ * \brief A square. The cross products are computed only once, thus
+ *   this is close to twice as fast as a multiplication of different
+ *   bignums. Note that the result bignum can be the input bignum.
+ *
+ * \param r A pointer to a result bignumber.
+ * \param a A pointer to a bignumber to square.
+ *
+ * \return BM_SUCCESS if squaring succeeded. See bm_mul() for errors.
+ */
+
+int bm_sqr( bm_t *r, const bm_t *a ) {
+	int n,m;
+	bm_t rr, sc, *t = r;
+	bm_stack_t st;
+
+	if (bm_is_zero(a)) {
+		return bm_set_si(r,0);
+	}
+
+	m = 2 * a->size;
+
+	if (m > BM_MAX_SIZE) {
+		return -BM_ERROR_NUMBER_TOO_BIG;
+	}
+	if ((n = bm_reserve(r,m)) != BM_SUCCESS) {
+		return n;
+	}
+
+	bm_init_arena(&rr,bm_temp_arena(r,&st));
+	bm_init_arena(&sc,rr.arena);
+
+	if (r == a) {
+		if ((n = bm_reserve(&rr,m)) != BM_SUCCESS) {
+			goto sqr_err;
+		}
+		t = &rr;
+	}
+	if ((n = bm_reserve(&sc,bm_sqr_n_scratch(a->size))) != BM_SUCCESS) {
+		goto sqr_err;
+	}
+
+	t->sign = BM_POS;
+	bm_sqr_n(t->b,a->b,a->size,sc.b);
+	bm_trim(t,m);
+
+	if (t == &rr) {
+		n = bm_set(r,&rr);
+	}
+
+sqr_err:
+	bm_done(&sc);
+	bm_done(&rr);
+	return n;
+}
+
+/**
+ * \brief Bitwise logical shift left.  Note that the result bignum
+ *   can also be the input bignum.
+ *
+ * \param[out] r A pointer to a result bignum.
+ * \param[in] a A pointer to a bignum to shift.
+ * \param[in] n Number of bits to shift (0 to BM_LIMB_BITS-1).
+ * \return BM_SUCCESS if OK, error otherwise.
+ */
+
+int bm_asl( bm_t *r, const bm_t *a, int n ) {
+	bm_limb_t c;
+	int i;
+
+	n %= BM_LIMB_BITS;
+
+	if ((i = bm_reserve(r,a->size)) != BM_SUCCESS) {
+		return i;
+	}
+
+	c = bm_lshift(r->b,a->b,a->size,n);
+	i = a->size;
+
+	if (c) {
+		if ((n = bm_reserve(r,i+1)) != BM_SUCCESS) {
+			return n;
+		}
+		r->b[i++] = c;
+	}
+
+	r->size = i;
+	r->sign = a->sign;
+	return BM_SUCCESS;
+}
+
+/**
+ * \brief Bitwise arithmetic shift right. Note that the result bignum
+ *   can be the input bignum.
+ *
+ * \param[out] r A pointer to a result bignum.
+ * \param[in] a A pointer to a bignum to shift.
+ * \param[in] n Number of bits to shift (0 to BM_LIMB_BITS-1).
+ * \return BM_SUCCESS if OK, error otherwise.
+ */
+
+int bm_asr( bm_t *r, const bm_t *a, int n ) {
+	int i;
+
+	n %= BM_LIMB_BITS;
+
+	if ((i = bm_reserve(r,a->size)) != BM_SUCCESS) {
+		return i;
+	}
+
+	bm_rshift(r->b,a->b,a->size,n);
+	r->sign = a->sign;
+	bm_trim(r,a->size);
+	return BM_SUCCESS;
+}
+
+/**
+ * \brief The number of leading zero bits of a non-zero limb.
+ *
+ * \param l The limb.
+ *
+ * \return The number of leading zero bits.
+ */
+
+static int bm_clz( bm_limb_t l ) {
+	int n = 0;
+
+	while (!(l >> (BM_LIMB_BITS-1))) {
+		l <<= 1;
+		n++;
+	}
+	return n;
+}
+
+/**
+ * \brief Divide a limb array with a single limb.
+ *
+ * \param q A pointer to the quotient limbs, m limbs.
+ * \param u A pointer to the numerator limbs.
+ * \param m The number of numerator limbs.
+ * \param v The denominator.
+ *
+ * \return The remainder.
+ */
+
+static bm_limb_t bm_divrem_1( bm_limb_t *q, const bm_limb_t *u, int m, bm_limb_t v ) {
+	bm_dlimb_t r = 0;
+
+	while (--m >= 0) {
+		r = r << BM_LIMB_BITS | u[m];
+		q[m] = (bm_limb_t)(r / v);
+		r %= v;
+	}
+	return (bm_limb_t)r;
+}
+
+/**
+ * \brief Long division of limb arrays, Knuth's Algorithm D (TAOCP
+ *   Vol. 2, 4.3.1). Each quotient limb is estimated from the two top
+ *   limbs of the partial remainder, which is at most one too big after
+ *   the correction loop. The denominator must be normalized i.e. the
+ *   highest bit of its highest limb is set, and the numerator shifted
+ *   by the same amount.
+ *
+ * \param q A pointer to the quotient limbs, m-n+1 limbs.
+ * \param u A pointer to the numerator limbs, m+1 limbs. On return
+ *   the n lowest limbs hold the remainder.
+ * \param m The number of numerator limbs.
+ * \param v A pointer to the denominator limbs.
+ * \param n The number of denominator limbs, at least 2.
+ *
+ * \return Nothing.
+ */
+
+static void bm_divrem_knuth( bm_limb_t *q, bm_limb_t *u, int m, const bm_limb_t *v, int n ) {
+	const bm_dlimb_t B = (bm_dlimb_t)1 << BM_LIMB_BITS;
+	bm_dlimb_t qh, rh;
+	bm_limb_t c;
+	int j;
+
+	for (j = m - n; j >= 0; j--) {
+		qh = (bm_dlimb_t)u[j+n] << BM_LIMB_BITS | u[j+n-1];
+		rh = qh % v[n-1];
+		qh = qh / v[n-1];
+
+		while (qh >= B || qh * v[n-2] > (rh << BM_LIMB_BITS | u[j+n-2])) {
+			qh--;
+			rh += v[n-1];
+
+			if (rh >= B) {
+				break;
+			}
+		}
+
+		/* multiply and subtract, add back if the estimate was too big */
+		c = bm_submul_1(u+j,v,n,(bm_limb_t)qh);
+
+		if (u[j+n] < c) {
+			qh--;
+			u[j+n] = u[j+n] - c + bm_add_n(u+j,u+j,v,n);
+		} else {
+			u[j+n] -= c;
+		}
+
+		q[j] = (bm_limb_t)qh;
+	}
+}
+
+/**
+ * \brief A signed division. The quotient is truncated towards zero and
+ *   the remainder gets the sign of the numerator. The bignums may be
+ *   the same as the input bignums.
+ *
+ * \param[out] q A pointer to a quotient bignumber.
+ * \param[out] r A pointer to s reminder bignumber.
+ * \param[in] n A pointer to a bignumber to numerator.
+ * \param[in] d A pointer to a bignumber to denominator.
+ *
+ * \return BM_SUCCESS if multiplication succeeded. Note that
+ *   if there is an error, the target bignun will be in inconsistent
+ *   state, i.e. one cannot expect it to contain a valid number.
+ */
+
+int bm_div( bm_t *q, bm_t *r, const bm_t *n, const bm_t *d ) {
+	int i,m,s,dn,rs,qs;
+	bm_limb_t *u, *v, *w;
+	bm_stack_t st;
+	bm_t sc;
+
+	/* check for pathetic cases */
+
+	if (bm_is_zero(d)) {
+		return -BM_ERROR_DIV_BY_ZERO;
+	}
+
+    m = bm_cmp_nosign(n,d);
+
+    if (m == 0) {
+        m = n->sign * d->sign;
+
+        if ((i = bm_set_si(r,0)) != BM_SUCCESS) {
+            return i;
+        }
+        return bm_set_si(q,m);
+    }
+    if (m < 0) {
+        if ((m = bm_set(r,n)) != BM_SUCCESS) {
+            return m;
+        }
+        return bm_set_si(q,0);
+    }
+
+	/* the numerator is bigger. The results get their room first and
+	 * then the scratch, which holds the normalized numerator with one
+	 * extra limb, the normalized denominator and the quotient
+	 */
+
+	m = n->size;
+	dn = d->size;
+	rs = n->sign;
+	qs = n->sign * d->sign;
+
+	if ((i = bm_reserve(q,m-dn+1)) != BM_SUCCESS) {
+		return i;
+	}
+	if ((i = bm_reserve(r,dn)) != BM_SUCCESS) {
+		return i;
+	}
+
+	bm_init_arena(&sc,bm_temp_arena(r,&st));
+
+	if ((i = bm_reserve(&sc,2*m+2)) != BM_SUCCESS) {
+		goto div_err;
+	}
+
+	u = sc.b;
+	v = u + m + 1;
+	w = v + dn;
+
+	if (dn == 1) {
+		u[0] = bm_divrem_1(w,n->b,m,d->b[0]);
+	} else {
+		s = bm_clz(d->b[dn-1]);
+		bm_lshift(v,d->b,dn,s);
+		u[m] = bm_lshift(u,n->b,m,s);
+		bm_divrem_knuth(w,u,m,v,dn);
+		bm_rshift(u,u,dn,s);
+	}
+
+	for (i = 0; i < m-dn+1; i++) {
+		q->b[i] = w[i];
+	}
+
+	q->sign = qs;
+	bm_trim(q,m-dn+1);
+
+	for (i = 0; i < dn; i++) {
+		r->b[i] = u[i];
+	}
+
+	r->sign = rs;
+	bm_trim(r,dn);
+	i = BM_SUCCESS;
+
+div_err:
+	bm_done(&sc);
+	return i;
+}
+
+
+/**
+ * \brief Compare limb arrays of equal length.
+ *
+ * \param a A pointer to the first limbs.
+ * \param b A pointer to the second limbs.
+ * \param n The number of limbs.
+ *
+ * \return 1 if a > b, 0 if a == b and -1 if a < b.
+ */
+
+static int bm_cmp_n( const bm_limb_t *a, const bm_limb_t *b, int n ) {
+	while (--n >= 0) {
+		if (a[n] != b[n]) {
+			return a[n] > b[n] ? 1 : -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * \brief Montgomery reduction, r = t R^-1 mod m with R = B^n. Each row
+ *   adds the multiple of m that clears the lowest limb and stores its
+ *   carry into the cleared limb, the carries are added in one pass at
+ *   the end.
+ *
+ * \param r A pointer to the result limbs, n limbs.
+ * \param t A pointer to the limbs to reduce, 2n limbs, below m R.
+ *   The limbs are destroyed.
+ * \param m A pointer to the modulus limbs.
+ * \param n The number of limbs in m.
+ * \param minv -m^-1 mod B.
+ *
+ * \return Nothing.
+ */
+
+static void bm_mont_redc( bm_limb_t *r, bm_limb_t *t, const bm_limb_t *m, int n, bm_limb_t minv ) {
+	int i;
+
+	for (i = 0; i < n; i++) {
+		t[i] = bm_addmul_1(t+i,m,n,t[i] * minv);
+	}
+
+	/* the sum is below 2m */
+	if (bm_add_n(r,t+n,t,n) || bm_cmp_n(r,m,n) >= 0) {
+		bm_sub_n(r,r,m,n);
+	}
+}
+
+/**
+ * \brief The number of scratch limbs bm_mont_mul_n() needs.
+ *
+ * \param n The number of limbs in the modulus.
+ *
+ * \return The number of limbs.
+ */
+
+static int bm_mont_scratch( int n ) {
+	int s = bm_mul_n_scratch(n), q = bm_sqr_n_scratch(n);
+
+	return 2 * n + (s > q ? s : q);
+}
+
+/**
+ * \brief Montgomery multiplication of limb arrays, r = a b R^-1 mod m.
+ *   The same array for a and b is a square.
+ *
+ * \param r A pointer to the result limbs, n limbs. May be a or b.
+ * \param a A pointer to the first limbs, below m.
+ * \param b A pointer to the second limbs, below m.
+ * \param c A pointer to the Montgomery context.
+ * \param t A pointer to bm_mont_scratch(n) scratch limbs.
+ *
+ * \return Nothing.
+ */
+
+static void bm_mont_mul_n( bm_limb_t *r, const bm_limb_t *a, const bm_limb_t *b,
+                           const bm_mont_t *c, bm_limb_t *t ) {
+	bm_mul_n(t,a,b,c->n,t+2*c->n);
+	bm_mont_redc(r,t,c->m.b,c->n,c->minv);
+}
+
+/**
+ * \brief Copy the limbs of a bignum and pad them with zeroes.
+ *
+ * \param x A pointer to the limbs.
+ * \param a A pointer to the bignum, at most n limbs.
+ * \param n The number of limbs in x.
+ *
+ * \return Nothing.
+ */
+
+static void bm_mont_pad( bm_limb_t *x, const bm_t *a, int n ) {
+	int i;
+
+	for (i = 0; i < n; i++) {
+		x[i] = i < a->size ? a->b[i] : 0;
+	}
+}
+
+/**
+ * \brief Initialize a Montgomery context for an odd modulus. R^2 mod m
+ *   and -m^-1 mod B are computed once here. The context must be given
+ *   back with bm_mont_done() also if this fails.
+ *
+ * \param c A pointer to the context.
+ * \param m A pointer to the modulus, positive and odd.
+ * \param ar A pointer to the arena for the bignums of the context, NULL
+ *   for the heap.
+ *
+ * \return BM_SUCCESS if OK, -BM_ERROR_INTERNAL_ERROR if the modulus is
+ *   not positive and odd. Negative error code otherwise.
+ */
+
+int bm_mont_init( bm_mont_t *c, const bm_t *m, bm_arena_t *ar ) {
+	bm_limb_t inv;
+	bm_t q;
+	int i, n;
+
+	bm_init_arena(&c->m,ar);
+	bm_init_arena(&c->rr,ar);
+
+	if (m->sign != BM_POS || (m->b[0] & 1) == 0) {
+		return -BM_ERROR_INTERNAL_ERROR;
+	}
+	if ((i = bm_set(&c->m,m)) != BM_SUCCESS) {
+		return i;
+	}
+
+	n = c->m.size;
+	c->n = n;
+
+	/* Newton's iteration doubles the correct low bits of the inverse,
+	 * an odd number is its own inverse modulo 8
+	 */
+	inv = m->b[0];
+
+	for (i = 3; i < BM_LIMB_BITS; i *= 2) {
+		inv *= 2 - m->b[0] * inv;
+	}
+
+	c->minv = -inv;
+
+	/* R mod m by a division, then squared and reduced again */
+	if ((i = bm_set_size(&c->rr,2*n)) != BM_SUCCESS) {
+		return i;
+	}
+	for (i = 0; i < n; i++) {
+		c->rr.b[i] = 0;
+	}
+
+	c->rr.b[n] = 1;
+	c->rr.size = n+1;
+	c->rr.sign = BM_POS;
+
+	bm_init_arena(&q,ar);
+
+	if ((i = bm_div(&q,&c->rr,&c->rr,m)) == BM_SUCCESS &&
+	    (i = bm_sqr(&c->rr,&c->rr)) == BM_SUCCESS) {
+		i = bm_div(&q,&c->rr,&c->rr,m);
+	}
+
+	bm_done(&q);
+	return i;
+}
+
+/**
+ * \brief Give back the bignums of a Montgomery context.
+ *
+ * \param c A pointer to the context.
+ *
+ * \return Nothing.
+ */
+
+void bm_mont_done( bm_mont_t *c ) {
+	/* in the reverse order for the arena */
+	bm_dones(&c->rr,&c->m,NULL);
+}
+
+/**
+ * \brief Montgomery multiplication, r = a b R^-1 mod m. Both inputs
+ *   must be in the range [0,m), which the Montgomery domain numbers
+ *   from the functions here always are. The result bignum can be
+ *   either one of the input bignums.
+ *
+ * \param r A pointer to a result bignum.
+ * \param a A pointer to a bignum in the Montgomery domain.
+ * \param b A pointer to a bignum in the Montgomery domain.
+ * \param c A pointer to the Montgomery context.
+ *
+ * \return BM_SUCCESS if OK, -BM_ERROR_NUMBER_TOO_BIG if an input is
+ *   longer than the modulus. Negative error code otherwise.
+ */
+
+int bm_mont_mul( bm_t *r, const bm_t *a, const bm_t *b, const bm_mont_t *c ) {
+	int i, n = c->n;
+	bm_limb_t *ap, *bp;
+	bm_stack_t st;
+	bm_t sc;
+
+	if (a->size > n || b->size > n) {
+		return -BM_ERROR_NUMBER_TOO_BIG;
+	}
+	if ((i = bm_reserve(r,n)) != BM_SUCCESS) {
+		return i;
+	}
+
+	bm_init_arena(&sc,bm_temp_arena(r,&st));
+
+	if ((i = bm_reserve(&sc,2*n+bm_mont_scratch(n))) != BM_SUCCESS) {
+		goto mont_err;
+	}
+
+	ap = sc.b;
+	bp = ap + n;
+	bm_mont_pad(ap,a,n);
+	bm_mont_pad(bp,b,n);
+
+	bm_mont_mul_n(r->b,ap,a == b ? ap : bp,c,bp+n);
+	r->sign = BM_POS;
+	bm_trim(r,n);
+
+mont_err:
+	bm_done(&sc);
+	return i;
+}
+
+/**
+ * \brief Montgomery square, r = a^2 R^-1 mod m. See bm_mont_mul().
+ *
+ * \param r A pointer to a result bignum.
+ * \param a A pointer to a bignum in the Montgomery domain.
+ * \param c A pointer to the Montgomery context.
+ *
+ * \return See bm_mont_mul().
+ */
+
+int bm_mont_sqr( bm_t *r, const bm_t *a, const bm_mont_t *c ) {
+	return bm_mont_mul(r,a,a,c);
+}
+
+/**
+ * \brief Convert a bignum into the Montgomery domain, r = a R mod m.
+ *   A negative number is first reduced into the range [0,m).
+ *
+ * \param r A pointer to a result bignum.
+ * \param a A pointer to a bignum.
+ * \param c A pointer to the Montgomery context.
+ *
+ * \return BM_SUCCESS if OK. Negative error code otherwise.
+ */
+
+int bm_mont_to( bm_t *r, const bm_t *a, const bm_mont_t *c ) {
+	bm_t q, x;
+	int i;
+
+	/* the room for the result comes before the temps in the arena */
+	if ((i = bm_reserve(r,c->n)) != BM_SUCCESS) {
+		return i;
+	}
+
+	bm_init_arena(&q,r->arena);
+	bm_init_arena(&x,r->arena);
+
+	if ((i = bm_div(&q,&x,a,&c->m)) != BM_SUCCESS) {
+		goto mont_err;
+	}
+	if (x.sign == BM_NEG && (i = bm_add(&x,&x,&c->m)) != BM_SUCCESS) {
+		goto mont_err;
+	}
+
+	i = bm_mont_mul(r,&x,&c->rr,c);
+
+mont_err:
+	bm_dones(&x,&q,NULL);
+	return i;
+}
+
+/**
+ * \brief Convert a bignum out of the Montgomery domain, r = a R^-1 mod m.
+ *
+ * \param r A pointer to a result bignum.
+ * \param a A pointer to a bignum in the Montgomery domain.
+ * \param c A pointer to the Montgomery context.
+ *
+ * \return See bm_mont_mul().
+ */
+
+int bm_mont_from( bm_t *r, const bm_t *a, const bm_mont_t *c ) {
+	int i, n = c->n;
+	bm_stack_t st;
+	bm_t sc;
+
+	if (a->size > n) {
+		return -BM_ERROR_NUMBER_TOO_BIG;
+	}
+	if ((i = bm_reserve(r,n)) != BM_SUCCESS) {
+		return i;
+	}
+
+	bm_init_arena(&sc,bm_temp_arena(r,&st));
+
+	if ((i = bm_reserve(&sc,2*n)) == BM_SUCCESS) {
+		bm_mont_pad(sc.b,a,2*n);
+		bm_mont_redc(r->b,sc.b,c->m.b,n,c->minv);
+		r->sign = BM_POS;
+		bm_trim(r,n);
+	}
+
+	bm_done(&sc);
+	return i;
+}
+
+/**
+ * \brief Get a bit of a bignum.
+ *
+ * \param a A pointer to the bignum.
+ * \param i The bit number, below the size of the bignum in bits.
+ *
+ * \return The bit.
+ */
+
+static inline int bm_bit( const bm_t *a, int i ) {
+	return (a->b[i / BM_LIMB_BITS] >> (i % BM_LIMB_BITS)) & 1;
+}
+
+/**
+ * \brief The sliding window width for an exponent. The table of odd
+ *   powers costs 2^(w-1) multiplications, a wider window saves one
+ *   multiplication for about every w+1 exponent bits.
+ *
+ * \param bits The number of bits in the exponent.
+ *
+ * \return The window width in bits.
+ */
+
+static int bm_mont_window( int bits ) {
+	if (bits > 671) {
+		return 6;
+	}
+	if (bits > 239) {
+		return 5;
+	}
+	if (bits > 79) {
+		return 4;
+	}
+	if (bits > 23) {
+		return 3;
+	}
+	return bits > 7 ? 2 : 1;
+}
+
+/**
+ * \brief Calculate a modular exponentiation, r = b^e mod m, in the
+ *   Montgomery domain of a context. The exponent is scanned from the
+ *   most significant bit with sliding windows over a table of the odd
+ *   powers of the base, thus each window costs one multiplication on
+ *   top of the squarings. The result is in the range [0,m) and the
+ *   result bignum can be either one of the input bignums.
+ *
+ * \param r A pointer to a result bignum.
+ * \param b A pointer to a base bignum.
+ * \param e A pointer to an exponent bignum, not negative.
+ * \param c A pointer to the Montgomery context of the modulus.
+ *
+ * \return BM_SUCCESS if OK, -BM_ERROR_NOT_IMPLEMENTED for a negative
+ *   exponent. Negative error code otherwise.
+ */
+
+int bm_powm_mont( bm_t *r, const bm_t *b, const bm_t *e, const bm_mont_t *c ) {
+	int i, j, s, v, w, bits, n = c->n;
+	bm_limb_t *tab, *x, *t;
+	bm_stack_t st;
+	bm_t g, sc;
+
+	if (e->sign == BM_NEG) {
+		return -BM_ERROR_NOT_IMPLEMENTED;
+	}
+	if (bm_is_zero(e)) {
+		/* b^0 = 1, which is 0 modulo 1 */
+		return bm_set_ui(r,bm_cmp_ui(&c->m,1) != 0);
+	}
+	if ((i = bm_reserve(r,n)) != BM_SUCCESS) {
+		return i;
+	}
+
+	bits = e->size * BM_LIMB_BITS - bm_clz(e->b[e->size-1]);
+	w = bm_mont_window(bits);
+
+	bm_init_arena(&g,bm_temp_arena(r,&st));
+	bm_init_arena(&sc,g.arena);
+
+	if ((i = bm_reserve(&g,n)) != BM_SUCCESS) {
+		goto powm_err;
+	}
+	if ((i = bm_mont_to(&g,b,c)) != BM_SUCCESS) {
+		goto powm_err;
+	}
+	if ((i = bm_reserve(&sc,((1 << (w-1)) + 1) * n + bm_mont_scratch(n))) != BM_SUCCESS) {
+		goto powm_err;
+	}
+
+	tab = sc.b;
+	x = tab + (1 << (w-1)) * n;
+	t = x + n;
+
+	/* the odd powers g, g^3, .., g^(2^w - 1) */
+	bm_mont_pad(tab,&g,n);
+
+	if (w > 1) {
+		bm_mont_mul_n(x,tab,tab,c,t);
+
+		for (j = 1; j < 1 << (w-1); j++) {
+			bm_mont_mul_n(tab+j*n,tab+(j-1)*n,x,c,t);
+		}
+	}
+
+	/* a window starts and ends with a one bit, the top bit of the
+	 * exponent starts the first one, which just takes its power
+	 */
+	for (i = bits-1; i >= 0; i = j-1) {
+		if (bm_bit(e,i) == 0) {
+			bm_mont_mul_n(x,x,x,c,t);
+			j = i;
+			continue;
+		}
+
+		j = i-w+1 < 0 ? 0 : i-w+1;
+
+		while (bm_bit(e,j) == 0) {
+			j++;
+		}
+		for (v = 0, s = i; s >= j; s--) {
+			v = v << 1 | bm_bit(e,s);
+		}
+
+		if (i == bits-1) {
+			for (s = 0; s < n; s++) {
+				x[s] = tab[(v >> 1) * n + s];
+			}
+		} else {
+			for (s = i; s >= j; s--) {
+				bm_mont_mul_n(x,x,x,c,t);
+			}
+			bm_mont_mul_n(x,x,tab+(v >> 1)*n,c,t);
+		}
+	}
+
+	/* out of the Montgomery domain */
+	for (s = 0; s < 2*n; s++) {
+		t[s] = s < n ? x[s] : 0;
+	}
+
+	bm_mont_redc(r->b,t,c->m.b,n,c->minv);
+	r->sign = BM_POS;
+	bm_trim(r,n);
+	i = BM_SUCCESS;
+
+powm_err:
+	/* in the reverse order for the arena */
+	bm_dones(&sc,&g,NULL);
+	return i;
+}
+
+/**
+ * \brief Calculate a modular exponentiation.
+ * \param[out] r A pointer to a result bignum.
+ * \param[in] b A pointer to a base bignum value.
+ * \param[in] e A pointer to an exponent bignum value.
+ * \param[in] m A pointer to a modulus bignum value.
+ *
+ * \return BM_SUCCESS if OK, -BM_ERROR_NOT_IMPLEMENTED for a negative
+ *   exponent. Negative error code otherwise.
+ *
+ * The result is in the range [0,|m|) for any modulus, i.e. a negative
+ * base is reduced like by bm_mont_to(). A positive odd modulus gets a
+ * Montgomery context for the call, see bm_powm_mont(). Use
+ * bm_powm_mont() directly to reuse the context for several
+ * exponentiations with the same modulus. Other moduli use the
+ * following algorithm for calculating the modular exponentiation.
+ *
+ *
+ * function modular_pow(base, exponent, modulus)
+ *   result := 1 mod modulus
+ *	while exponent > 0
+ *		if (exponent mod 2 == 1):
+ *		   result := (result * base) mod modulus
+ *	   exponent := exponent >> 1
+ *	   base = (base * base) mod modulus
+ *   return result
+ *
+ */
+
+int bm_powm( bm_t *res, const bm_t *b, const bm_t *e, const bm_t *m ) {
+	int n;
+	bm_t nil, exp, bas;
+	bm_mont_t c;
+
+	if (e->sign == BM_NEG) {
+		return -BM_ERROR_NOT_IMPLEMENTED;
+	}
+	if (m->sign == BM_POS && (m->b[0] & 1)) {
+		/* the result gets its room before the context in the arena */
+		if ((n = bm_reserve(res,m->size)) != BM_SUCCESS) {
+			return n;
+		}
+		if ((n = bm_mont_init(&c,m,res->arena)) == BM_SUCCESS) {
+			n = bm_powm_mont(res,b,e,&c);
+		}
+
+		bm_mont_done(&c);
+		return n;
+	}
+    
+	bm_init_arena(&nil,res->arena);
+	bm_init_arena(&exp,res->arena);
+	bm_init_arena(&bas,res->arena);
+
+    if ((n = bm_set_ui(res,1)) != BM_SUCCESS) {
+        goto powm_err;
+    }
+    if ((n = bm_div(&nil,res,res,m)) != BM_SUCCESS) {
         goto powm_err;
     }
     if ((n = bm_set(&bas,b)) != BM_SUCCESS) {
@@ -1087,18 +2664,20 @@ int bm_powm( bm_t *res, const bm_t *b, const bm_t *e, const bm_t *m ) {
 		 */
         if (exp.b[0] & 1) {
             if ((n = bm_mul(res,res,&bas)) != BM_SUCCESS) { goto powm_err; }
-            if ((n = bm_set(&tmp,res)) != BM_SUCCESS) { goto powm_err; }
-            if ((n = bm_div(&nil,res,&tmp,m)) != BM_SUCCESS) { goto powm_err; }
+            if ((n = bm_div(&nil,res,res,m)) != BM_SUCCESS) { goto powm_err; }
         }
         if ((n = bm_asr(&exp,&exp,1)) != BM_SUCCESS) { goto powm_err; }
-        if ((n = bm_mul(&bas,&bas,&bas)) != BM_SUCCESS) { goto powm_err; }
-        if ((n = bm_set(&tmp,&bas)) != BM_SUCCESS) { goto powm_err; }
-        if ((n = bm_div(&nil,&bas,&tmp,m)) != BM_SUCCESS) { goto powm_err; }
+        if ((n = bm_sqr(&bas,&bas)) != BM_SUCCESS) { goto powm_err; }
+        if ((n = bm_div(&nil,&bas,&bas,m)) != BM_SUCCESS) { goto powm_err; }
     }
 
-    n = BM_SUCCESS;
+    /* the remainder has the sign of a negative base, like in bm_mont_to() */
+    if (res->sign == BM_NEG && !bm_is_zero(res)) {
+        n = m->sign == BM_POS ? bm_add(res,res,m) : bm_sub(res,res,m);
+    }
 powm_err:
-    bm_dones(&nil,&exp,&bas,&tmp,NULL);
+    /* in the reverse order for the arena */
+    bm_dones(&bas,&exp,&nil,NULL);
 	return n;
 }
 
@@ -1110,8 +2689,8 @@ powm_err:
 
 #if !defined(PARTOFLIBRARY)
 static void output(char *title, const bm_t *r ) {
-	uint8_t o[BM_MAX_SIZE];
-	int n = bm_get_b(r,o,BM_MAX_SIZE);
+	uint8_t o[BM_MAX_BITS/8];
+	int n = bm_get_b(r,o,sizeof(o));
 	int m;
 
 	printf("%s => ",title);
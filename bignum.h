@@ -13,12 +13,44 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 
-#define BM_MAX_SIZE  32	/**< Maximum 1024-bit numbers */
-#define BM_STATIC_ALLOC	/**< Undefine this if dynamically allocated memory is needed. */
+/**
+ * \brief The limb, i.e. the digit of a bignum, is 64 bits on hosts where
+ *   the compiler has a 128-bit integer type for the double limb products
+ *   and 32 bits elsewhere. Define BM_LIMB_BITS to 32 or 64 to override.
+ */
+
+#if !defined(BM_LIMB_BITS)
+#if defined(__SIZEOF_INT128__)
+#define BM_LIMB_BITS 64
+#else
+#define BM_LIMB_BITS 32
+#endif
+#endif
+
+#if BM_LIMB_BITS == 64
+typedef uint64_t bm_limb_t;             /**< A limb */
+typedef unsigned __int128 bm_dlimb_t;   /**< A double limb for products and carries */
+#elif BM_LIMB_BITS == 32
+typedef uint32_t bm_limb_t;
+typedef uint64_t bm_dlimb_t;
+#else
+#error "BM_LIMB_BITS must be 32 or 64"
+#endif
+
+#define BM_MAX_BITS 32768                           /**< Maximum 32768-bit numbers, i.e. products
+                                                         of 16384-bit numbers */
+#define BM_MAX_SIZE (BM_MAX_BITS / BM_LIMB_BITS)    /**< .. in limbs */
+//#define BM_STATIC_ALLOC	/**< Define this if the heap must not be used. */
+#if defined(BM_STATIC_ALLOC)
+#define BM_INLINE_BITS 1024                         /**< Numbers up to 1024 bits are kept inline */
+#else
+#define BM_INLINE_BITS 256                          /**< Numbers up to 256 bits are kept inline */
+#endif
+#define BM_INLINE_SIZE (BM_INLINE_BITS / BM_LIMB_BITS)  /**< .. in limbs */
 
 #define BM_MAX(a,b) (a) < (b) ? (b) : (a)
-#define BM_RESIZE(a) (a) + BM_MAX_SIZE  /**< Resize a bignum by 1024 bits. */
 
 /**
  * \brief Error codes that bignum functions may return. In case of errors
@@ -49,25 +81,60 @@
 /**
  * \struct bm_s bignum.h bignum.h
  * \brief Bignum structure definition. The bignum is represented as
- *   an array of unsigned 32-bit numbers. 
+ *   an array of limbs, the least significant limb first.
+ *
+ * Small numbers live in the inline limbs of the structure. Bigger
+ * numbers spill either to the arena the bignum is bound to with
+ * bm_init_arena() or to the heap, also when the arena is full. If
+ * BM_STATIC_ALLOC is defined the heap is never used and a bignum without
+ * an arena cannot grow past the inline limbs, which then hold 1024
+ * bits. Temporaries inside the bignum functions use the arena of the
+ * result bignum, or the stack if it has none and the heap when the
+ * stack is not enough.
  *
- * The bignum implementation allows either static memory allocation or
- * dynamic memory allocation. If BM_STATIC_ALLOC is defined, then static
- * memory allocation is used. Note that statically allocated bignum cannot
- * be rezised and an attemp to do so will always return an error.
+ * Since b may point to the structure itself, a bignum must not be
+ * copied by assignment, use bm_set() instead.
  */
 
 typedef struct bm_s {
     int sign;                   /**< Either BM_POS, BM_NEG or BM_NAN */
     int size;                   /**< The size of the current bignum in the b[] array */
     int maxs;                   /**< The maximum size of the b[] array */
-#if defined(BM_STATIC_ALLOC)
-    uint32_t b[BM_MAX_SIZE];    /**< The bignum array for static memory usage */
-#else
-    uint32_t *b;                /**< The bignum array for dynamic memory usage */
-#endif
+    bm_limb_t *b;               /**< The bignum array, either l[] or spilled memory */
+    struct bm_arena_s *arena;   /**< The arena to spill to, NULL for the heap */
+    bm_limb_t l[BM_INLINE_SIZE];    /**< The inline limbs for small numbers */
 } bm_t;
 
+/**
+ * \struct bm_arena_s bignum.h bignum.h
+ * \brief A caller supplied memory area for spilled limbs. The arena is
+ *   a stack: memory is taken from the top and a bignum on the top is
+ *   grown in place and given back by bm_done(). bm_arena_mark() and
+ *   bm_arena_release() free everything allocated in between.
+ */
+
+typedef struct bm_arena_s {
+    bm_limb_t *base;            /**< The arena memory */
+    int size;                   /**< The size of the arena in limbs */
+    int used;                   /**< The number of limbs in use */
+} bm_arena_t;
+
+/**
+ * \struct bm_mont_s bignum.h bignum.h
+ * \brief A Montgomery context of an odd modulus m. A number a is in the
+ *   Montgomery domain as a R mod m, where R = B^n, B is the limb base
+ *   and n the size of m in limbs. The context is set up once with
+ *   bm_mont_init() and can be reused for any number of operations with
+ *   the same modulus, e.g. with an RSA or a DH key.
+ */
+
+typedef struct bm_mont_s {
+    bm_t m;                     /**< The modulus */
+    bm_t rr;                    /**< R^2 mod m for converting into the domain */
+    bm_limb_t minv;             /**< -m^-1 mod B */
+    int n;                      /**< The size of the modulus in limbs */
+} bm_mont_t;
+
 typedef bm_t * bmp_t;           /**< A pointer to the bignum type */
 
 /**
@@ -77,6 +144,7 @@ typedef bm_t * bmp_t;           /**< A pointer to the bignum type */
  */
 
 void bm_init( bm_t * );
+void bm_init_arena( bm_t *, bm_arena_t * );
 void bm_inits( bm_t *, ... );
 void bm_done( bm_t * );
 void bm_dones( bm_t *, ... );
@@ -88,8 +156,10 @@ int bm_neg( bm_t * );
 int bm_cmp( const bm_t *, const bm_t * );
 int bm_cmp_ui( const bm_t *, uint32_t );
 int bm_mul( bm_t *, const bm_t *, const bm_t * );
+int bm_sqr( bm_t *, const bm_t * );
 int bm_div( bm_t *, bm_t *, const bm_t *, const bm_t * );
 int bm_powm( bm_t *, const bm_t *, const bm_t *, const bm_t * );
+int bm_powm_mont( bm_t *, const bm_t *, const bm_t *, const bm_mont_t * );
 int bm_asl( bm_t *, const bm_t *, int );
 int bm_asr( bm_t *, const bm_t *, int );
 
@@ -101,4 +171,15 @@ int bm_set( bm_t *, const bm_t * );
 int bm_get_b( const bm_t *, unsigned char *, int );
 int bm_get_sign( const bm_t * );
 
+int bm_mont_init( bm_mont_t *, const bm_t *, bm_arena_t * );
+void bm_mont_done( bm_mont_t * );
+int bm_mont_to( bm_t *, const bm_t *, const bm_mont_t * );
+int bm_mont_from( bm_t *, const bm_t *, const bm_mont_t * );
+int bm_mont_mul( bm_t *, const bm_t *, const bm_t *, const bm_mont_t * );
+int bm_mont_sqr( bm_t *, const bm_t *, const bm_mont_t * );
+
+void bm_arena_init( bm_arena_t *, void *, size_t );
+int bm_arena_mark( const bm_arena_t * );
+void bm_arena_release( bm_arena_t *, int );
+
 #endif /* _bignum_h_included */
@@ -0,0 +1,167 @@
+/**
+ * \file cpu_features.c
+ * \brief CPUID based detection of the instruction set extensions
+ *   used for selecting digest kernels at run time.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "cpu_features.h"
+
+#if defined(CPU_X86_KERNELS)
+#include <cpuid.h>
+
+/**
+ * \brief Read the extended control register 0, i.e. find out which
+ *   register states the operating system saves on context switches.
+ *
+ * \return The XCR0 value.
+ */
+
+static uint64_t cpu_xgetbv( void ) {
+    uint32_t lo, hi;
+
+    __asm__ __volatile__ ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (uint64_t)hi << 32 | lo;
+}
+
+/**
+ * \brief Query the CPU for the supported extensions.
+ *
+ * \return A set of CPU_FEATURE_* bits.
+ */
+
+static uint32_t cpu_probe( void ) {
+    uint32_t a, b, c, d;
+    uint32_t f = 0;
+    uint64_t xcr0 = 0;
+
+    if (!__get_cpuid(1,&a,&b,&c,&d)) {
+        return 0;
+    }
+    if (c & bit_SSSE3) {
+        f |= CPU_FEATURE_SSSE3;
+    }
+    if (c & bit_SSE4_1) {
+        f |= CPU_FEATURE_SSE41;
+    }
+    if (c & bit_OSXSAVE) {
+        xcr0 = cpu_xgetbv();
+    }
+    if (__get_cpuid_max(0,NULL) < 7) {
+        return f;
+    }
+
+    __cpuid_count(7,0,a,b,c,d);
+
+    /* XMM|YMM state for AVX2, additionally opmask|ZMM for AVX-512 */
+    if ((b & bit_AVX2) && (xcr0 & 0x06) == 0x06) {
+        f |= CPU_FEATURE_AVX2;
+    }
+    if ((b & bit_AVX512F) && (b & bit_AVX512BW) && (xcr0 & 0xe6) == 0xe6) {
+        f |= CPU_FEATURE_AVX512;
+    }
+    if (b & bit_SHA) {
+        f |= CPU_FEATURE_SHA;
+    }
+    if (b & bit_BMI2) {
+        f |= CPU_FEATURE_BMI2;
+    }
+    if (b & bit_ADX) {
+        f |= CPU_FEATURE_ADX;
+    }
+
+    return f;
+}
+#endif
+
+/* The cache is shared by all threads, the flag is published after the
+ * features with release order. */
+
+static _Atomic uint32_t features;
+static _Atomic int features_probed;
+
+/* Kernel names accepted in CPU_KERNEL_ENV and the features they allow.
+ * A kernel name includes the features its kernels depend on. */
+
+static const struct {
+    const char *name;
+    uint32_t mask;
+} cpu_kernels[] = {
+    { "generic", 0 },
+    { "ssse3",   CPU_FEATURE_SSSE3 },
+    { "sse41",   CPU_FEATURE_SSSE3 | CPU_FEATURE_SSE41 },
+    { "avx2",    CPU_FEATURE_SSSE3 | CPU_FEATURE_SSE41 | CPU_FEATURE_AVX2 },
+    { "avx512",  CPU_FEATURE_SSSE3 | CPU_FEATURE_SSE41 | CPU_FEATURE_AVX2 | CPU_FEATURE_AVX512 },
+    { "shani",   CPU_FEATURE_SSSE3 | CPU_FEATURE_SSE41 | CPU_FEATURE_SHA },
+    { "bmi2",    CPU_FEATURE_BMI2 },
+    { "adx",     CPU_FEATURE_ADX },
+};
+
+/**
+ * \brief Parse the kernel override from the environment, a comma
+ *   separated list of kernel names, e.g. "avx2" or "shani,bmi2".
+ *   Unknown names are ignored.
+ *
+ * \return A mask of CPU_FEATURE_* bits the kernels may use. All bits
+ *   set if the override is not present.
+ */
+
+static uint32_t cpu_override( void ) {
+    const char *e = getenv(CPU_KERNEL_ENV);
+    uint32_t mask = 0;
+    size_t len;
+    int n;
+
+    if (e == NULL) {
+        return ~0;
+    }
+    while (*e) {
+        len = strcspn(e,",");
+
+        for (n = 0; n < sizeof(cpu_kernels)/sizeof(cpu_kernels[0]); n++) {
+            if (strlen(cpu_kernels[n].name) == len && !strncmp(e,cpu_kernels[n].name,len)) {
+                mask |= cpu_kernels[n].mask;
+            }
+        }
+
+        e += len;
+        e += *e == ',';
+    }
+
+    return mask;
+}
+
+/**
+ * \brief Get the instruction set extensions of the running CPU. The
+ *   CPU is probed on the first call and the result is cached. Probing
+ *   is idempotent, thus two first callers may both probe and store the
+ *   same value.
+ *   The CPU_KERNEL_ENV environment variable can restrict the result
+ *   for forcing a specific kernel, it never adds unsupported features.
+ *
+ * \return A set of CPU_FEATURE_* bits. 0 on non-x86 hosts.
+ */
+
+uint32_t cpu_features( void ) {
+    uint32_t f = 0;
+
+    if (atomic_load_explicit(&features_probed,memory_order_acquire)) {
+        return atomic_load_explicit(&features,memory_order_relaxed);
+    }
+#if defined(CPU_X86_KERNELS)
+    f = cpu_probe() & cpu_override();
+#endif
+    atomic_store_explicit(&features,f,memory_order_relaxed);
+    atomic_store_explicit(&features_probed,1,memory_order_release);
+
+    return f;
+}
@@ -0,0 +1,45 @@
+/**
+ * \file cpu_features.h
+ * \brief Runtime detection of the CPU instruction set extensions
+ *   the accelerated digest kernels depend on.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#ifndef _cpu_features_h_included
+#define _cpu_features_h_included
+
+#include <stdint.h>
+
+/* The x86 kernels are built with per function target attributes, thus
+ * no special compiler flags are needed. Other hosts (like the Amiga)
+ * only get the portable C implementations.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_X86_KERNELS
+#endif
+
+/**
+ * \brief Feature bits returned by cpu_features(). A bit is only set
+ *   when both the CPU and the operating system support the extension.
+ */
+
+#define CPU_FEATURE_SSSE3   0x00000001  /**< SSSE3 (pshufb) */
+#define CPU_FEATURE_SSE41   0x00000002  /**< SSE4.1 */
+#define CPU_FEATURE_AVX2    0x00000004  /**< AVX2 incl. OS saved YMM state */
+#define CPU_FEATURE_AVX512  0x00000008  /**< AVX-512 F and BW incl. OS saved ZMM state */
+#define CPU_FEATURE_SHA     0x00000010  /**< Intel SHA extensions */
+#define CPU_FEATURE_BMI2    0x00000020  /**< BMI2 (mulx) */
+#define CPU_FEATURE_ADX     0x00000040  /**< ADX (adcx/adox) */
+
+/* The name of the environment variable for forcing kernels, see
+ * cpu_features.c for the accepted values. */
+
+#define CPU_KERNEL_ENV      "CRYPTO_KERNEL"
+
+uint32_t cpu_features( void );
+
+#endif /* _cpu_features_h_included */
@@ -6,6 +6,9 @@
 #define CRYPTO_ERROR_UNSUPPORTED_CRYPTO     0x00000002
 #define CRYPTO_ERROR_UNSUPPORTED_TAG		0x00000003
 #define CRYPTO_ERROR_VALIDATION_FAILED		0x00000004
+#define CRYPTO_ERROR_IO						0x00000005
+#define CRYPTO_ERROR_NO_MEMORY				0x00000006
+#define CRYPTO_ERROR_INVALID_ARGUMENT		0x00000007
 
 
 
@@ -0,0 +1,318 @@
+/**
+ * \file filedigest.c
+ * \brief Digest calculation over files and file descriptors. Regular
+ *   files at least FILE_MAP_MIN octets long are memory mapped with
+ *   sequential access hints and passed to the digest update in large
+ *   windows, thus full blocks are compressed straight from the page
+ *   cache without copying. Pipes, sockets and small files are read
+ *   into an aligned buffer instead.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <memory.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "filedigest.h"
+#include "sha1.h"
+#include "sha256.h"
+#include "sha512.h"
+#include "md5.h"
+#include "crypto_error.h"
+#include "registry.h"
+
+/* Any of the digest contexts, for the digests calculated on stack */
+
+typedef union file_digest_u {
+    md5_context_t md5;
+    sha1_context_t sha1;
+    sha256_context_t sha256;
+    sha512_context_t sha512;
+} file_digest_t;
+
+/**
+ * \brief Map a regular file read only, starting from the current file
+ *   offset. The kernel is told the mapping is read sequentially and,
+ *   where supported, that huge pages are welcome.
+ *
+ * \param fd An open file descriptor.
+ * \param m A pointer to the mapping to fill in.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_IO if the descriptor
+ *   cannot be mapped, e.g. it is not a regular file. An empty file
+ *   results in an empty mapping with data set to NULL.
+ */
+
+int file_map( int fd, file_map_t *m ) {
+    struct stat st;
+    off_t off, pg;
+    long page = sysconf(_SC_PAGESIZE);
+
+    memset(m,0,sizeof(*m));
+
+    if (fstat(fd,&st) < 0 || !S_ISREG(st.st_mode)) {
+        return CRYPTO_ERROR_IO;
+    }
+    if ((off = lseek(fd,0,SEEK_CUR)) < 0) {
+        return CRYPTO_ERROR_IO;
+    }
+    if (off >= st.st_size) {
+        return CRYPTO_SUCCESS;
+    }
+    if ((uint64_t)(st.st_size - off) > SIZE_MAX - page) {
+        /* does not fit into the address space */
+        return CRYPTO_ERROR_IO;
+    }
+
+    pg = off & ~(off_t)(page-1);
+    m->size = st.st_size - pg;
+    m->base = mmap(NULL,m->size,PROT_READ,MAP_PRIVATE,fd,pg);
+
+    if (m->base == MAP_FAILED) {
+        memset(m,0,sizeof(*m));
+        return CRYPTO_ERROR_IO;
+    }
+
+    m->data = (const uint8_t *)m->base + (off - pg);
+    m->len = st.st_size - off;
+
+    /* hints only, failures do not matter */
+    madvise(m->base,m->size,MADV_SEQUENTIAL);
+#if defined(MADV_HUGEPAGE)
+    madvise(m->base,m->size,MADV_HUGEPAGE);
+#endif
+    posix_fadvise(fd,pg,m->size,POSIX_FADV_SEQUENTIAL);
+
+    return CRYPTO_SUCCESS;
+}
+
+/**
+ * \brief Unmap a mapping made with file_map().
+ *
+ * \param m A pointer to the mapping.
+ *
+ * \return Nothing.
+ */
+
+void file_unmap( file_map_t *m ) {
+    if (m->base) {
+        munmap(m->base,m->size);
+    }
+    memset(m,0,sizeof(*m));
+}
+
+/**
+ * \brief Feed a mapped file to the digest one window at a time. The
+ *   next window is requested ahead and the pages of a consumed window
+ *   are dropped from the mapping, which keeps the resident size of
+ *   the process small for very large files. The file stays in the
+ *   page cache.
+ *
+ * \param ctx A pointer to the digest context.
+ * \param m A pointer to the mapping.
+ *
+ * \return Nothing.
+ */
+
+static void file_update_map( crypto_context *ctx, const file_map_t *m ) {
+    uint8_t *base = (uint8_t *)m->base;
+    const uint8_t *p = m->data;
+    const uint8_t *end = m->data + m->len;
+    size_t w = 0;
+
+    while (p < end) {
+        /* windows are aligned to the mapping start, i.e. to pages */
+        uint8_t *win = base + w;
+        size_t n = end - p;
+
+        if (n > (size_t)(win + FILE_MAP_WINDOW - p)) {
+            n = win + FILE_MAP_WINDOW - p;
+            madvise(win + FILE_MAP_WINDOW,
+                    m->size - w - FILE_MAP_WINDOW > FILE_MAP_WINDOW ?
+                    FILE_MAP_WINDOW : m->size - w - FILE_MAP_WINDOW,
+                    MADV_WILLNEED);
+        }
+
+        crypto_update(ctx,p,n);
+        p += n;
+
+        madvise(win,m->size - w > FILE_MAP_WINDOW ? FILE_MAP_WINDOW : m->size - w,
+                MADV_DONTNEED);
+        w += FILE_MAP_WINDOW;
+    }
+}
+
+/**
+ * \brief Feed a file descriptor to the digest using reads into an
+ *   aligned buffer. Seekable descriptors are read with pread() and
+ *   the file offset is moved to the end afterwards.
+ *
+ * \param ctx A pointer to the digest context.
+ * \param fd An open file descriptor.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_IO on a read error and
+ *   CRYPTO_ERROR_NO_MEMORY if the buffer could not be allocated.
+ */
+
+static int file_update_read( crypto_context *ctx, int fd ) {
+    void *buf;
+    off_t off = lseek(fd,0,SEEK_CUR);
+    int r = CRYPTO_SUCCESS;
+    ssize_t n;
+
+    if (posix_memalign(&buf,sysconf(_SC_PAGESIZE),FILE_READ_SIZE)) {
+        return CRYPTO_ERROR_NO_MEMORY;
+    }
+    if (off >= 0) {
+        posix_fadvise(fd,off,0,POSIX_FADV_SEQUENTIAL);
+    }
+
+    for (;;) {
+        if (off >= 0) {
+            n = pread(fd,buf,FILE_READ_SIZE,off);
+        } else {
+            n = read(fd,buf,FILE_READ_SIZE);
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            r = CRYPTO_ERROR_IO;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        crypto_update(ctx,buf,n);
+
+        if (off >= 0) {
+            off += n;
+        }
+    }
+    if (off >= 0) {
+        lseek(fd,off,SEEK_SET);
+    }
+
+    free(buf);
+    return r;
+}
+
+/**
+ * \brief Update a digest or HMAC context with the contents of a file
+ *   descriptor from the current file offset to the end of file. On
+ *   return the file offset is at the end of the file.
+ *
+ * \param ctx A pointer to an initialized and reset context.
+ * \param fd An open file descriptor.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_IO on a read error and
+ *   CRYPTO_ERROR_NO_MEMORY if a read buffer could not be allocated.
+ */
+
+int crypto_update_fd( crypto_context *ctx, int fd ) {
+    struct stat st;
+    file_map_t m;
+
+    if (fstat(fd,&st) == 0 && S_ISREG(st.st_mode) && st.st_size >= FILE_MAP_MIN &&
+        file_map(fd,&m) == CRYPTO_SUCCESS) {
+        file_update_map(ctx,&m);
+        lseek(fd,m.len,SEEK_CUR);
+        file_unmap(&m);
+        return CRYPTO_SUCCESS;
+    }
+
+    return file_update_read(ctx,fd);
+}
+
+/**
+ * \brief Calculate the digest of a file descriptor from the current
+ *   file offset to the end of file.
+ *
+ * \param alg The digest algorithm identifier, one of TEE_ALG_MD5,
+ *   TEE_ALG_SHA1, TEE_ALG_SHA224, TEE_ALG_SHA256, TEE_ALG_SHA384 or
+ *   TEE_ALG_SHA512.
+ * \param fd An open file descriptor.
+ * \param out A pointer to the digest output buffer.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_UNSUPPORTED_DIGEST if the
+ *   algorithm is unknown, otherwise see crypto_update_fd().
+ */
+
+int crypto_digest_fd( uint32_t alg, int fd, uint8_t *out ) {
+    file_digest_t u;
+    crypto_context *ctx;
+    int r;
+
+    if ((ctx = crypto_init(alg,&u)) == NULL) {
+        return CRYPTO_ERROR_UNSUPPORTED_DIGEST;
+    }
+
+    crypto_reset(ctx);
+
+    if ((r = crypto_update_fd(ctx,fd)) == CRYPTO_SUCCESS) {
+        crypto_finish(ctx,out);
+    }
+
+    crypto_free(ctx);
+    return r;
+}
+
+/**
+ * \brief Calculate the digest of a file.
+ *
+ * \param alg The digest algorithm identifier, see crypto_digest_fd().
+ * \param path The path name of the file.
+ * \param out A pointer to the digest output buffer.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_IO if the file cannot be
+ *   opened, otherwise see crypto_digest_fd().
+ */
+
+int crypto_digest_file( uint32_t alg, const char *path, uint8_t *out ) {
+    int fd, r;
+
+    if ((fd = open(path,O_RDONLY|O_CLOEXEC)) < 0) {
+        return CRYPTO_ERROR_IO;
+    }
+
+    r = crypto_digest_fd(alg,fd,out);
+    close(fd);
+    return r;
+}
+
+
+
+#if !defined(PARTOFLIBRARY)
+int main( int argc, char** argv )
+{
+    uint8_t hash[SHA512_HSH_SIZE];
+    int n, r;
+
+    if (argc < 2) {
+        r = crypto_digest_fd(TEE_ALG_SHA256,0,hash);
+    } else {
+        r = crypto_digest_file(TEE_ALG_SHA256,argv[1],hash);
+    }
+    if (r != CRYPTO_SUCCESS) {
+        printf("Error %d\n",r);
+        return 1;
+    }
+
+    for (n = 0; n < SHA256_HSH_SIZE; n++) {
+        printf("%02x",hash[n]);
+    }
+    printf("\n");
+
+    return 0;
+}
+#endif
@@ -0,0 +1,48 @@
+/**
+ * \file filedigest.h
+ * \brief Digest calculation over files and file descriptors. Regular
+ *   files are memory mapped and fed to the digest directly from the
+ *   mapping, other descriptors are read in large blocks.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#ifndef _filedigest_h_included
+#define _filedigest_h_included
+
+#include <stdint.h>
+#include <stddef.h>
+#include "algorithm_types.h"
+
+#define FILE_MAP_MIN        (1 << 20)   /**< Smaller files are just read */
+#define FILE_MAP_WINDOW     (64 << 20)  /**< Read-ahead and release granularity */
+#define FILE_READ_SIZE      (1 << 20)   /**< Read size when the file is not mapped */
+
+/**
+ * \brief A read only mapping of a file from the file offset to the end
+ *   of the file. data and len describe the file contents, base and size
+ *   the page aligned mapping itself.
+ */
+
+typedef struct file_map_s {
+    const uint8_t *data;    /**< The file contents at the file offset */
+    size_t len;             /**< Octets from the file offset to the end */
+    void *base;             /**< Start of the mapping */
+    size_t size;            /**< Size of the mapping */
+} file_map_t;
+
+/**
+ * \brief File digest function prototypes.
+ *
+ */
+
+int file_map( int, file_map_t * );
+void file_unmap( file_map_t * );
+
+int crypto_update_fd( crypto_context *, int );
+int crypto_digest_fd( uint32_t, int, uint8_t * );
+int crypto_digest_file( uint32_t, const char *, uint8_t * );
+
+#endif /* _filedigest_h_included */
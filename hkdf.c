@@ -0,0 +1,260 @@
+/**
+ * \file hkdf.c
+ * \brief HKDF key derivation over the HMAC implementation. Expand keys
+ *   one HMAC context with the PRK and restarts it from the saved ipad
+ *   midstate for every block, thus no block pays for hashing the key.
+ *   Full blocks are finished directly into the output buffer and the
+ *   previous block is read back from there, only a partial last block
+ *   goes through a temporary buffer.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <memory.h>
+
+#include "hkdf.h"
+#include "hmac.h"
+#include "oneshot.h"
+#include "sha512.h"
+#include "crypto_error.h"
+
+/* The missing salt, HashLen zeroes (RFC 5869 section 2.2). Zeroes up to
+ * the block size pad into the same HMAC key, thus the longest digest's
+ * worth serves all of the algorithms. */
+
+static const uint8_t hkdf_zero_salt[SHA512_HSH_SIZE];
+
+/**
+ * \brief Expand with an HMAC context keyed with the PRK.
+ *
+ * \param ctx A pointer to the keyed HMAC context.
+ * \param info A pointer to the info.
+ * \param ilen The length of the info.
+ * \param okm A pointer to the output buffer.
+ * \param len The length of the output.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_INVALID_ARGUMENT if the
+ *   output is longer than 255 digests.
+ */
+
+static int hkdf_expand_keyed( crypto_context *ctx, const void *info, size_t ilen,
+                              uint8_t *okm, size_t len ) {
+    uint8_t T[SHA512_HSH_SIZE];
+    const uint8_t *prev = NULL;
+    size_t hsz = ctx->size >> 3;
+    uint8_t i;
+
+    if (len > 255 * hsz) {
+        return CRYPTO_ERROR_INVALID_ARGUMENT;
+    }
+
+    /* T(i) = HMAC(PRK, T(i-1) | info | i) */
+    for (i = 1; len > 0; i++) {
+        crypto_reset(ctx,CTAG_DONE);
+
+        if (prev) {
+            crypto_update(ctx,prev,hsz);
+        }
+
+        crypto_update(ctx,info,ilen);
+        crypto_update(ctx,&i,1);
+
+        if (len >= hsz) {
+            crypto_finish(ctx,okm);
+            prev = okm;
+            okm += hsz;
+            len -= hsz;
+        } else {
+            crypto_finish(ctx,T);
+            memcpy(okm,T,len);
+            memset(T,0,sizeof(T));
+            len = 0;
+        }
+    }
+
+    return CRYPTO_SUCCESS;
+}
+
+/**
+ * \brief Key an HMAC context with the PRK.
+ *
+ * \param htx A pointer to the HMAC context storage.
+ * \param alg The HMAC algorithm identifier, TEE_ALG_HMAC_*.
+ * \param prk A pointer to the pseudorandom key.
+ * \param plen The length of the PRK.
+ *
+ * \return A pointer to the keyed context, NULL if the algorithm is
+ *   unknown.
+ */
+
+static crypto_context *hkdf_key( hmac_context *htx, uint32_t alg, const void *prk, size_t plen ) {
+    crypto_context *ctx;
+
+    if ((ctx = hmac_init(htx,alg)) != NULL) {
+        crypto_reset(ctx,CTAG_KEY,prk,CTAG_KEY_LEN,(int)plen,CTAG_DONE);
+    }
+
+    return ctx;
+}
+
+/**
+ * \brief HKDF-Extract, i.e. PRK = HMAC(salt, IKM).
+ *
+ * \param alg The HMAC algorithm identifier, TEE_ALG_HMAC_*.
+ * \param salt A pointer to the salt, may be NULL.
+ * \param slen The length of the salt. A missing salt is a digest of
+ *   zeroes.
+ * \param ikm A pointer to the input keying material.
+ * \param ilen The length of the IKM.
+ * \param prk A pointer to the PRK output buffer of the digest size.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_UNSUPPORTED_DIGEST if the
+ *   algorithm is unknown.
+ */
+
+int crypto_hkdf_extract( uint32_t alg, const void *salt, size_t slen,
+                         const void *ikm, size_t ilen, uint8_t *prk ) {
+    if (salt == NULL) {
+        salt = hkdf_zero_salt;
+        slen = sizeof(hkdf_zero_salt);
+    }
+
+    return crypto_hmac(alg,salt,slen,ikm,ilen,prk);
+}
+
+/**
+ * \brief HKDF-Expand.
+ *
+ * \param alg The HMAC algorithm identifier, TEE_ALG_HMAC_*.
+ * \param prk A pointer to the pseudorandom key.
+ * \param plen The length of the PRK.
+ * \param info A pointer to the info, may be NULL if ilen is 0.
+ * \param ilen The length of the info.
+ * \param okm A pointer to the output keying material buffer.
+ * \param len The length of the output, at most 255 digests.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_UNSUPPORTED_DIGEST if the
+ *   algorithm is unknown, CRYPTO_ERROR_INVALID_ARGUMENT if the output
+ *   is too long.
+ */
+
+int crypto_hkdf_expand( uint32_t alg, const void *prk, size_t plen,
+                        const void *info, size_t ilen, uint8_t *okm, size_t len ) {
+    hmac_context htx;
+    crypto_context *ctx;
+    int r;
+
+    if ((ctx = hkdf_key(&htx,alg,prk,plen)) == NULL) {
+        return CRYPTO_ERROR_UNSUPPORTED_DIGEST;
+    }
+
+    r = hkdf_expand_keyed(ctx,info,ilen,okm,len);
+
+    /* clear temporary things */
+    memset(&htx,0,sizeof(htx));
+    return r;
+}
+
+/**
+ * \brief HKDF-Expand of several labelled keys from one PRK. The PRK is
+ *   hashed into the HMAC midstates once for all of the outputs.
+ *
+ * \param alg The HMAC algorithm identifier, TEE_ALG_HMAC_*.
+ * \param prk A pointer to the pseudorandom key.
+ * \param plen The length of the PRK.
+ * \param out A pointer to an array of n outputs.
+ * \param n The number of outputs.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_UNSUPPORTED_DIGEST if the
+ *   algorithm is unknown, CRYPTO_ERROR_INVALID_ARGUMENT if an output
+ *   is too long. Outputs before the failing one are derived.
+ */
+
+int crypto_hkdf_expand_multi( uint32_t alg, const void *prk, size_t plen,
+                              const hkdf_out_t *out, int n ) {
+    hmac_context htx;
+    crypto_context *ctx;
+    int i, r = CRYPTO_SUCCESS;
+
+    if ((ctx = hkdf_key(&htx,alg,prk,plen)) == NULL) {
+        return CRYPTO_ERROR_UNSUPPORTED_DIGEST;
+    }
+
+    for (i = 0; i < n && r == CRYPTO_SUCCESS; i++) {
+        r = hkdf_expand_keyed(ctx,out[i].info,out[i].info_len,out[i].okm,out[i].len);
+    }
+
+    memset(&htx,0,sizeof(htx));
+    return r;
+}
+
+/**
+ * \brief HKDF, i.e. extract followed by expand.
+ *
+ * \param alg The HMAC algorithm identifier, TEE_ALG_HMAC_*.
+ * \param salt A pointer to the salt, may be NULL.
+ * \param slen The length of the salt.
+ * \param ikm A pointer to the input keying material.
+ * \param ilen The length of the IKM.
+ * \param info A pointer to the info, may be NULL if infolen is 0.
+ * \param infolen The length of the info.
+ * \param okm A pointer to the output keying material buffer.
+ * \param len The length of the output, at most 255 digests.
+ *
+ * \return See crypto_hkdf_extract() and crypto_hkdf_expand().
+ */
+
+int crypto_hkdf( uint32_t alg, const void *salt, size_t slen, const void *ikm, size_t ilen,
+                 const void *info, size_t infolen, uint8_t *okm, size_t len ) {
+    uint8_t prk[SHA512_HSH_SIZE];
+    hmac_context htx;
+    crypto_context *ctx;
+    int r;
+
+    if ((ctx = hmac_init(&htx,alg)) == NULL) {
+        return CRYPTO_ERROR_UNSUPPORTED_DIGEST;
+    }
+
+    if ((r = crypto_hkdf_extract(alg,salt,slen,ikm,ilen,prk)) == CRYPTO_SUCCESS) {
+        crypto_reset(ctx,CTAG_KEY,prk,CTAG_KEY_LEN,ctx->size >> 3,CTAG_DONE);
+        r = hkdf_expand_keyed(ctx,info,infolen,okm,len);
+    }
+
+    memset(prk,0,sizeof(prk));
+    memset(&htx,0,sizeof(htx));
+    return r;
+}
+
+
+
+#if !defined(PARTOFLIBRARY)
+int main( int argc, char** argv )
+{
+    /* RFC 5869 test case 1, OKM =
+     * 3cb25f25faacd57a90434f64d0362f2a2d2d0a90cf1a5a4c5db02d56ecc4c5bf
+     * 34007208d5b887185865 */
+    static const uint8_t ikm[22] = {
+        0x0b,0x0b,0x0b,0x0b,0x0b,0x0b,0x0b,0x0b,0x0b,0x0b,0x0b,
+        0x0b,0x0b,0x0b,0x0b,0x0b,0x0b,0x0b,0x0b,0x0b,0x0b,0x0b };
+    static const uint8_t salt[13] = {
+        0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0x0a,0x0b,0x0c };
+    static const uint8_t info[10] = {
+        0xf0,0xf1,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,0xf9 };
+    uint8_t okm[42];
+    int n;
+
+    crypto_hkdf(TEE_ALG_HMAC_SHA256,salt,sizeof(salt),ikm,sizeof(ikm),
+                info,sizeof(info),okm,sizeof(okm));
+
+    for (n = 0; n < sizeof(okm); n++) {
+        printf("%02x",okm[n]);
+    }
+    printf("\n");
+
+    return 0;
+}
+#endif
@@ -0,0 +1,40 @@
+/**
+ * \file hkdf.h
+ * \brief HKDF key derivation (RFC 5869) with HMAC of any supported
+ *   digest.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#ifndef _hkdf_h_included
+#define _hkdf_h_included
+
+#include <stdint.h>
+#include <stddef.h>
+#include "algorithm_types.h"
+
+/**
+ * \brief One output of a multi-output expand, i.e. a labelled key.
+ */
+
+typedef struct hkdf_out_s {
+    const void *info;       /**< The context and application specific info */
+    size_t info_len;        /**< The length of the info */
+    uint8_t *okm;           /**< The output keying material */
+    size_t len;             /**< The length of the output, at most 255 digests */
+} hkdf_out_t;
+
+/**
+ * \brief HKDF function prototypes.
+ *
+ */
+
+int crypto_hkdf_extract( uint32_t, const void *, size_t, const void *, size_t, uint8_t * );
+int crypto_hkdf_expand( uint32_t, const void *, size_t, const void *, size_t, uint8_t *, size_t );
+int crypto_hkdf_expand_multi( uint32_t, const void *, size_t, const hkdf_out_t *, int );
+int crypto_hkdf( uint32_t, const void *, size_t, const void *, size_t, const void *, size_t,
+                 uint8_t *, size_t );
+
+#endif /* _hkdf_h_included */
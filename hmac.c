@@ -10,6 +10,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <memory.h>
 #include <stdint.h>
 #include <stdarg.h>
@@ -19,6 +20,8 @@
 #include "sha1.h"
 #include "sha256.h"
 #include "md5.h"
+#include "registry.h"
+#include "multibuf.h"
 #include "algorithm_types.h"
 #include "crypto_error.h"
 
@@ -34,16 +37,62 @@
 
 static crypto_context *hmac_get_hash( const crypto_context *ctx ) {
 	hmac_context *htx = (hmac_context *)ctx;
-	return (crypto_context *)htx->digest;
+	return (crypto_context *)&htx->hash;
 }
 
 static hmac_context *hmac_get_hmac( const crypto_context *ctx ) {
 	return (hmac_context *)ctx;
 }
 
+/* All of the digest contexts have the same header, thus the block
+ * count and H are at the same offset in each */
+
+#define HMAC_CHAIN_OFFSET offsetof(md5_context_t,index)
+
+/**
+ * \brief Get the size of an HMAC context, i.e. the header, the digest
+ *   context and the two midstates.
+ *
+ * \param htx A pointer to the HMAC context.
+ *
+ * \return The size in octets.
+ */
+
+static inline size_t hmac_size( const hmac_context *htx ) {
+	return offsetof(hmac_context,hash) + htx->state_size + 2 * htx->chain_size;
+}
+
+/**
+ * \brief Restore the digest context from a saved midstate.
+ *
+ * \param htx A pointer to the HMAC context.
+ * \param st A pointer to the saved midstate.
+ *
+ * \return Nothing.
+ */
+
+static void hmac_restore( hmac_context *htx, const hmac_chain_t *st ) {
+	memcpy((uint8_t *)&htx->hash + HMAC_CHAIN_OFFSET,st,htx->chain_size);
+}
+
+/**
+ * \brief Save the digest context into a midstate.
+ *
+ * \param htx A pointer to the HMAC context.
+ * \param st A pointer to the midstate.
+ *
+ * \return Nothing.
+ */
+
+static void hmac_save( const hmac_context *htx, hmac_chain_t *st ) {
+	memcpy(st,(const uint8_t *)&htx->hash + HMAC_CHAIN_OFFSET,htx->chain_size);
+}
 
 /**
- * \brief Finish the HMAC calculation..
+ * \brief Finish the HMAC calculation. The outer hash continues from
+ *   the saved opad midstate, thus costs just the final block(s). The
+ *   inner hash is then restored to the ipad midstate, i.e. the context
+ *   is ready for the next message with the same key.
  *
  * \param ctx A pointer to the HMAC context.
  * \param buf A pointer to the digest output buffer. Note that
@@ -58,14 +107,11 @@ static void hmac_finish( crypto_context *ctx, uint8_t *buf ) {
 	assert(ctx);
 	assert(htx);
 	
-	hsh->finish(hsh,buf);
-	hsh->reset(hsh);
-	hsh->update(hsh,htx->pad,hsh->block_size);
-	hsh->update(hsh,buf,hsh->size >> 3);
-	hsh->finish(hsh,buf);
-
-	/* clear temporary things */
-	memset(htx->pad,0,ctx->block_size);
+	crypto_finish(hsh,buf);
+	hmac_restore(htx,hmac_ostate(htx));
+	crypto_update(hsh,buf,hsh->size >> 3);
+	crypto_finish(hsh,buf);
+	hmac_restore(htx,hmac_istate(htx));
 }
 
 /**
@@ -76,7 +122,7 @@ static void hmac_finish( crypto_context *ctx, uint8_t *buf ) {
  * \param len The length of the input data.
  */
 
-static void hmac_update( crypto_context *ctx, const void *buf, int len ) {
+static void hmac_update( crypto_context *ctx, const void *buf, size_t len ) {
 	hmac_context *htx = hmac_get_hmac( ctx );
 	crypto_context *hsh = hmac_get_hash( ctx);
 
@@ -84,24 +130,28 @@ static void hmac_update( crypto_context *ctx, const void *buf, int len ) {
 	assert(htx);
 	
 	if (len > 0) {
-		hsh->update(hsh,buf,len);
+		crypto_update(hsh,buf,len);
 	}
 }
 
 
 
 /**
- * \brief Reset the hmac_context to initial state.
+ * \brief Reset the hmac_context to initial state. A new key is hashed
+ *   into the ipad and opad midstates, which are saved in the context.
+ *   Without a key the saved midstates of the previous key are used,
+ *   which costs no compressions at all.
  *
  * \param ctx A poiter to the HMAC context to initialize.
- * \param key A pointer to the key used for HMAC.
- * \param keylen The length of the key.
+ * \param tags CTAG_KEY and CTAG_KEY_LEN for a new key, or just
+ *   CTAG_DONE to keep the previous key.
  *
- * \return 0 is OK. -1 if not support for the algorithm.
+ * \return CRYPTO_SUCCESS if OK. CRYPTO_ERROR_UNSUPPORTED_TAG on an
+ *   unknown tag, or if there is no key at all.
  */
 
- static int hmac_reset( crypto_context *ctx, ... ) {
-	va_list tags;
+ static int hmac_reset( crypto_context *ctx, va_list tags ) {
+	uint8_t pad[HMAC_MAX_KEY];
 	uint32_t tag;
 	uint8_t *key = NULL;
 	int keylen = -1;
@@ -112,8 +162,6 @@ static void hmac_update( crypto_context *ctx, const void *buf, int len ) {
 
 	/* var args.. we need to read at least the key and key length */
 
-	va_start(tags,ctx);
-
 	while (tag = va_arg(tags,uint32_t)) {
 		switch (tag) {
 			case CTAG_KEY:
@@ -123,13 +171,14 @@ static void hmac_update( crypto_context *ctx, const void *buf, int len ) {
 				keylen = va_arg(tags,int);
 				break;
 			default:
-				va_end(tags);
 				return CRYPTO_ERROR_UNSUPPORTED_TAG;
 		}
 	}
 
-	va_end(tags);
-
+	if (!key && keylen < 0 && (ctx->flags & CFLAG_KEYED)) {
+		hmac_restore(htx,hmac_istate(htx));
+		return CRYPTO_SUCCESS;
+	}
 	if (!key || keylen < 0) {
 		return CRYPTO_ERROR_UNSUPPORTED_TAG;
 	}
@@ -138,30 +187,41 @@ static void hmac_update( crypto_context *ctx, const void *buf, int len ) {
 		/* if the key is longer than the hash function block size,
 		 * the key is truncated into proper size by hashing it */
 
-		hsh->reset(hsh);
-		hsh->update(hsh,key,keylen);
-		hsh->finish(hsh,htx->pad);
-		keylen = ctx->block_size;
+		crypto_reset(hsh);
+		crypto_update(hsh,key,keylen);
+		crypto_finish(hsh,pad);
+		keylen = hsh->size >> 3;
 	} else {
-		memcpy(htx->pad,key,keylen);
+		memcpy(pad,key,keylen);
 	}
 
 	/* ipad.. */
 	for (n = 0; n < keylen; n++) {
-		htx->pad[n] ^= 0x36;
+		pad[n] ^= 0x36;
 	}
 	for (n = keylen; n < ctx->block_size; n++) {
-		htx->pad[n] = 0x36;
+		pad[n] = 0x36;
 	}
 
-	hsh->reset(hsh);
-	hsh->update(hsh,htx->pad,ctx->block_size);
+	crypto_reset(hsh);
+	crypto_update(hsh,pad,ctx->block_size);
+	hmac_save(htx,hmac_istate(htx));
 
 	/* opad.. */
 	for (n = 0; n < ctx->block_size; n++) {
-		htx->pad[n] = htx->pad[n] ^ 0x36 ^ 0x5c;
+		pad[n] = pad[n] ^ 0x36 ^ 0x5c;
 	}
 
+	crypto_reset(hsh);
+	crypto_update(hsh,pad,ctx->block_size);
+	hmac_save(htx,hmac_ostate(htx));
+
+	/* continue from the inner midstate */
+	hmac_restore(htx,hmac_istate(htx));
+	ctx->flags |= CFLAG_KEYED;
+
+	/* clear temporary things */
+	memset(pad,0,ctx->block_size);
 	return CRYPTO_SUCCESS;
  }
 
@@ -173,92 +233,343 @@ static void hmac_update( crypto_context *ctx, const void *buf, int len ) {
  */
 
 static void hmac_free( crypto_context* ctx ) {
-	hmac_context *htx = hmac_get_hmac(ctx);
-    htx->digest->free(htx->digest);
-    free(ctx);
+	if (!(ctx->flags & CFLAG_STATIC_ALLOC)) {
+		free(ctx);
+	}
 }
 
-static void hmac_free_dummy( crypto_context* ctx ) {
-	hmac_context *htx = hmac_get_hmac(ctx);
-    htx->digest->free(htx->digest);
+/**
+ * \brief Copy the HMAC context including the state of the calculation
+ *   so far.
+ *
+ * \param ctx A pointer to the context to copy.
+ * \param dst A pointer to the storage for the copy, or NULL to allocate
+ *   the copy from the heap.
+ *
+ * \return A pointer to the copy. NULL if the allocation failed.
+ */
+
+static crypto_context *hmac_clone( const crypto_context *ctx, crypto_context *dst ) {
+	size_t size = hmac_size(hmac_get_hmac(ctx));
+	int heap = dst == NULL;
+
+	if (heap && (dst = malloc(size)) == NULL) {
+		return NULL;
+	}
+
+	memcpy(dst,ctx,size);
+	if (heap) {
+		dst->flags &= ~CFLAG_STATIC_ALLOC;
+	} else {
+		dst->flags |= CFLAG_STATIC_ALLOC;
+	}
+	return dst;
 }
 
 /**
- * \brief Allocate memory for the HMAC contect. The allocation function is
- *   avare also of the used digest algorithm.
- *
- * \param alg An algorithm identifier.
+ * \brief The HMAC state includes the key, which is not exported.
  *
- * \return A pointer to the allocated context. NULL if
- *   a) out of memory or b) algorithm was unknown.
  */
 
-crypto_context *hmac_alloc( uint32_t alg ) {
-	crypto_context *ctx, *hsh;
+static int hmac_export( const crypto_context *ctx, uint8_t *out, size_t *len ) {
+	return CRYPTO_ERROR_UNSUPPORTED_CRYPTO;
+}
+
+static int hmac_import( crypto_context *ctx, const uint8_t *in, size_t len ) {
+	return CRYPTO_ERROR_UNSUPPORTED_CRYPTO;
+}
+
+static const crypto_ops hmac_ops = {
+	hmac_reset,
+	hmac_update,
+	hmac_finish,
+	hmac_clone,
+	hmac_export,
+	hmac_import,
+	hmac_free
+};
 
-	if ((ctx = malloc(sizeof(hmac_context))) == NULL) {
+/**
+ * \brief Find the digest of an HMAC algorithm.
+ *
+ * \param alg An HMAC algorithm identifier, TEE_ALG_HMAC_*.
+ *
+ * \return A pointer to the registry entry of the digest, NULL if the
+ *   algorithm is unknown.
+ */
+
+static const crypto_algo_t *hmac_find( uint32_t alg ) {
+	/* HMAC and digest identifiers differ only in the class */
+	if ((alg & 0xf0000000) != (TEE_ALG_HMAC_MD5 & 0xf0000000)) {
 		return NULL;
 	}
 
-	/* Fix pointer magic.. this is ugly */
+	return crypto_find(alg - TEE_ALG_HMAC_MD5 + TEE_ALG_MD5);
+}
 
-	switch (alg) {
-	default:
-	case TEE_ALG_HMAC_SHA1:
-		hsh = sha1_alloc();
+/**
+ * \brief Get the size of a saved midstate of a digest, i.e. its
+ *   context from the block count up to the block buffer, which is
+ *   the last member.
+ *
+ * \param a A pointer to the registry entry of the digest.
+ *
+ * \return The size in octets.
+ */
 
-		if (hsh == NULL) {
-			free(ctx);
-			return NULL;
-		}
+static size_t hmac_chain_size( const crypto_algo_t *a ) {
+	return a->ctx_size - a->blk_size - HMAC_CHAIN_OFFSET;
+}
 
-		break;
+/**
+ * \brief Allocate memory for the HMAC contect. The digest is embedded
+ *   in the same allocation, which is only as large as the digest of
+ *   the algorithm needs.
+ *
+ * \param alg An HMAC algorithm identifier, TEE_ALG_HMAC_*.
+ *
+ * \return A pointer to the allocated context. NULL if
+ *   a) out of memory or b) algorithm was unknown.
+ */
+
+crypto_context *hmac_alloc( uint32_t alg ) {
+	const crypto_algo_t *a;
+	crypto_context *ctx;
+
+	if ((a = hmac_find(alg)) == NULL) {
+		return NULL;
+	}
+	if ((ctx = malloc(offsetof(hmac_context,hash) + a->ctx_size + 2 * hmac_chain_size(a))) == NULL) {
+		return NULL;
+	}
+	if (hmac_init((hmac_context *)ctx,alg) == NULL) {
+		free(ctx);
+		return NULL;
 	}
 
-	hmac_init((hmac_context *)ctx,hsh);
-	ctx->free = hmac_free;
+	ctx->flags &= ~CFLAG_STATIC_ALLOC;
 	return ctx;
 }
 
 /**
- * \brief Initialize HMAC context when it is allocated in a heap.
+ * \brief Initialize HMAC context in caller provided storage, e.g. on
+ *   stack.
  *
- * \param htx A pointer to a HMAC context to initialize. 
- * \param dtx A pointer to a digest context to include into this HMAC.
+ * \param htx A pointer to a HMAC context to initialize. Storage of
+ *   sizeof(hmac_context) fits any algorithm.
+ * \param alg An HMAC algorithm identifier, TEE_ALG_HMAC_MD5,
+ *   TEE_ALG_HMAC_SHA1, TEE_ALG_HMAC_SHA224, TEE_ALG_HMAC_SHA256,
+ *   TEE_ALG_HMAC_SHA384 or TEE_ALG_HMAC_SHA512.
  *
  * \return A pointer to crypto_context (which points to the
- *   input parameter hmac_context.
+ *   input parameter hmac_context. NULL if the algorithm was unknown.
  */
 
-crypto_context *hmac_init( hmac_context *htx, crypto_context *dtx ) {
+crypto_context *hmac_init( hmac_context *htx, uint32_t alg ) {
 	crypto_context *ctx = (crypto_context *)htx;
+	crypto_context *hsh;
+	const crypto_algo_t *a;
 
-	memset(ctx,0,sizeof(hmac_context));
-	
-	/* The context structures are allocated as a one blob in memory. The
-	 * context and hash void pointers are then fixed to poin to the right
-	 * context structures. Somewhat hacky.. brr.. should do proper allocations..
-	 */
-	
-	/* setup hash context */
-	htx->digest = dtx;
+	if ((a = hmac_find(alg)) == NULL) {
+		return NULL;
+	}
+
+	assert(a->ctx_size <= sizeof(hmac_state_t));
+
+	/* only the storage of the algorithm is touched, see hmac_alloc() */
+	htx->state_size = a->ctx_size;
+	htx->chain_size = hmac_chain_size(a);
+	memset(&htx->hash,0,htx->state_size + 2 * htx->chain_size);
+
+	/* setup hash context, the midstates are copies of its chaining value */
+	hsh = a->init(&htx->hash);
 
 	/* fill in the minimum essentials */
-	ctx->algorithm = TEE_ALG_HMAC_SHA1;
-	ctx->size = dtx->size;
-	ctx->block_size = dtx->block_size;
-	ctx->flags = dtx->flags;
+	ctx->algorithm = alg;
+	ctx->size = hsh->size;
+	ctx->block_size = hsh->block_size;
+	ctx->flags = CFLAG_STATIC_ALLOC;
 
 	/* input & output functions.. */
-	ctx->reset = hmac_reset;
-	ctx->update = hmac_update;
-	ctx->finish = hmac_finish;
-	ctx->free = hmac_free_dummy;
+	ctx->ops = &hmac_ops;
 
 	return ctx;
 }
 
 
+/**
+ * \brief Calculate the HMACs of a batch of messages, one by one on a
+ *   copy of each context. Used for digests without multi-buffer
+ *   kernels.
+ *
+ * \return Nothing.
+ */
+
+static void hmac_batch_serial( crypto_context *const *ctx, int n, const void *const *msg,
+							   const size_t *len, uint8_t *out ) {
+	hmac_context tmp;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		hmac_clone(ctx[i],(crypto_context *)&tmp);
+		hmac_restore(&tmp,hmac_istate(&tmp));
+		hmac_update((crypto_context *)&tmp,msg[i],len[i]);
+		hmac_finish((crypto_context *)&tmp,out);
+		out += ctx[i]->size >> 3;
+	}
+
+	memset(&tmp,0,sizeof(tmp));
+}
+
+/**
+ * \brief Calculate the HMACs of a batch of messages. The inner hashes
+ *   of all messages run in the lanes of the multi-buffer kernels
+ *   starting from the ipad midstates, then the outer hashes do the
+ *   same from the opad midstates.
+ *
+ * \param ctx A pointer to an array of n keyed HMAC contexts, all of
+ *   the same algorithm. The contexts are only read, thus the same
+ *   context may appear several times and may be shared by threads.
+ * \param n The number of messages.
+ * \param msg A pointer to an array of n message pointers.
+ * \param len A pointer to an array of n message lengths.
+ * \param out A pointer to the output buffer of n digests. The digests
+ *   are stored one after the other.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_INVALID_ARGUMENT if a
+ *   context is not a keyed HMAC of the same algorithm as the others.
+ */
+
+int hmac_mb( crypto_context *const *ctx, int n, const void *const *msg,
+			 const size_t *len, uint8_t *out ) {
+	mb_job_t jobs[HMAC_MB_BATCH];
+	uint8_t inner[HMAC_MB_BATCH*SHA256_HSH_SIZE];
+	mb_algo_t a;
+	int hsz, i, m;
+
+	if (n <= 0) {
+		return CRYPTO_SUCCESS;
+	}
+	for (i = 0; i < n; i++) {
+		if (ctx[i]->ops != &hmac_ops || ctx[i]->algorithm != ctx[0]->algorithm ||
+			!(ctx[i]->flags & CFLAG_KEYED)) {
+			return CRYPTO_ERROR_INVALID_ARGUMENT;
+		}
+	}
+	if (mb_setup(&a,ctx[0]->algorithm - TEE_ALG_HMAC_MD5 + TEE_ALG_MD5) != CRYPTO_SUCCESS) {
+		hmac_batch_serial(ctx,n,msg,len,out);
+		return CRYPTO_SUCCESS;
+	}
+
+	hsz = ctx[0]->size >> 3;
+
+	while (n > 0) {
+		m = n > HMAC_MB_BATCH ? HMAC_MB_BATCH : n;
+
+		/* inner */
+		for (i = 0; i < m; i++) {
+			jobs[i].msg = msg[i];
+			jobs[i].len = len[i];
+			jobs[i].iv = hmac_istate(hmac_get_hmac(ctx[i]))->H.w32;
+			jobs[i].prefix = ctx[i]->block_size;
+			jobs[i].out = inner + i*hsz;
+		}
+
+		mb_digest_jobs(&a,jobs,m);
+
+		/* outer */
+		for (i = 0; i < m; i++) {
+			jobs[i].msg = inner + i*hsz;
+			jobs[i].len = hsz;
+			jobs[i].iv = hmac_ostate(hmac_get_hmac(ctx[i]))->H.w32;
+			jobs[i].out = out;
+			out += hsz;
+		}
+
+		mb_digest_jobs(&a,jobs,m);
+
+		ctx += m;
+		msg += m;
+		len += m;
+		n -= m;
+	}
+
+	memset(inner,0,sizeof(inner));
+	return CRYPTO_SUCCESS;
+}
+
+/**
+ * \brief Verify the HMACs of a batch of messages, see hmac_mb(). The
+ *   tags are compared in constant time.
+ *
+ * \param ctx A pointer to an array of n keyed HMAC contexts.
+ * \param n The number of messages.
+ * \param msg A pointer to an array of n message pointers.
+ * \param len A pointer to an array of n message lengths.
+ * \param tag A pointer to n expected tags stored one after the other.
+ * \param tlen The length of a tag, at most the digest size. A shorter
+ *   tag is compared against the leftmost octets of the HMAC.
+ * \param res A pointer to an array of n results, CRYPTO_SUCCESS or
+ *   CRYPTO_ERROR_VALIDATION_FAILED.
+ *
+ * \return CRYPTO_SUCCESS if all tags are valid, CRYPTO_ERROR_VALIDATION_FAILED
+ *   if any is not, CRYPTO_ERROR_INVALID_ARGUMENT on a bad context or
+ *   tag length.
+ */
+
+int hmac_verify_mb( crypto_context *const *ctx, int n, const void *const *msg,
+					const size_t *len, const uint8_t *tag, size_t tlen, int *res ) {
+	uint8_t mac[HMAC_MB_BATCH*SHA512_HSH_SIZE];
+	int r = CRYPTO_SUCCESS;
+	int hsz, i, k, m;
+	uint8_t d;
+
+	if (n <= 0) {
+		return CRYPTO_SUCCESS;
+	}
+
+	hsz = ctx[0]->size >> 3;
+
+	if (tlen == 0 || tlen > hsz) {
+		return CRYPTO_ERROR_INVALID_ARGUMENT;
+	}
+	for (i = 1; i < n; i++) {
+		if (ctx[i]->algorithm != ctx[0]->algorithm) {
+			return CRYPTO_ERROR_INVALID_ARGUMENT;
+		}
+	}
+
+	while (n > 0) {
+		m = n > HMAC_MB_BATCH ? HMAC_MB_BATCH : n;
+
+		if ((k = hmac_mb(ctx,m,msg,len,mac)) != CRYPTO_SUCCESS) {
+			return k;
+		}
+		for (i = 0; i < m; i++) {
+			for (d = 0, k = 0; k < tlen; k++) {
+				d |= mac[i*hsz+k] ^ tag[k];
+			}
+			if (d) {
+				res[i] = CRYPTO_ERROR_VALIDATION_FAILED;
+				r = CRYPTO_ERROR_VALIDATION_FAILED;
+			} else {
+				res[i] = CRYPTO_SUCCESS;
+			}
+			tag += tlen;
+		}
+
+		ctx += m;
+		msg += m;
+		len += m;
+		res += m;
+		n -= m;
+	}
+
+	memset(mac,0,sizeof(mac));
+	return r;
+}
+
+
 //#if !defined(PARTOFLIBRARY)
 
 /*
@@ -290,45 +601,37 @@ int main( int argc, char** argv ) {
 	uint8_t digest_md5[MD5_HSH_SIZE];
 	uint8_t digest_sha1[SHA1_HSH_SIZE];
 	uint8_t digest_sha256[SHA256_HSH_SIZE];
-	crypto_context  *hsh, *hmac_sha1, *hmac_sha256, *hmac_md5;
+	crypto_context  *hmac_sha1, *hmac_sha256, *hmac_md5;
 	int n;
 
-	sha1_context_t sha1;
-	sha256_context_t sha256;
-	md5_context_t md5;
 	hmac_context h_md5;
 	hmac_context h_sha1;
 	hmac_context h_sha256;
 
-    hsh = md5_init(&md5);
-    hmac_md5 = hmac_init(&h_md5,hsh);
-
-    hsh = sha1_init(&sha1);
-    hmac_sha1 = hmac_init(&h_sha1,hsh);
-    
-    hsh = sha256_init(&sha256);
-    hmac_sha256 = hmac_init(&h_sha256,hsh);
+    hmac_md5 = hmac_init(&h_md5,TEE_ALG_HMAC_MD5);
+    hmac_sha1 = hmac_init(&h_sha1,TEE_ALG_HMAC_SHA1);
+    hmac_sha256 = hmac_init(&h_sha256,TEE_ALG_HMAC_SHA256);
 
-	hmac_md5->reset(hmac_md5,CTAG_KEY,"key",CTAG_KEY_LEN,3,CTAG_DONE);
-	hmac_sha1->reset(hmac_sha1,CTAG_KEY,"key",CTAG_KEY_LEN,3,CTAG_DONE);
-	hmac_sha256->reset(hmac_sha256,CTAG_KEY,"key",CTAG_KEY_LEN,3,CTAG_DONE);
+	crypto_reset(hmac_md5,CTAG_KEY,"key",CTAG_KEY_LEN,3,CTAG_DONE);
+	crypto_reset(hmac_sha1,CTAG_KEY,"key",CTAG_KEY_LEN,3,CTAG_DONE);
+	crypto_reset(hmac_sha256,CTAG_KEY,"key",CTAG_KEY_LEN,3,CTAG_DONE);
 
-	hmac_md5->update(hmac_md5,msg,strlen(msg));
-	hmac_md5->finish(hmac_md5,digest_md5);
+	crypto_update(hmac_md5,msg,strlen(msg));
+	crypto_finish(hmac_md5,digest_md5);
 
-	hmac_sha1->update(hmac_sha1,msg,strlen(msg));
-	hmac_sha1->finish(hmac_sha1,digest_sha1);
+	crypto_update(hmac_sha1,msg,strlen(msg));
+	crypto_finish(hmac_sha1,digest_sha1);
 
-	hmac_sha256->update(hmac_sha256,msg,strlen(msg));
-	hmac_sha256->finish(hmac_sha256,digest_sha256);
+	crypto_update(hmac_sha256,msg,strlen(msg));
+	crypto_finish(hmac_sha256,digest_sha256);
 
     output(digest_md5,MD5_HSH_SIZE,"MD5:");
     output(digest_sha1,SHA1_HSH_SIZE,"SHA1:");
     output(digest_sha256,SHA256_HSH_SIZE,"SHA256:");
 
-    hmac_md5->free(hmac_md5);
-    hmac_sha1->free(hmac_sha1);
-    hmac_sha256->free(hmac_sha256);
+    crypto_free(hmac_md5);
+    crypto_free(hmac_sha1);
+    crypto_free(hmac_sha256);
 
 	return 0;
 }
@@ -11,22 +11,82 @@
 #define _hmac_h_included
 
 #include "algorithm_types.h"
+#include "md5.h"
 #include "sha1.h"
+#include "sha256.h"
+#include "sha512.h"
 
-/* for now.. this is enough */
+/* the largest block size of the supported digests */
 
-#define HMAC_MAX_KEY SHA1_BLK_SIZE
+#define HMAC_MAX_KEY SHA512_BLK_SIZE
 
-/* the context is now "hardcoded" for at least MD5 and SHA-1. If you
- * need more flexibility, go ahead and structure.. 
+/* messages per multi-buffer pass of hmac_mb() */
+
+#define HMAC_MB_BATCH 256
+
+/* Any of the digest contexts. The digest of an HMAC is embedded in the
+ * HMAC context, thus an HMAC context is a single allocation of any
+ * supported digest.
+ */
+
+typedef union hmac_state_u {
+	md5_context_t md5;
+	sha1_context_t sha1;
+	sha256_context_t sha256;
+	sha512_context_t sha512;
+} hmac_state_t;
+
+/* A saved midstate. After the key ^ pad block the buffer of the digest
+ * is empty, thus the number of octets and the intermediate hash value
+ * are all there is, i.e. the digest context from index up to buf. Only
+ * the words of the digest are stored.
+ */
+
+typedef struct hmac_chain_s {
+	uint64_t index;
+	union {
+		uint32_t w32[16];
+		uint64_t w64[8];
+	} H;
+} hmac_chain_t;
+
+/* The midstates follow the digest context of its own size, thus an
+ * allocated context is only as large as its digest needs, see
+ * hmac_alloc(). The declared size fits any digest.
  */
 
 typedef struct hmac_context_s {
 	crypto_context hdr;
-	uint8_t pad[HMAC_MAX_KEY];
-	crypto_context *digest;
+	size_t state_size;		/* of the digest context */
+	size_t chain_size;		/* of a saved midstate */
+	hmac_state_t hash;		/* the digest being calculated */
+	hmac_chain_t chain[2];	/* room for the ipad and opad midstates */
 } hmac_context;
 
+/**
+ * \brief Get the midstate after the key ^ ipad block.
+ *
+ * \param htx A pointer to the HMAC context.
+ *
+ * \return A pointer to the midstate.
+ */
+
+static inline hmac_chain_t *hmac_istate( const hmac_context *htx ) {
+	return (hmac_chain_t *)((uint8_t *)&htx->hash + htx->state_size);
+}
+
+/**
+ * \brief Get the midstate after the key ^ opad block.
+ *
+ * \param htx A pointer to the HMAC context.
+ *
+ * \return A pointer to the midstate.
+ */
+
+static inline hmac_chain_t *hmac_ostate( const hmac_context *htx ) {
+	return (hmac_chain_t *)((uint8_t *)hmac_istate(htx) + htx->chain_size);
+}
+
 /**
  * \brief Generic HMAC function prototypes.
  *
@@ -35,6 +95,9 @@ typedef struct hmac_context_s {
  */
 
 crypto_context *hmac_alloc( uint32_t );
-crypto_context *hmac_init( hmac_context*, crypto_context* );
+crypto_context *hmac_init( hmac_context*, uint32_t );
+int hmac_mb( crypto_context *const *, int, const void *const *, const size_t *, uint8_t * );
+int hmac_verify_mb( crypto_context *const *, int, const void *const *, const size_t *,
+					const uint8_t *, size_t, int * );
 
 #endif /* _hmac_h_included  */
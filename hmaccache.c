@@ -0,0 +1,367 @@
+/**
+ * \file hmaccache.c
+ * \brief A cache of keyed HMAC states, see hmaccache.h. An entry holds
+ *   copies of the ipad and opad midstates of an hmac_context. Readers
+ *   copy them out between two reads of the sequence counter of the
+ *   entry, writers make the counter odd for the duration of an update.
+ *   A writer claims an entry with a compare and swap, thus writers do
+ *   not wait for each other either, a lost race just skips the insert.
+ *
+ *   LRU is approximated with an epoch counter that advances on every
+ *   insert. A hit stamps the entry with the current epoch, which is a
+ *   store only when the epoch has changed, i.e. hot entries are not
+ *   written to on every lookup.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <memory.h>
+#include <stdatomic.h>
+
+#include "hmaccache.h"
+#include "hmac.h"
+#include "crypto_error.h"
+
+#define HMAC_CACHE_LINE     64
+
+typedef struct hmac_cache_entry_s {
+    _Atomic uint32_t seq;       /* odd while the entry is written */
+    _Atomic uint32_t used;      /* epoch of the last insert or hit */
+    _Atomic uint64_t key_id;    /* 0 if the entry is empty */
+    uint8_t state[];            /* ipad midstate, then opad midstate */
+} hmac_cache_entry_t;
+
+struct hmac_cache_s {
+    uint32_t algorithm;         /* TEE_ALG_HMAC_* */
+    size_t state_size;          /* of one midstate */
+    size_t stride;              /* of an entry, a multiple of a cache line */
+    int bits;                   /* log2 of the number of sets */
+    _Atomic uint32_t epoch;
+    uint8_t *entries;
+};
+
+/**
+ * \brief Get an entry of a set.
+ *
+ * \param c A pointer to the cache.
+ * \param set The set index.
+ * \param way The way within the set.
+ *
+ * \return A pointer to the entry.
+ */
+
+static hmac_cache_entry_t *cache_entry( const hmac_cache_t *c, size_t set, int way ) {
+    return (hmac_cache_entry_t *)(c->entries + (set * HMAC_CACHE_WAYS + way) * c->stride);
+}
+
+/**
+ * \brief Map a key_id to a set. The multiplication spreads consecutive
+ *   identifiers over the sets.
+ *
+ * \param c A pointer to the cache.
+ * \param key_id The key identifier.
+ *
+ * \return The set index.
+ */
+
+static size_t cache_set( const hmac_cache_t *c, uint64_t key_id ) {
+    if (c->bits == 0) {
+        return 0;
+    }
+
+    return (key_id * 0x9e3779b97f4a7c15ULL) >> (64 - c->bits);
+}
+
+/**
+ * \brief Look a key up and copy its midstates into the HMAC context.
+ *   The context may be left half written on a miss.
+ *
+ * \param c A pointer to the cache.
+ * \param key_id The key identifier.
+ * \param htx A pointer to the HMAC context.
+ *
+ * \return 1 on a hit, 0 on a miss.
+ */
+
+static int cache_lookup( hmac_cache_t *c, uint64_t key_id, hmac_context *htx ) {
+    size_t set = cache_set(c,key_id);
+    hmac_cache_entry_t *e;
+    uint32_t seq, now;
+    int w;
+
+    for (w = 0; w < HMAC_CACHE_WAYS; w++) {
+        e = cache_entry(c,set,w);
+        seq = atomic_load_explicit(&e->seq,memory_order_acquire);
+
+        if ((seq & 1) || atomic_load_explicit(&e->key_id,memory_order_relaxed) != key_id) {
+            continue;
+        }
+
+        memcpy(hmac_istate(htx),e->state,2 * c->state_size);
+        atomic_thread_fence(memory_order_acquire);
+
+        if (atomic_load_explicit(&e->seq,memory_order_relaxed) != seq) {
+            /* replaced while copying */
+            return 0;
+        }
+
+        now = atomic_load_explicit(&c->epoch,memory_order_relaxed);
+
+        if (atomic_load_explicit(&e->used,memory_order_relaxed) != now) {
+            atomic_store_explicit(&e->used,now,memory_order_relaxed);
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief Claim an entry for writing.
+ *
+ * \param e A pointer to the entry.
+ * \param seq A pointer to the even sequence number on return.
+ *
+ * \return 1 if claimed, 0 if another writer has it.
+ */
+
+static int cache_claim( hmac_cache_entry_t *e, uint32_t *seq ) {
+    *seq = atomic_load_explicit(&e->seq,memory_order_relaxed);
+
+    if ((*seq & 1) || !atomic_compare_exchange_strong_explicit(&e->seq,seq,*seq + 1,
+                                                                memory_order_relaxed,
+                                                                memory_order_relaxed)) {
+        return 0;
+    }
+
+    atomic_thread_fence(memory_order_release);
+    return 1;
+}
+
+/**
+ * \brief Insert the midstates of a freshly keyed HMAC context. The
+ *   victim is an empty entry of the set or, failing that, the least
+ *   recently used one.
+ *
+ * \param c A pointer to the cache.
+ * \param key_id The key identifier.
+ * \param htx A pointer to the HMAC context.
+ *
+ * \return Nothing.
+ */
+
+static void cache_insert( hmac_cache_t *c, uint64_t key_id, const hmac_context *htx ) {
+    size_t set = cache_set(c,key_id);
+    hmac_cache_entry_t *e, *victim = NULL;
+    uint32_t now = atomic_load_explicit(&c->epoch,memory_order_relaxed);
+    uint32_t age, oldest = 0;
+    uint64_t id;
+    uint32_t seq;
+    int w;
+
+    for (w = 0; w < HMAC_CACHE_WAYS; w++) {
+        e = cache_entry(c,set,w);
+        id = atomic_load_explicit(&e->key_id,memory_order_relaxed);
+
+        if (id == key_id) {
+            /* inserted by another thread meanwhile */
+            return;
+        }
+        if (id == 0) {
+            victim = e;
+            break;
+        }
+
+        age = now - atomic_load_explicit(&e->used,memory_order_relaxed);
+
+        if (victim == NULL || age > oldest) {
+            victim = e;
+            oldest = age;
+        }
+    }
+
+    if (!cache_claim(victim,&seq)) {
+        return;
+    }
+
+    atomic_store_explicit(&victim->key_id,key_id,memory_order_relaxed);
+    memcpy(victim->state,hmac_istate(htx),2 * c->state_size);
+
+    now = atomic_fetch_add_explicit(&c->epoch,1,memory_order_relaxed) + 1;
+    atomic_store_explicit(&victim->used,now,memory_order_relaxed);
+    atomic_store_explicit(&victim->seq,seq + 2,memory_order_release);
+}
+
+/**
+ * \brief Allocate a key cache.
+ *
+ * \param alg The HMAC algorithm identifier, TEE_ALG_HMAC_*. Only
+ *   contexts of this algorithm can be used with the cache.
+ * \param entries The number of keys to cache. Rounded up to a power of
+ *   two number of sets.
+ *
+ * \return A pointer to the cache. NULL if a) out of memory or b) the
+ *   algorithm is not supported.
+ */
+
+hmac_cache_t *hmac_cache_alloc( uint32_t alg, size_t entries ) {
+    hmac_context htx;
+    hmac_cache_t *c;
+    void *mem;
+    size_t sets = 1;
+    int bits = 0;
+
+    if (hmac_init(&htx,alg) == NULL) {
+        return NULL;
+    }
+    while (sets * HMAC_CACHE_WAYS < entries) {
+        sets <<= 1;
+        bits++;
+    }
+    if ((c = malloc(sizeof(hmac_cache_t))) == NULL) {
+        return NULL;
+    }
+
+    c->algorithm = alg;
+    c->state_size = htx.chain_size;
+    c->stride = (sizeof(hmac_cache_entry_t) + 2 * c->state_size + HMAC_CACHE_LINE - 1) &
+                ~(size_t)(HMAC_CACHE_LINE - 1);
+    c->bits = bits;
+    atomic_init(&c->epoch,0);
+
+    if (posix_memalign(&mem,HMAC_CACHE_LINE,sets * HMAC_CACHE_WAYS * c->stride)) {
+        free(c);
+        return NULL;
+    }
+
+    /* all zero is an empty entry */
+    memset(mem,0,sets * HMAC_CACHE_WAYS * c->stride);
+    c->entries = mem;
+    return c;
+}
+
+/**
+ * \brief Free a key cache. The cached midstates are cleared first as
+ *   they are as good as the keys.
+ *
+ * \param c A pointer to the cache.
+ *
+ * \return Nothing.
+ */
+
+void hmac_cache_free( hmac_cache_t *c ) {
+    if (c == NULL) {
+        return;
+    }
+
+    memset(c->entries,0,((size_t)HMAC_CACHE_WAYS << c->bits) * c->stride);
+    free(c->entries);
+    free(c);
+}
+
+/**
+ * \brief Reset an HMAC context with a key, using the cached midstates
+ *   of the key when there are such. On a miss the key is hashed as
+ *   with crypto_reset() and the result is added to the cache.
+ *
+ * \param c A pointer to the cache.
+ * \param ctx A pointer to an HMAC context of the algorithm of the cache.
+ * \param key_id A non-zero identifier of the key. 0 bypasses the cache.
+ * \param key A pointer to the key.
+ * \param klen The length of the key, at most INT_MAX.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_INVALID_ARGUMENT if the
+ *   context does not match the cache or the key is too long, otherwise
+ *   see crypto_reset().
+ */
+
+int hmac_cache_reset( hmac_cache_t *c, crypto_context *ctx, uint64_t key_id,
+                      const void *key, size_t klen ) {
+    hmac_context *htx = (hmac_context *)ctx;
+    int r;
+
+    if (ctx->algorithm != c->algorithm || klen > INT_MAX) {
+        return CRYPTO_ERROR_INVALID_ARGUMENT;
+    }
+    if (key_id && cache_lookup(c,key_id,htx)) {
+        /* continue from the cached ipad midstate */
+        ctx->flags |= CFLAG_KEYED;
+        return crypto_reset(ctx,CTAG_DONE);
+    }
+    if ((r = crypto_reset(ctx,CTAG_KEY,key,CTAG_KEY_LEN,(int)klen,CTAG_DONE)) != CRYPTO_SUCCESS) {
+        return r;
+    }
+    if (key_id) {
+        cache_insert(c,key_id,htx);
+    }
+
+    return CRYPTO_SUCCESS;
+}
+
+/**
+ * \brief Remove a key from the cache, e.g. when it is revoked. Waits
+ *   for a concurrent writer of the entry, if any.
+ *
+ * \param c A pointer to the cache.
+ * \param key_id The key identifier.
+ *
+ * \return Nothing.
+ */
+
+void hmac_cache_remove( hmac_cache_t *c, uint64_t key_id ) {
+    size_t set = cache_set(c,key_id);
+    hmac_cache_entry_t *e;
+    uint32_t seq;
+    int w;
+
+    for (w = 0; w < HMAC_CACHE_WAYS; w++) {
+        e = cache_entry(c,set,w);
+
+        while (atomic_load_explicit(&e->key_id,memory_order_relaxed) == key_id) {
+            if (cache_claim(e,&seq)) {
+                atomic_store_explicit(&e->key_id,0,memory_order_relaxed);
+                memset(e->state,0,2 * c->state_size);
+                atomic_store_explicit(&e->seq,seq + 2,memory_order_release);
+            }
+        }
+    }
+}
+
+
+
+#if !defined(PARTOFLIBRARY)
+int main( int argc, char** argv )
+{
+    static char msg[] = "The quick brown fox jumps over the lazy dog";
+    uint8_t mac[32];
+    hmac_context h;
+    hmac_cache_t *c;
+    crypto_context *ctx;
+    int i, n;
+
+    c = hmac_cache_alloc(TEE_ALG_HMAC_SHA256,1024);
+    ctx = hmac_init(&h,TEE_ALG_HMAC_SHA256);
+
+    /* the first round misses, the second hits */
+    for (i = 0; i < 2; i++) {
+        hmac_cache_reset(c,ctx,1,"key",3);
+        crypto_update(ctx,msg,sizeof(msg)-1);
+        crypto_finish(ctx,mac);
+
+        for (n = 0; n < 32; n++) {
+            printf("%02x",mac[n]);
+        }
+        printf("\n");
+    }
+
+    crypto_free(ctx);
+    hmac_cache_free(c);
+    return 0;
+}
+#endif
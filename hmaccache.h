@@ -0,0 +1,43 @@
+/**
+ * \file hmaccache.h
+ * \brief A cache of keyed HMAC states for servers that verify messages
+ *   with a bounded set of keys. The ipad and opad midstates of a key
+ *   are computed once and shared by all threads, thus a reset with a
+ *   cached key costs no compressions at all.
+ *
+ *   The cache is set associative with HMAC_CACHE_WAYS entries per set
+ *   and evicts the least recently used entry of a set. Lookups take no
+ *   locks, every entry is protected by a sequence counter and a lookup
+ *   that races with a writer is simply treated as a miss.
+ *
+ *   Keys are identified by a caller chosen non-zero key_id, e.g. the
+ *   tenant and the key version. A key_id must never be reused for a
+ *   different key, or hmac_cache_remove() must be called first.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#ifndef _hmaccache_h_included
+#define _hmaccache_h_included
+
+#include <stdint.h>
+#include <stddef.h>
+#include "algorithm_types.h"
+
+#define HMAC_CACHE_WAYS     4   /**< Entries per set */
+
+typedef struct hmac_cache_s hmac_cache_t;
+
+/**
+ * \brief HMAC key cache function prototypes.
+ *
+ */
+
+hmac_cache_t *hmac_cache_alloc( uint32_t, size_t );
+void hmac_cache_free( hmac_cache_t * );
+int hmac_cache_reset( hmac_cache_t *, crypto_context *, uint64_t, const void *, size_t );
+void hmac_cache_remove( hmac_cache_t *, uint64_t );
+
+#endif /* _hmaccache_h_included */
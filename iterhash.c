@@ -0,0 +1,325 @@
+/**
+ * \file iterhash.c
+ * \brief Iterated hashing. After the first pass the input of every
+ *   pass is a digest, which always fits into a single block together
+ *   with the padding. The block is built once with the padding and the
+ *   length, each pass stores the previous digest into it and runs the
+ *   compression function from the initial hash value. There is no
+ *   context, buffering or padding logic in the loop. SHA-224 and SHA-256
+ *   use sha256_iterate(), which with SHA-NI keeps the digest and the
+ *   padding in registers for the whole chain.
+ *
+ *   The batch form runs independent chains in the lanes of the
+ *   multi-buffer kernels, one block per lane per pass.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <memory.h>
+
+#include "iterhash.h"
+#include "multibuf.h"
+#include "oneshot.h"
+#include "sha256.h"
+#include "sha512.h"
+#include "crypto_error.h"
+
+/**
+ * \brief Build the padding of a block holding one digest.
+ *
+ * \param b A pointer to the block.
+ * \param blk The block size.
+ * \param hsz The digest size.
+ * \param le Non-zero for a little endian length (MD5).
+ *
+ * \return Nothing.
+ */
+
+static void iter_pad( uint8_t *b, int blk, int hsz, int le ) {
+    uint64_t bits = (uint64_t)hsz << 3;
+    int n;
+
+    memset(b+hsz,0,blk-hsz);
+    b[hsz] = 0x80;
+
+    for (n = 0; n < 8; n++) {
+        if (le) {
+            b[blk-8+n] = bits >> (n*8);
+        } else {
+            b[blk-1-n] = bits >> (n*8);
+        }
+    }
+}
+
+/**
+ * \brief Store one word into octets.
+ *
+ * \param b A pointer to the output.
+ * \param w The word.
+ * \param le Non-zero for little endian (MD5).
+ *
+ * \return Nothing.
+ */
+
+static inline void iter_put32( uint8_t *b, uint32_t w, int le ) {
+    if (le) {
+        b[0] = w;
+        b[1] = w >> 8;
+        b[2] = w >> 16;
+        b[3] = w >> 24;
+    } else {
+        b[0] = w >> 24;
+        b[1] = w >> 16;
+        b[2] = w >> 8;
+        b[3] = w;
+    }
+}
+
+/**
+ * \brief Iterate a 32-bit word digest with the single lane kernel.
+ *
+ * \param a A pointer to the digest description.
+ * \param x A pointer to the digest to iterate, replaced by the result.
+ * \param n The number of passes.
+ *
+ * \return Nothing.
+ */
+
+static void iter_run32( const mb_algo_t *a, uint8_t *x, uint64_t n ) {
+    uint8_t b[MB_BLK_SIZE];
+    uint32_t H[MB_MAX_WORDS];
+    int hsz = a->out_words * 4;
+    int le = !a->big_endian;
+    int w;
+
+    if (a->algorithm == TEE_ALG_SHA224 || a->algorithm == TEE_ALG_SHA256) {
+        /* the digest stays as words, in registers with SHA-NI */
+        for (w = 0; w < a->out_words; w++) {
+            H[w] = (uint32_t)x[w*4] << 24 | x[w*4+1] << 16 | x[w*4+2] << 8 | x[w*4+3];
+        }
+
+        sha256_iterate(H,a->out_words,n);
+
+        for (w = 0; w < a->out_words; w++) {
+            iter_put32(x+w*4,H[w],0);
+        }
+        return;
+    }
+
+    iter_pad(b,MB_BLK_SIZE,hsz,le);
+    memcpy(b,x,hsz);
+
+    while (n-- > 0) {
+        memcpy(H,a->iv,a->words*sizeof(uint32_t));
+        a->single(H,b,1);
+
+        for (w = 0; w < a->out_words; w++) {
+            iter_put32(b+w*4,H[w],le);
+        }
+    }
+
+    memcpy(x,b,hsz);
+}
+
+/**
+ * \brief Iterate up to a->lanes digests at once in the lanes of the
+ *   multi-buffer kernel. Unused lanes run on their padding only.
+ *
+ * \param a A pointer to the digest description.
+ * \param x A pointer to m consecutive digests, replaced by the results.
+ * \param m The number of digests.
+ * \param n The number of passes.
+ *
+ * \return Nothing.
+ */
+
+static void iter_run_lanes( const mb_algo_t *a, uint8_t *x, int m, uint64_t n ) {
+    uint8_t b[MB_MAX_LANES][MB_BLK_SIZE];
+    const uint8_t *p[MB_MAX_LANES];
+    uint32_t S[MB_MAX_WORDS*MB_MAX_LANES];
+    int hsz = a->out_words * 4;
+    int le = !a->big_endian;
+    int l, w;
+
+    for (l = 0; l < a->lanes; l++) {
+        iter_pad(b[l],MB_BLK_SIZE,hsz,le);
+
+        if (l < m) {
+            memcpy(b[l],x+l*hsz,hsz);
+        }
+
+        p[l] = b[l];
+    }
+
+    while (n-- > 0) {
+        for (w = 0; w < a->words; w++) {
+            for (l = 0; l < a->lanes; l++) {
+                S[w*MB_MAX_LANES+l] = a->iv[w];
+            }
+        }
+
+        a->blocks(S,p);
+
+        for (w = 0; w < a->out_words; w++) {
+            for (l = 0; l < a->lanes; l++) {
+                iter_put32(b[l]+w*4,S[w*MB_MAX_LANES+l],le);
+            }
+        }
+    }
+
+    for (l = 0; l < m; l++) {
+        memcpy(x+l*hsz,b[l],hsz);
+    }
+}
+
+/**
+ * \brief Iterate SHA-384 or SHA-512.
+ *
+ * \param iv A pointer to the initial hash value.
+ * \param hsz The digest size.
+ * \param x A pointer to the digest to iterate, replaced by the result.
+ * \param n The number of passes.
+ *
+ * \return Nothing.
+ */
+
+static void iter_run64( const uint64_t *iv, int hsz, uint8_t *x, uint64_t n ) {
+    uint8_t b[SHA512_BLK_SIZE];
+    uint64_t H[8];
+    int w, k;
+
+    /* the 128-bit length, the upper half is zero */
+    iter_pad(b,SHA512_BLK_SIZE,hsz,0);
+    memcpy(b,x,hsz);
+
+    while (n-- > 0) {
+        memcpy(H,iv,sizeof(H));
+        sha512_compress(H,b,1);
+
+        for (w = 0; w < hsz / 8; w++) {
+            for (k = 0; k < 8; k++) {
+                b[w*8+k] = H[w] >> (56 - k*8);
+            }
+        }
+    }
+
+    memcpy(x,b,hsz);
+}
+
+/**
+ * \brief Calculate an iterated hash, i.e. the digest of the input is
+ *   hashed again n-1 times. n = 2 gives e.g. the double SHA-256.
+ *
+ * \param alg The digest algorithm identifier, TEE_ALG_MD5 or TEE_ALG_SHA*.
+ * \param buf A pointer to the input.
+ * \param len The length of the input.
+ * \param n The number of passes, at least 1.
+ * \param out A pointer to the digest output buffer.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_UNSUPPORTED_DIGEST if the
+ *   algorithm is unknown, CRYPTO_ERROR_INVALID_ARGUMENT if n is 0.
+ */
+
+int crypto_hash_iterate( uint32_t alg, const void *buf, size_t len, uint64_t n, uint8_t *out ) {
+    mb_algo_t a;
+    int r;
+
+    if (n == 0) {
+        return CRYPTO_ERROR_INVALID_ARGUMENT;
+    }
+    if ((r = crypto_digest(alg,buf,len,out)) != CRYPTO_SUCCESS) {
+        return r;
+    }
+
+    switch (alg) {
+    case TEE_ALG_SHA384:
+        iter_run64(sha384_iv,SHA384_HSH_SIZE,out,n-1);
+        break;
+    case TEE_ALG_SHA512:
+        iter_run64(sha512_iv,SHA512_HSH_SIZE,out,n-1);
+        break;
+    default:
+        mb_setup(&a,alg);
+        iter_run32(&a,out,n-1);
+        break;
+    }
+
+    return CRYPTO_SUCCESS;
+}
+
+/**
+ * \brief Calculate iterated hashes of a batch of independent messages,
+ *   see crypto_hash_iterate(). The first pass is crypto_digest_mb(),
+ *   the following passes keep one chain per lane.
+ *
+ * \param alg The digest algorithm identifier, TEE_ALG_MD5 or TEE_ALG_SHA*.
+ *   SHA-384 and SHA-512 have no multi-buffer kernels and run the chains
+ *   one after another.
+ * \param cnt The number of messages.
+ * \param msg A pointer to an array of cnt message pointers.
+ * \param len A pointer to an array of cnt message lengths.
+ * \param n The number of passes, at least 1.
+ * \param out A pointer to the output buffer of cnt digests. The digests
+ *   are stored one after the other.
+ *
+ * \return See crypto_hash_iterate().
+ */
+
+int crypto_hash_iterate_mb( uint32_t alg, int cnt, const void *const *msg, const size_t *len,
+                            uint64_t n, uint8_t *out ) {
+    mb_algo_t a;
+    int hsz, i, m, r;
+
+    if (n == 0) {
+        return CRYPTO_ERROR_INVALID_ARGUMENT;
+    }
+    if (mb_setup(&a,alg) != CRYPTO_SUCCESS) {
+        for (i = 0; i < cnt; i++) {
+            if ((r = crypto_hash_iterate(alg,msg[i],len[i],n,out)) != CRYPTO_SUCCESS) {
+                return r;
+            }
+            out += alg == TEE_ALG_SHA384 ? SHA384_HSH_SIZE : SHA512_HSH_SIZE;
+        }
+        return CRYPTO_SUCCESS;
+    }
+
+    crypto_digest_mb(alg,cnt,msg,len,out);
+    hsz = a.out_words * 4;
+
+    for (i = 0; i < cnt; i += m) {
+        if (a.lanes < 2) {
+            m = 1;
+            iter_run32(&a,out+i*hsz,n-1);
+        } else {
+            m = cnt - i < a.lanes ? cnt - i : a.lanes;
+            iter_run_lanes(&a,out+i*hsz,m,n-1);
+        }
+    }
+
+    return CRYPTO_SUCCESS;
+}
+
+
+
+#if !defined(PARTOFLIBRARY)
+int main( int argc, char** argv )
+{
+    /* double SHA-256 of "hello" is
+     * 9595c9df90075148eb06860365df33584b75bff782a510c6cd4883a419833d50 */
+    uint8_t hash[SHA256_HSH_SIZE];
+    int n;
+
+    crypto_hash_iterate(TEE_ALG_SHA256,"hello",5,2,hash);
+
+    for (n = 0; n < sizeof(hash); n++) {
+        printf("%02x",hash[n]);
+    }
+    printf("\n");
+
+    return 0;
+}
+#endif
@@ -0,0 +1,27 @@
+/**
+ * \file iterhash.h
+ * \brief Iterated hashing, i.e. H(H(..H(x)..)), for hash chains, one
+ *   time password schemes and double hashing.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#ifndef _iterhash_h_included
+#define _iterhash_h_included
+
+#include <stdint.h>
+#include <stddef.h>
+#include "algorithm_types.h"
+
+/**
+ * \brief Iterated hash function prototypes.
+ *
+ */
+
+int crypto_hash_iterate( uint32_t, const void *, size_t, uint64_t, uint8_t * );
+int crypto_hash_iterate_mb( uint32_t, int, const void *const *, const size_t *, uint64_t,
+                            uint8_t * );
+
+#endif /* _iterhash_h_included */
@@ -19,6 +19,9 @@
 #include <assert.h>
 #include "md5.h"
 #include "crypto_error.h"
+#include "cpu_features.h"
+#include "midstate.h"
+#include "multibuf.h"
 
 /* constants .. */
 
@@ -50,11 +53,19 @@ static const uint8_t r[64] = {
 };
 
 
+/* MD5 initial hash value */
+
+const uint32_t md5_iv[4] = {
+    0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476
+};
+
 /* potential candidate for inline asm */
 #define ROL(n,w) (((w) << n) | ((w) >> (32-n)))
 
 /**
  * \brief Extract a LITTLE_ENDIAN unsigned long word out of the buffer.
+ *   With GCC the word is loaded at once and byte swapped on big
+ *   endian hosts. The buffer needs not be aligned.
  *
  * \param b A pointer to the buffer. The buffer must have
  *   at least 4 octets of space.
@@ -62,12 +73,21 @@ static const uint8_t r[64] = {
  * \return The extracted unsigned long word.
  */
 
-static inline uint32_t getlong( uint8_t *b ) {
+static inline uint32_t getlong( const uint8_t *b ) {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__)
+    uint32_t l;
+    memcpy(&l,b,sizeof(l));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    l = __builtin_bswap32(l);
+#endif
+    return l;
+#else
     uint32_t l = *b++;
     l |= *b++ << 8;
     l |= *b++ << 16;
     l |= *b++ << 24;
     return l;
+#endif
 }
 
 /**
@@ -91,55 +111,245 @@ static inline uint8_t *putlong( uint8_t *b, uint32_t l ) {
 
 /**
  * \brief Update the MD5 hash value. The implementation is based
- *   on the RFC1321, i.e. the memory efficient version.
+ *   on the RFC1321, i.e. the memory efficient version. This is also
+ *   the exported kernel interface for hashing full blocks without
+ *   a context.
  *
- * \param ctx A pointer to the md5_context.
+ * \param H A pointer to the intermediate hash value H[4].
+ * \param p A pointer to the input blocks.
+ * \param n The number of MD5_BLK_SIZE blocks to process.
  *
  * \return Nothing.
  */
 
-static void md5_update_block( md5_context_t *ctx ) {
+void md5_compress( uint32_t *H, const uint8_t *p, size_t n ) {
     uint32_t W[16];
     uint32_t f, g;
-    uint32_t A = ctx->H[0];
-    uint32_t B = ctx->H[1];
-    uint32_t C = ctx->H[2];
-    uint32_t D = ctx->H[3];
     uint32_t i;
 
-    /* intialize the W[].. 16 first long words */
+    while (n-- > 0) {
+        uint32_t A = H[0];
+        uint32_t B = H[1];
+        uint32_t C = H[2];
+        uint32_t D = H[3];
+
+        /* intialize the W[].. 16 first long words */
+
+        for (i = 0; i < 16; i++) {
+            W[i] = getlong(p + i*4);
+        }
+        for (i = 0; i < 64; i++) {
+            uint32_t t;
+
+            if (i < 16) {
+                f = (B & C) | ((~B) & D);
+                g = i;
+            } else if (i < 32) {
+                f = (D & B) | ((~D) & C);
+                g = (5*i + 1) & 0xf; /* % 16; */
+            } else if (i < 48) {
+                f = B ^ C ^ D;
+                g = (3*i + 5) & 0xf; /* % 16; */
+            } else {
+                f = C ^ (B | (~D));
+                g = (7*i) & 0xf; /* % 16; */
+            }
+
+            t = D;
+            D = C;
+            C = B;
+            B = B + ROL((r[i]), (A + f + k[i] + W[g]));
+            A = t;
+        }
+
+        H[0] += A;
+        H[1] += B;
+        H[2] += C;
+        H[3] += D;
+        p += MD5_BLK_SIZE;
+    }
+}
+
+/**
+ * \brief Update the MD5 hash value with the block in the context
+ *   buffer.
+ *
+ * \param ctx A pointer to the md5_context.
+ *
+ * \return Nothing.
+ */
+
+static void md5_update_block( md5_context_t *ctx ) {
+    md5_compress(ctx->H,ctx->buf,1);
+}
 
-    for (i = 0; i < 16; i++) {
-        W[i] = getlong(ctx->buf + i*4);
+#if defined(CPU_X86_KERNELS)
+
+/* MD5 rounds for 8 and 16 lanes. The lane state is transposed, see
+ * multibuf.h, so every vector holds one word of every lane. The
+ * words are little endian, thus the blocks are loaded as they are.
+ */
+
+#define MB8_ADD(a,b) _mm256_add_epi32(a,b)
+
+/**
+ * \brief Compress one block in each of the 8 lanes using AVX2.
+ *
+ * \param S A pointer to the transposed lane state.
+ * \param p A pointer to 8 block pointers, one per lane.
+ *
+ * \return Nothing.
+ */
+
+__attribute__((target("avx2")))
+static void md5_x8_avx2( uint32_t *S, const uint8_t *const *p ) {
+    const __m256i ONES = _mm256_set1_epi32(-1);
+    __m256i W[16];
+    __m256i A, B, C, D;
+    int i;
+
+    mb_load_x8(W,p,0);
+
+    A = _mm256_loadu_si256((const __m256i *)&S[0*MB_MAX_LANES]);
+    B = _mm256_loadu_si256((const __m256i *)&S[1*MB_MAX_LANES]);
+    C = _mm256_loadu_si256((const __m256i *)&S[2*MB_MAX_LANES]);
+    D = _mm256_loadu_si256((const __m256i *)&S[3*MB_MAX_LANES]);
+
+    for (i = 0; i < 64; i++) {
+        __m256i f, t;
+        int g;
+
+        if (i < 16) {
+            f = _mm256_or_si256(_mm256_and_si256(B,C),_mm256_andnot_si256(B,D));
+            g = i;
+        } else if (i < 32) {
+            f = _mm256_or_si256(_mm256_and_si256(D,B),_mm256_andnot_si256(D,C));
+            g = (5*i + 1) & 0xf;
+        } else if (i < 48) {
+            f = _mm256_xor_si256(_mm256_xor_si256(B,C),D);
+            g = (3*i + 5) & 0xf;
+        } else {
+            f = _mm256_xor_si256(C,_mm256_or_si256(B,_mm256_xor_si256(D,ONES)));
+            g = (7*i) & 0xf;
+        }
+
+        t = MB8_ADD(MB8_ADD(A,f),MB8_ADD(_mm256_set1_epi32(k[i]),W[g]));
+        t = _mm256_or_si256(_mm256_slli_epi32(t,r[i]),_mm256_srli_epi32(t,32-r[i]));
+        A = D;
+        D = C;
+        C = B;
+        B = MB8_ADD(B,t);
     }
+
+#define MB8_STORE(n,v) _mm256_storeu_si256((__m256i *)&S[(n)*MB_MAX_LANES], \
+        MB8_ADD(v,_mm256_loadu_si256((const __m256i *)&S[(n)*MB_MAX_LANES])))
+    MB8_STORE(0,A);
+    MB8_STORE(1,B);
+    MB8_STORE(2,C);
+    MB8_STORE(3,D);
+#undef MB8_STORE
+}
+
+#undef MB8_ADD
+
+#define MB16_ADD(a,b) _mm512_add_epi32(a,b)
+
+/**
+ * \brief Compress one block in each of the 16 lanes using AVX-512.
+ *
+ * \param S A pointer to the transposed lane state.
+ * \param p A pointer to 16 block pointers, one per lane.
+ *
+ * \return Nothing.
+ */
+
+__attribute__((target("avx512f,avx512bw")))
+static void md5_x16_avx512( uint32_t *S, const uint8_t *const *p ) {
+    __m512i W[16];
+    __m512i A, B, C, D;
+    int i;
+
+    mb_load_x16(W,p,0);
+
+    A = _mm512_loadu_si512((const void *)&S[0*MB_MAX_LANES]);
+    B = _mm512_loadu_si512((const void *)&S[1*MB_MAX_LANES]);
+    C = _mm512_loadu_si512((const void *)&S[2*MB_MAX_LANES]);
+    D = _mm512_loadu_si512((const void *)&S[3*MB_MAX_LANES]);
+
     for (i = 0; i < 64; i++) {
-        uint32_t t;
+        __m512i f, t;
+        int g;
 
+        /* F is Ch(B,C,D), G is Ch(D,B,C) and I is C ^ (B | ~D), i.e.
+         * 0x39 as a ternary logic truth table */
         if (i < 16) {
-            f = (B & C) | ((~B) & D);
+            f = _mm512_ternarylogic_epi32(B,C,D,0xca);
             g = i;
         } else if (i < 32) {
-            f = (D & B) | ((~D) & C);
-            g = (5*i + 1) & 0xf; /* % 16; */
+            f = _mm512_ternarylogic_epi32(D,B,C,0xca);
+            g = (5*i + 1) & 0xf;
         } else if (i < 48) {
-            f = B ^ C ^ D;
-            g = (3*i + 5) & 0xf; /* % 16; */
+            f = _mm512_ternarylogic_epi32(B,C,D,0x96);
+            g = (3*i + 5) & 0xf;
         } else {
-            f = C ^ (B | (~D));
-            g = (7*i) & 0xf; /* % 16; */
+            f = _mm512_ternarylogic_epi32(B,C,D,0x39);
+            g = (7*i) & 0xf;
         }
 
-        t = D;
+        t = MB16_ADD(MB16_ADD(A,f),MB16_ADD(_mm512_set1_epi32(k[i]),W[g]));
+        t = _mm512_rolv_epi32(t,_mm512_set1_epi32(r[i]));
+        A = D;
         D = C;
         C = B;
-        B = B + ROL((r[i]), (A + f + k[i] + W[g]));
-        A = t;
+        B = MB16_ADD(B,t);
     }
 
-    ctx->H[0] += A;
-    ctx->H[1] += B;
-    ctx->H[2] += C;
-    ctx->H[3] += D;
+#define MB16_STORE(n,v) _mm512_storeu_si512((void *)&S[(n)*MB_MAX_LANES], \
+        MB16_ADD(v,_mm512_loadu_si512((const void *)&S[(n)*MB_MAX_LANES])))
+    MB16_STORE(0,A);
+    MB16_STORE(1,B);
+    MB16_STORE(2,C);
+    MB16_STORE(3,D);
+#undef MB16_STORE
+}
+
+#undef MB16_ADD
+#endif
+
+/**
+ * \brief Fill in the multi-buffer description of MD5 using the
+ *   widest lane kernel the CPU supports.
+ *
+ * \param a A pointer to the description to fill in.
+ * \param alg TEE_ALG_MD5.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_UNSUPPORTED_DIGEST otherwise.
+ */
+
+int md5_mb_setup( mb_algo_t *a, uint32_t alg ) {
+    if (alg != TEE_ALG_MD5) {
+        return CRYPTO_ERROR_UNSUPPORTED_DIGEST;
+    }
+
+    a->algorithm = alg;
+    a->words = 4;
+    a->out_words = 4;
+    a->big_endian = 0;
+    a->iv = md5_iv;
+    a->lanes = 1;
+    a->single = md5_compress;
+    a->blocks = NULL;
+
+#if defined(CPU_X86_KERNELS)
+    if (cpu_features() & CPU_FEATURE_AVX512) {
+        a->lanes = 16;
+        a->blocks = md5_x16_avx512;
+    } else if (cpu_features() & CPU_FEATURE_AVX2) {
+        a->lanes = 8;
+        a->blocks = md5_x8_avx2;
+    }
+#endif
+    return CRYPTO_SUCCESS;
 }
 
 
@@ -150,17 +360,14 @@ static void md5_update_block( md5_context_t *ctx ) {
  * \paramm ctx A pointer to the md5_context.
  */
 
-static int md5_reset( crypto_context *hdr, ... ) {
+static int md5_reset( crypto_context *hdr, va_list tags ) {
 	/* Note that we must not override the hdr->context value.. */
 	
     md5_context_t *ctx = (md5_context_t *)hdr;
 	ctx->index = 0;
 
     /* Initialize intermediate hash values */
-    ctx->H[0] = 0x67452301;
-    ctx->H[1] = 0xEFCDAB89;
-    ctx->H[2] = 0x98BADCFE;
-    ctx->H[3] = 0x10325476;
+    memcpy(ctx->H,md5_iv,sizeof(md5_iv));
 
 	return CRYPTO_SUCCESS;
 }
@@ -173,32 +380,43 @@ static int md5_reset( crypto_context *hdr, ... ) {
  *   initialized prior calling this function, otherwise the result is
  *   unpredictable.
  * \param buf A pointer to input octet buffer.
- * \param len The length of the input buffer. Must be greater or equal to 0.
+ * \param len The length of the input buffer.
  *
  * \return Nothing.
  */
 
-static void md5_update( crypto_context *hdr, const void *buf, int len ) {
+static void md5_update( crypto_context *hdr, const void *buf, size_t len ) {
     md5_context_t *ctx = (md5_context_t *)hdr;
-	int pos = 0;
-    uint8_t *b = (uint8_t *)buf;
+    const uint8_t *b = (const uint8_t *)buf;
+    size_t idx;
+
+    assert(ctx);
 
-    while (len > 0) {
-        int idx = ctx->index & MD5_BLK_MASK;
-        int sze = MD5_BLK_SIZE-idx;
+    idx = ctx->index & MD5_BLK_MASK;
+    ctx->index += len;
+
+    if (idx > 0) {
+        /* complete the partial block in the context first */
+        size_t sze = MD5_BLK_SIZE-idx;
 
         if (sze > len) {
-            sze = len;
+            memcpy(ctx->buf+idx,b,len);
+            return;
         }
 
-        memcpy(ctx->buf+idx,b+pos,sze);
+        memcpy(ctx->buf+idx,b,sze);
+        md5_update_block( ctx );
+        b += sze;
         len -= sze;
-        pos += sze;
-        ctx->index += sze;
-        
-        if (idx+sze == MD5_BLK_SIZE) {
-            md5_update_block( ctx );
-        }
+    }
+    if (len >= MD5_BLK_SIZE) {
+        /* all full blocks directly from the caller buffer */
+        md5_compress(ctx->H,b,len / MD5_BLK_SIZE);
+        b += len & ~MD5_BLK_MASK;
+        len &= MD5_BLK_MASK;
+    }
+    if (len > 0) {
+        memcpy(ctx->buf,b,len);
     }
 }
 
@@ -215,7 +433,7 @@ static void md5_update( crypto_context *hdr, const void *buf, int len ) {
 static void md5_finish( crypto_context *hdr, uint8_t *out ) {
 	md5_context_t *ctx = (md5_context_t *)hdr;
 	int idx = ctx->index & MD5_BLK_MASK;
-    int64_t flen = ctx->index * 8;
+    uint64_t flen = ctx->index * 8;
     int32_t hlen = flen >> 32;
     int32_t llen = flen;
 
@@ -250,14 +468,62 @@ static void md5_finish( crypto_context *hdr, uint8_t *out ) {
  */
 
 static void md5_free( crypto_context *ctx) {
-	if (ctx) {
+	if (ctx && !(ctx->flags & CFLAG_STATIC_ALLOC)) {
 		free(ctx);
 	}
 }
 
-static void md5_free_dummy( crypto_context *ctx) {
+/**
+ * \brief Copy the MD5 context including the state of the calculation
+ *   so far. The copy is independent of the original.
+ *
+ * \param hdr A pointer to the context to copy.
+ * \param dst A pointer to the storage for the copy, or NULL to allocate
+ *   the copy from the heap.
+ *
+ * \return A pointer to the copy. NULL if the allocation failed.
+ */
+
+static crypto_context *md5_clone( const crypto_context *hdr, crypto_context *dst ) {
+	if (dst == NULL) {
+		if ((dst = malloc(sizeof(md5_context_t))) == NULL) {
+			return NULL;
+		}
+		memcpy(dst,hdr,sizeof(md5_context_t));
+		dst->flags &= ~CFLAG_STATIC_ALLOC;
+	} else {
+		memcpy(dst,hdr,sizeof(md5_context_t));
+		dst->flags |= CFLAG_STATIC_ALLOC;
+	}
+	return dst;
+}
+
+/**
+ * \brief Export and import the MD5 intermediate state as a blob,
+ *   see midstate.h for the format.
+ *
+ */
+
+static int md5_export( const crypto_context *hdr, uint8_t *out, size_t *len ) {
+	const md5_context_t *ctx = (const md5_context_t *)hdr;
+	return midstate_export(hdr,ctx->index,ctx->H,4,4,ctx->buf,out,len);
+}
+
+static int md5_import( crypto_context *hdr, const uint8_t *in, size_t len ) {
+	md5_context_t *ctx = (md5_context_t *)hdr;
+	return midstate_import(hdr,&ctx->index,ctx->H,4,4,ctx->buf,in,len);
 }
 
+static const crypto_ops md5_ops = {
+	md5_reset,
+	md5_update,
+	md5_finish,
+	md5_clone,
+	md5_export,
+	md5_import,
+	md5_free
+};
+
 /**
  * \brief Allocate and initialize the minumum of the MD5 context.
  *   This is supposed to be the only exported function.
@@ -277,7 +543,7 @@ crypto_context *md5_alloc( void ) {
 	}
 
 	md5_init((md5_context_t *)ctx);
-	ctx->free = md5_free;
+	ctx->flags &= ~CFLAG_STATIC_ALLOC;
 	return ctx;
 }
 
@@ -298,10 +564,8 @@ crypto_context *md5_init( md5_context_t *stx ) {
 	ctx->size = MD5_HSH_SIZE << 3;
 	ctx->block_size = MD5_BLK_SIZE;
 	
-	ctx->reset = md5_reset;
-	ctx->update = md5_update;
-	ctx->finish = md5_finish;
-	ctx->free = md5_free_dummy;
+	ctx->flags = CFLAG_STATIC_ALLOC;
+	ctx->ops = &md5_ops;
 	return ctx;
 }
 
@@ -325,9 +589,9 @@ int main( int argc, char** argv )
     crypto_context *ctx = md5_alloc();
     uint8_t hash[MD5_HSH_SIZE];
 	
-	ctx->reset(ctx);
-    ctx->update(ctx,argv[1],strlen(argv[1]));
-	ctx->finish(ctx,hash);
+	crypto_reset(ctx);
+    crypto_update(ctx,argv[1],strlen(argv[1]));
+	crypto_finish(ctx,hash);
 
 
     for (n = 0; n < MD5_HSH_SIZE; n++) {
@@ -335,15 +599,15 @@ int main( int argc, char** argv )
     }
     printf("\n");
 
-	ctx->reset(ctx);
-    ctx->update(ctx,argv[1],strlen(argv[1]));
-	ctx->finish(ctx,hash);
+	crypto_reset(ctx);
+    crypto_update(ctx,argv[1],strlen(argv[1]));
+	crypto_finish(ctx,hash);
     for (n = 0; n < MD5_HSH_SIZE; n++) {
         printf("%02x",hash[n]);
     }
     printf("\n");
 
-	ctx->free(ctx);
+	crypto_free(ctx);
 
     return 0;
 }
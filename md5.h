@@ -12,6 +12,7 @@
 #define _md5_h_included
 
 #include <stdint.h>
+#include <stddef.h>
 #include "algorithm_types.h"
 
 /* */
@@ -24,7 +25,7 @@
 
 typedef struct md5_context_s {
 	crypto_context hdr;
-	int64_t index;      /* number of octets processed so far */
+	uint64_t index;     /* number of octets processed so far */
     uint32_t H[4];
     uint8_t buf[MD5_BLK_SIZE];
 } md5_context_t;
@@ -37,4 +38,13 @@ typedef struct md5_context_s {
 crypto_context *md5_alloc( void );
 crypto_context *md5_init( md5_context_t * );
 
+/* Compress n full blocks straight from a buffer into H[], i.e. no
+ * padding or buffering. */
+
+void md5_compress( uint32_t *, const uint8_t *, size_t );
+
+/* Initial hash values, for use with the compress function */
+
+extern const uint32_t md5_iv[4];
+
 #endif /* _md5_h_included */
@@ -0,0 +1,150 @@
+/**
+ * \file midstate.c
+ * \brief Serialization of the intermediate state of a digest. The
+ *   digests keep their own context layout, these helpers only convert
+ *   between the pieces of the state and the blob, see midstate.h.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <memory.h>
+
+#include "midstate.h"
+#include "crypto_error.h"
+
+/**
+ * \brief Store a big endian integer of n octets.
+ *
+ * \param b A pointer to the output buffer.
+ * \param v The value.
+ * \param n The number of octets.
+ *
+ * \return A pointer to the buffer following the integer.
+ */
+
+static uint8_t *midstate_put( uint8_t *b, uint64_t v, int n ) {
+    while (n-- > 0) {
+        *b++ = v >> (n*8);
+    }
+    return b;
+}
+
+/**
+ * \brief Load a big endian integer of n octets.
+ *
+ * \param b A pointer to the input buffer.
+ * \param n The number of octets.
+ *
+ * \return The value.
+ */
+
+static uint64_t midstate_get( const uint8_t *b, int n ) {
+    uint64_t v = 0;
+
+    while (n-- > 0) {
+        v = v << 8 | *b++;
+    }
+    return v;
+}
+
+/**
+ * \brief Serialize a digest state.
+ *
+ * \param ctx A pointer to the digest context, for the algorithm and
+ *   the block size.
+ * \param index The number of octets processed so far.
+ * \param H A pointer to the intermediate hash value.
+ * \param words The number of words in H.
+ * \param wsize The size of a word in H, 4 or 8.
+ * \param buf A pointer to the partial block.
+ * \param out A pointer to the output buffer.
+ * \param len A pointer to the size of the output buffer. On return
+ *   the size of the blob.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_INVALID_ARGUMENT if the
+ *   output buffer is too small. The required size is returned in len.
+ */
+
+int midstate_export( const crypto_context *ctx, uint64_t index, const void *H, int words,
+                     int wsize, const uint8_t *buf, uint8_t *out, size_t *len ) {
+    size_t part = index & (ctx->block_size - 1);
+    size_t need = MIDSTATE_HDR_SIZE + words * wsize + part;
+    int n;
+
+    if (*len < need) {
+        *len = need;
+        return CRYPTO_ERROR_INVALID_ARGUMENT;
+    }
+
+    *out++ = MIDSTATE_VERSION;
+    out = midstate_put(out,ctx->algorithm,4);
+    out = midstate_put(out,index,8);
+
+    for (n = 0; n < words; n++) {
+        if (wsize == 8) {
+            out = midstate_put(out,((const uint64_t *)H)[n],8);
+        } else {
+            out = midstate_put(out,((const uint32_t *)H)[n],4);
+        }
+    }
+
+    memcpy(out,buf,part);
+    *len = need;
+    return CRYPTO_SUCCESS;
+}
+
+/**
+ * \brief Deserialize a digest state. Nothing is modified unless the
+ *   blob is valid for the digest.
+ *
+ * \param ctx A pointer to the digest context, for the algorithm and
+ *   the block size.
+ * \param index A pointer to the number of octets processed so far.
+ * \param H A pointer to the intermediate hash value.
+ * \param words The number of words in H.
+ * \param wsize The size of a word in H, 4 or 8.
+ * \param buf A pointer to the partial block.
+ * \param in A pointer to the blob.
+ * \param len The size of the blob.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_VALIDATION_FAILED if the
+ *   blob is not a state of this digest.
+ */
+
+int midstate_import( crypto_context *ctx, uint64_t *index, void *H, int words,
+                     int wsize, uint8_t *buf, const uint8_t *in, size_t len ) {
+    uint64_t idx;
+    size_t part;
+    int n;
+
+    if (len < MIDSTATE_HDR_SIZE || in[0] != MIDSTATE_VERSION ||
+        midstate_get(in+1,4) != ctx->algorithm) {
+        return CRYPTO_ERROR_VALIDATION_FAILED;
+    }
+
+    idx = midstate_get(in+5,8);
+    part = idx & (ctx->block_size - 1);
+
+    if (len != MIDSTATE_HDR_SIZE + words * wsize + part) {
+        return CRYPTO_ERROR_VALIDATION_FAILED;
+    }
+
+    in += MIDSTATE_HDR_SIZE;
+
+    for (n = 0; n < words; n++) {
+        if (wsize == 8) {
+            ((uint64_t *)H)[n] = midstate_get(in,8);
+        } else {
+            ((uint32_t *)H)[n] = midstate_get(in,4);
+        }
+        in += wsize;
+    }
+
+    memcpy(buf,in,part);
+    *index = idx;
+    return CRYPTO_SUCCESS;
+}
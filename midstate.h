@@ -0,0 +1,45 @@
+/**
+ * \file midstate.h
+ * \brief Serialization of the intermediate state of a digest, i.e. the
+ *   state after some input has been processed but before finish().
+ *
+ *   The blob format, all integers big endian:
+ *
+ *   - 1 octet version, MIDSTATE_VERSION
+ *   - 4 octets TEE_ALG_* algorithm identifier
+ *   - 8 octets number of octets processed so far (the index)
+ *   - the intermediate hash value H[], 4 octets per word for the
+ *     32-bit digests and 8 octets per word for SHA-384/512
+ *   - index modulo block size octets of the partial block
+ *
+ *   The blob of a given digest and index is always of the same size,
+ *   at most MIDSTATE_MAX_SIZE octets.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#ifndef _midstate_h_included
+#define _midstate_h_included
+
+#include <stdint.h>
+#include <stddef.h>
+#include "algorithm_types.h"
+
+#define MIDSTATE_VERSION    1
+#define MIDSTATE_HDR_SIZE   13
+#define MIDSTATE_MAX_SIZE   (MIDSTATE_HDR_SIZE + 64 + 127)  /**< SHA-512 */
+
+/**
+ * \brief Midstate helpers for the digest implementations. H[] is given
+ *   as words words of wsize (4 or 8) octets.
+ *
+ */
+
+int midstate_export( const crypto_context *, uint64_t, const void *, int, int,
+                     const uint8_t *, uint8_t *, size_t * );
+int midstate_import( crypto_context *, uint64_t *, void *, int, int,
+                     uint8_t *, const uint8_t *, size_t );
+
+#endif /* _midstate_h_included */
@@ -0,0 +1,304 @@
+/**
+ * \file multibuf.c
+ * \brief A lane scheduler for the multi-buffer digest kernels. Every
+ *   lane gets its own message. When a lane finishes its message the
+ *   digest is written out and the next pending message is started in
+ *   the same lane, thus messages of different lengths keep the lanes
+ *   busy. The message padding is built per lane into a small tail
+ *   buffer, the message body is compressed directly from the caller
+ *   buffer.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <memory.h>
+#include <assert.h>
+#include "multibuf.h"
+#include "algorithm_types.h"
+#include "crypto_error.h"
+
+/* per lane bookkeeping */
+
+typedef struct mb_lane_s {
+    mb_job_t *job;          /* NULL if the lane is idle */
+    const uint8_t *p;       /* next body block */
+    size_t blocks;          /* body blocks left */
+    const uint8_t *t;       /* next tail block */
+    int tail;               /* tail blocks left */
+    uint8_t buf[2*MB_BLK_SIZE];
+} mb_lane_t;
+
+/* idle lanes are fed with this */
+
+static const uint8_t mb_zero_block[MB_BLK_SIZE];
+
+/**
+ * \brief Build the padded tail of a message, i.e. the partial last
+ *   block, the 0x80 marker, zeroes and the message length in bits.
+ *
+ * \param a A pointer to the digest description.
+ * \param l A pointer to the lane.
+ * \param j A pointer to the job to set up.
+ *
+ * \return Nothing.
+ */
+
+static void mb_lane_tail( const mb_algo_t *a, mb_lane_t *l, const mb_job_t *j ) {
+    size_t rem = j->len & (MB_BLK_SIZE-1);
+    uint64_t bits = (j->prefix + j->len) << 3;
+    int end, n;
+
+    memcpy(l->buf,j->msg+j->len-rem,rem);
+    l->buf[rem++] = 0x80;
+    end = rem > MB_BLK_SIZE-8 ? 2*MB_BLK_SIZE : MB_BLK_SIZE;
+    memset(l->buf+rem,0,end-rem);
+
+    for (n = 0; n < 8; n++) {
+        if (a->big_endian) {
+            l->buf[end-1-n] = bits >> (n*8);
+        } else {
+            l->buf[end-8+n] = bits >> (n*8);
+        }
+    }
+
+    l->t = l->buf;
+    l->tail = end / MB_BLK_SIZE;
+    l->p = j->msg;
+    l->blocks = j->len / MB_BLK_SIZE;
+    l->job = (mb_job_t *)j;
+}
+
+/**
+ * \brief Write out the digest.
+ *
+ * \param a A pointer to the digest description.
+ * \param H A pointer to the intermediate hash value.
+ * \param s The distance between two consecutive words in H.
+ * \param out A pointer to the output buffer.
+ *
+ * \return Nothing.
+ */
+
+static void mb_output( const mb_algo_t *a, const uint32_t *H, int s, uint8_t *out ) {
+    int n;
+
+    for (n = 0; n < a->out_words; n++) {
+        uint32_t w = H[n*s];
+
+        if (a->big_endian) {
+            *out++ = w >> 24;
+            *out++ = w >> 16;
+            *out++ = w >> 8;
+            *out++ = w;
+        } else {
+            *out++ = w;
+            *out++ = w >> 8;
+            *out++ = w >> 16;
+            *out++ = w >> 24;
+        }
+    }
+}
+
+/**
+ * \brief Finish a lane with the single lane kernel.
+ *
+ * \param a A pointer to the digest description.
+ * \param l A pointer to the lane.
+ * \param H The intermediate hash value of the lane.
+ *
+ * \return Nothing.
+ */
+
+static void mb_lane_finish( const mb_algo_t *a, mb_lane_t *l, uint32_t *H ) {
+    if (l->blocks > 0) {
+        a->single(H,l->p,l->blocks);
+    }
+    if (l->tail > 0) {
+        a->single(H,l->t,l->tail);
+    }
+
+    mb_output(a,H,1,l->job->out);
+    l->job = NULL;
+}
+
+/**
+ * \brief Hash a batch of jobs.
+ *
+ * \param a A pointer to the digest description, see e.g. sha2xx_mb_setup().
+ * \param jobs A pointer to an array of jobs.
+ * \param n The number of jobs.
+ *
+ * \return CRYPTO_SUCCESS.
+ */
+
+int mb_digest_jobs( const mb_algo_t *a, mb_job_t *jobs, int n ) {
+    mb_lane_t lane[MB_MAX_LANES];
+    uint32_t S[MB_MAX_WORDS*MB_MAX_LANES];
+    uint32_t H[MB_MAX_WORDS];
+    const uint8_t *p[MB_MAX_LANES];
+    int next = 0;
+    int active = 0;
+    int i, w;
+
+    assert(a->lanes <= MB_MAX_LANES);
+
+    if (a->lanes < 2) {
+        /* no SIMD available, just do one by one */
+        for (i = 0; i < n; i++) {
+            memcpy(H,jobs[i].iv ? jobs[i].iv : a->iv,a->words*sizeof(uint32_t));
+            mb_lane_tail(a,&lane[0],&jobs[i]);
+            mb_lane_finish(a,&lane[0],H);
+        }
+        return CRYPTO_SUCCESS;
+    }
+    for (i = 0; i < a->lanes; i++) {
+        lane[i].job = NULL;
+
+        if (next < n) {
+            const uint32_t *iv = jobs[next].iv ? jobs[next].iv : a->iv;
+
+            for (w = 0; w < a->words; w++) {
+                S[w*MB_MAX_LANES+i] = iv[w];
+            }
+            mb_lane_tail(a,&lane[i],&jobs[next++]);
+            active++;
+        }
+    }
+    while (active > 0) {
+        if (next == n && active < a->lanes/2) {
+            /* not enough work to fill the lanes anymore */
+            for (i = 0; i < a->lanes; i++) {
+                if (lane[i].job) {
+                    for (w = 0; w < a->words; w++) {
+                        H[w] = S[w*MB_MAX_LANES+i];
+                    }
+                    mb_lane_finish(a,&lane[i],H);
+                }
+            }
+            break;
+        }
+        for (i = 0; i < a->lanes; i++) {
+            if (lane[i].job == NULL) {
+                p[i] = mb_zero_block;
+            } else if (lane[i].blocks > 0) {
+                p[i] = lane[i].p;
+            } else {
+                p[i] = lane[i].t;
+            }
+        }
+
+        a->blocks(S,p);
+
+        for (i = 0; i < a->lanes; i++) {
+            mb_lane_t *l = &lane[i];
+
+            if (l->job == NULL) {
+                continue;
+            }
+            if (l->blocks > 0) {
+                l->blocks--;
+                l->p += MB_BLK_SIZE;
+                continue;
+            }
+            if (--l->tail > 0) {
+                l->t += MB_BLK_SIZE;
+                continue;
+            }
+
+            /* lane done, output and start the next job if any */
+            mb_output(a,&S[i],MB_MAX_LANES,l->job->out);
+            l->job = NULL;
+
+            if (next < n) {
+                const uint32_t *iv = jobs[next].iv ? jobs[next].iv : a->iv;
+
+                for (w = 0; w < a->words; w++) {
+                    S[w*MB_MAX_LANES+i] = iv[w];
+                }
+                mb_lane_tail(a,l,&jobs[next++]);
+            } else {
+                active--;
+            }
+        }
+    }
+
+    return CRYPTO_SUCCESS;
+}
+
+/**
+ * \brief Set up the description of a digest for the lane scheduler.
+ *
+ * \param a A pointer to the description to fill in.
+ * \param alg The digest algorithm identifier, i.e. TEE_ALG_MD5,
+ *   TEE_ALG_SHA1, TEE_ALG_SHA224 or TEE_ALG_SHA256.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_UNSUPPORTED_DIGEST if there
+ *   is no multi-buffer implementation for the algorithm.
+ */
+
+int mb_setup( mb_algo_t *a, uint32_t alg ) {
+    switch (alg) {
+    case TEE_ALG_MD5:
+        return md5_mb_setup(a,alg);
+    case TEE_ALG_SHA1:
+        return sha1_mb_setup(a,alg);
+    case TEE_ALG_SHA224:
+    case TEE_ALG_SHA256:
+        return sha2xx_mb_setup(a,alg);
+    default:
+        return CRYPTO_ERROR_UNSUPPORTED_DIGEST;
+    }
+}
+
+/**
+ * \brief Calculate digests of a batch of independent messages.
+ *
+ * \param alg The digest algorithm identifier, i.e. TEE_ALG_MD5,
+ *   TEE_ALG_SHA1, TEE_ALG_SHA224 or TEE_ALG_SHA256.
+ * \param n The number of messages.
+ * \param msg A pointer to an array of n message pointers.
+ * \param len A pointer to an array of n message lengths.
+ * \param out A pointer to the output buffer of n digests. The digests
+ *   are stored one after the other.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_UNSUPPORTED_DIGEST if there
+ *   is no multi-buffer implementation for the algorithm.
+ */
+
+int crypto_digest_mb( uint32_t alg, int n, const void *const *msg,
+                      const size_t *len, uint8_t *out ) {
+    mb_job_t jobs[256];
+    mb_algo_t a;
+    int i, m, r;
+
+    if ((r = mb_setup(&a,alg)) != CRYPTO_SUCCESS) {
+        return r;
+    }
+
+    /* feed the scheduler in chunks to keep the job array on stack */
+
+    while (n > 0) {
+        m = n > 256 ? 256 : n;
+
+        for (i = 0; i < m; i++) {
+            jobs[i].msg = msg[i];
+            jobs[i].len = len[i];
+            jobs[i].iv = NULL;
+            jobs[i].prefix = 0;
+            jobs[i].out = out;
+            out += a.out_words * sizeof(uint32_t);
+        }
+
+        mb_digest_jobs(&a,jobs,m);
+        msg += m;
+        len += m;
+        n -= m;
+    }
+
+    return CRYPTO_SUCCESS;
+}
@@ -0,0 +1,173 @@
+/**
+ * \file multibuf.h
+ * \brief Multi-buffer hashing of a batch of independent messages.
+ *   Several messages are processed at once in SIMD lanes, each lane
+ *   running the same compression function over a different message.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#ifndef _multibuf_h_included
+#define _multibuf_h_included
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cpu_features.h"
+
+#if defined(CPU_X86_KERNELS)
+#include <immintrin.h>
+#endif
+
+#define MB_MAX_LANES    16  /**< AVX-512 gives 16 32-bit lanes */
+#define MB_MAX_WORDS    8   /**< Max intermediate hash words of the supported digests */
+#define MB_BLK_SIZE     64  /**< All multi-buffer digests use 64 octet blocks */
+
+/**
+ * \brief A description of a digest for the lane scheduler. The lane
+ *   state is kept transposed, i.e. word w of lane l is located at
+ *   S[w*MB_MAX_LANES+l] so that the kernels can load a full vector.
+ */
+
+typedef struct mb_algo_s {
+    uint32_t algorithm;     /**< TEE_ALG_* of the digest */
+    int words;              /**< Number of intermediate hash words */
+    int out_words;          /**< Number of words in the digest output */
+    int big_endian;         /**< Byte order of the length and the output */
+    const uint32_t *iv;     /**< Initial hash value */
+    int lanes;              /**< Lanes of the kernel, 1 if no SIMD kernel */
+
+    /** Single lane compression of n consecutive blocks */
+    void (*single)( uint32_t *, const uint8_t *, size_t );
+    /** Compress one block for every lane, p[l] pointing at the block of lane l */
+    void (*blocks)( uint32_t *, const uint8_t *const * );
+} mb_algo_t;
+
+/**
+ * \brief One message to hash. A job may start from an intermediate hash
+ *   value (e.g. a precomputed HMAC pad) in which case the number of
+ *   octets already hashed into it must be given for the padding.
+ */
+
+typedef struct mb_job_s {
+    const uint8_t *msg;     /**< The message */
+    size_t len;             /**< The length of the message in octets */
+    const uint32_t *iv;     /**< Initial hash value or NULL for the digest IV */
+    uint64_t prefix;        /**< Octets already hashed into iv */
+    uint8_t *out;           /**< Digest output buffer */
+} mb_job_t;
+
+#if defined(CPU_X86_KERNELS)
+
+/**
+ * \brief Load the 16 message words of one block for each of the 8
+ *   lanes into vectors holding one word of every lane. The blocks are
+ *   loaded as rows and transposed 8x8 words at a time.
+ *
+ * \param[out] W A pointer to 16 vectors.
+ * \param[in] p A pointer to 8 block pointers, one per lane.
+ * \param[in] bswap Non-zero if the words are big endian.
+ *
+ * \return Nothing.
+ */
+
+__attribute__((target("avx2")))
+static inline void mb_load_x8( __m256i *W, const uint8_t *const *p, int bswap ) {
+    const __m256i BSWAP = _mm256_set_epi8(12,13,14,15,8,9,10,11,4,5,6,7,0,1,2,3,
+                                          12,13,14,15,8,9,10,11,4,5,6,7,0,1,2,3);
+    __m256i t0, t1, t2, t3, t4, t5, t6, t7;
+    __m256i u0, u1, u2, u3, u4, u5, u6, u7;
+    int i;
+
+    for (i = 0; i < 16; i += 8) {
+        __m256i *r = &W[i];
+        int j;
+
+        for (j = 0; j < 8; j++) {
+            r[j] = _mm256_loadu_si256((const __m256i *)(p[j]+i*4));
+        }
+
+        t0 = _mm256_unpacklo_epi32(r[0],r[1]);
+        t1 = _mm256_unpackhi_epi32(r[0],r[1]);
+        t2 = _mm256_unpacklo_epi32(r[2],r[3]);
+        t3 = _mm256_unpackhi_epi32(r[2],r[3]);
+        t4 = _mm256_unpacklo_epi32(r[4],r[5]);
+        t5 = _mm256_unpackhi_epi32(r[4],r[5]);
+        t6 = _mm256_unpacklo_epi32(r[6],r[7]);
+        t7 = _mm256_unpackhi_epi32(r[6],r[7]);
+        u0 = _mm256_unpacklo_epi64(t0,t2);
+        u1 = _mm256_unpackhi_epi64(t0,t2);
+        u2 = _mm256_unpacklo_epi64(t1,t3);
+        u3 = _mm256_unpackhi_epi64(t1,t3);
+        u4 = _mm256_unpacklo_epi64(t4,t6);
+        u5 = _mm256_unpackhi_epi64(t4,t6);
+        u6 = _mm256_unpacklo_epi64(t5,t7);
+        u7 = _mm256_unpackhi_epi64(t5,t7);
+        r[0] = _mm256_permute2x128_si256(u0,u4,0x20);
+        r[1] = _mm256_permute2x128_si256(u1,u5,0x20);
+        r[2] = _mm256_permute2x128_si256(u2,u6,0x20);
+        r[3] = _mm256_permute2x128_si256(u3,u7,0x20);
+        r[4] = _mm256_permute2x128_si256(u0,u4,0x31);
+        r[5] = _mm256_permute2x128_si256(u1,u5,0x31);
+        r[6] = _mm256_permute2x128_si256(u2,u6,0x31);
+        r[7] = _mm256_permute2x128_si256(u3,u7,0x31);
+    }
+    if (bswap) {
+        for (i = 0; i < 16; i++) {
+            W[i] = _mm256_shuffle_epi8(W[i],BSWAP);
+        }
+    }
+}
+
+/**
+ * \brief Load the 16 message words of one block for each of the 16
+ *   lanes into vectors holding one word of every lane. The words are
+ *   gathered directly through the 16 block pointers.
+ *
+ * \param[out] W A pointer to 16 vectors.
+ * \param[in] p A pointer to 16 block pointers, one per lane.
+ * \param[in] bswap Non-zero if the words are big endian.
+ *
+ * \return Nothing.
+ */
+
+__attribute__((target("avx512f,avx512bw")))
+static inline void mb_load_x16( __m512i *W, const uint8_t *const *p, int bswap ) {
+    const __m512i BSWAP = _mm512_set4_epi32(0x0c0d0e0f,0x08090a0b,0x04050607,0x00010203);
+    const __m512i FOUR = _mm512_set1_epi64(4);
+    __m512i lo = _mm512_loadu_si512((const void *)&p[0]);
+    __m512i hi = _mm512_loadu_si512((const void *)&p[8]);
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        __m256i l = _mm512_i64gather_epi32(lo,NULL,1);
+        __m256i h = _mm512_i64gather_epi32(hi,NULL,1);
+
+        W[i] = _mm512_inserti64x4(_mm512_castsi256_si512(l),h,1);
+
+        if (bswap) {
+            W[i] = _mm512_shuffle_epi8(W[i],BSWAP);
+        }
+
+        lo = _mm512_add_epi64(lo,FOUR);
+        hi = _mm512_add_epi64(hi,FOUR);
+    }
+}
+
+#endif
+
+/**
+ * \brief Multi-buffer function prototypes.
+ *
+ */
+
+int mb_setup( mb_algo_t *, uint32_t );
+int mb_digest_jobs( const mb_algo_t *, mb_job_t *, int );
+int crypto_digest_mb( uint32_t, int, const void *const *, const size_t *, uint8_t * );
+
+int sha2xx_mb_setup( mb_algo_t *, uint32_t );
+int sha1_mb_setup( mb_algo_t *, uint32_t );
+int md5_mb_setup( mb_algo_t *, uint32_t );
+
+#endif /* _multibuf_h_included */
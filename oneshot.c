@@ -0,0 +1,328 @@
+/**
+ * \file oneshot.c
+ * \brief One-shot digest and HMAC functions. The intermediate hash value
+ *   and the padding block are kept on stack, full blocks are compressed
+ *   directly from the input and only the tail is copied. An input that
+ *   fits into one block together with the padding, i.e. up to 55 octets
+ *   for the 64 octet block digests, costs a single compression.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <memory.h>
+
+#include "oneshot.h"
+#include "algorithm_types.h"
+#include "crypto_error.h"
+#include "md5.h"
+#include "sha1.h"
+#include "sha256.h"
+#include "sha512.h"
+
+#define ONESHOT_MAX_BLK     SHA512_BLK_SIZE
+#define ONESHOT_MAX_HSH     SHA512_HSH_SIZE
+
+/* The raw description of a digest */
+
+typedef struct oneshot_algo_s {
+    uint32_t algorithm;
+    int hsh_size;
+    int blk_size;
+    int words;              /* of the intermediate hash value */
+    int little_endian;      /* MD5 */
+    const uint32_t *iv32;   /* either of these */
+    const uint64_t *iv64;
+    void (*compress32)( uint32_t *, const uint8_t *, size_t );
+} oneshot_algo_t;
+
+static const oneshot_algo_t oneshot_algos[] = {
+    { TEE_ALG_MD5, MD5_HSH_SIZE, MD5_BLK_SIZE, 4, 1, md5_iv, NULL, md5_compress },
+    { TEE_ALG_SHA1, SHA1_HSH_SIZE, SHA1_BLK_SIZE, 5, 0, sha1_iv, NULL, sha1_compress },
+    { TEE_ALG_SHA224, SHA224_HSH_SIZE, SHA224_BLK_SIZE, 8, 0, sha224_iv, NULL, sha256_compress },
+    { TEE_ALG_SHA256, SHA256_HSH_SIZE, SHA256_BLK_SIZE, 8, 0, sha256_iv, NULL, sha256_compress },
+    { TEE_ALG_SHA384, SHA384_HSH_SIZE, SHA384_BLK_SIZE, 8, 0, NULL, sha384_iv, NULL },
+    { TEE_ALG_SHA512, SHA512_HSH_SIZE, SHA512_BLK_SIZE, 8, 0, NULL, sha512_iv, NULL },
+};
+
+/* The intermediate hash value of any of the digests */
+
+typedef union oneshot_state_u {
+    uint32_t w32[8];
+    uint64_t w64[8];
+} oneshot_state_t;
+
+/**
+ * \brief Find the raw description of a digest.
+ *
+ * \param alg The digest algorithm identifier.
+ *
+ * \return A pointer to the description, NULL if the algorithm is unknown.
+ */
+
+static const oneshot_algo_t *oneshot_find( uint32_t alg ) {
+    int n;
+
+    for (n = 0; n < sizeof(oneshot_algos)/sizeof(oneshot_algos[0]); n++) {
+        if (oneshot_algos[n].algorithm == alg) {
+            return &oneshot_algos[n];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief Set the intermediate hash value to the initial value.
+ *
+ * \return Nothing.
+ */
+
+static void oneshot_iv( const oneshot_algo_t *a, oneshot_state_t *H ) {
+    if (a->iv64) {
+        memcpy(H->w64,a->iv64,sizeof(H->w64));
+    } else {
+        memcpy(H->w32,a->iv32,a->words*sizeof(uint32_t));
+    }
+}
+
+/**
+ * \brief Compress n full blocks.
+ *
+ * \return Nothing.
+ */
+
+static inline void oneshot_compress( const oneshot_algo_t *a, oneshot_state_t *H,
+                                     const uint8_t *p, size_t n ) {
+    if (a->iv64) {
+        sha512_compress(H->w64,p,n);
+    } else {
+        a->compress32(H->w32,p,n);
+    }
+}
+
+/**
+ * \brief Hash the concatenation of two inputs, pad and output the
+ *   digest. The head is typically short, e.g. a name space or a
+ *   protocol header. Full blocks of both inputs are compressed in
+ *   place, only the octets straddling a block boundary are copied.
+ *
+ * \param a A pointer to the digest description.
+ * \param H A pointer to the intermediate hash value to start from.
+ * \param prefix The number of octets already hashed into H.
+ * \param h A pointer to the head.
+ * \param hl The length of the head.
+ * \param m A pointer to the body.
+ * \param ml The length of the body.
+ * \param out A pointer to the digest output buffer.
+ *
+ * \return Nothing.
+ */
+
+static void oneshot_run( const oneshot_algo_t *a, oneshot_state_t *H, uint64_t prefix,
+                         const uint8_t *h, size_t hl, const uint8_t *m, size_t ml,
+                         uint8_t *out ) {
+    uint8_t b[2*ONESHOT_MAX_BLK];
+    uint64_t total = prefix + hl + ml;
+    uint64_t bits;
+    size_t blk = a->blk_size;
+    size_t n, t, end;
+    int lsize = blk / 8;    /* 8 or 16 octets of length */
+    int hsh = a->hsh_size;
+    int le = a->little_endian;
+    int i, k;
+
+    /* full blocks of the head, then join the head tail and the body */
+    if (hl >= blk) {
+        oneshot_compress(a,H,h,hl / blk);
+        h += hl & ~(blk-1);
+        hl &= blk-1;
+    }
+
+    if (hl > 0) {
+        memcpy(b,h,hl);
+    }
+
+    n = hl;
+
+    if (n > 0 && ml > 0) {
+        t = blk - n < ml ? blk - n : ml;
+        memcpy(b+n,m,t);
+        n += t;
+        m += t;
+        ml -= t;
+
+        if (n == blk) {
+            oneshot_compress(a,H,b,1);
+            n = 0;
+        }
+    }
+    if (ml >= blk) {
+        oneshot_compress(a,H,m,ml / blk);
+        m += ml & ~(blk-1);
+        ml &= blk-1;
+    }
+    if (ml > 0) {
+        memcpy(b+n,m,ml);
+        n += ml;
+    }
+
+    /* padding */
+    b[n++] = 0x80;
+    end = n > blk - lsize ? 2*blk : blk;
+    memset(b+n,0,end-n);
+    bits = total << 3;
+
+    if (le) {
+        for (i = 0; i < 8; i++) {
+            b[end-8+i] = bits >> (i*8);
+        }
+    } else {
+        for (i = 0; i < 8; i++) {
+            b[end-1-i] = bits >> (i*8);
+        }
+        if (lsize == 16) {
+            b[end-9] = total >> 61;
+        }
+    }
+
+    oneshot_compress(a,H,b,end / blk);
+
+    /* output, whole words except for the last word of SHA-224 */
+    if (a->iv64) {
+        for (i = 0; i < hsh; i += 8) {
+            uint64_t w = H->w64[i >> 3];
+
+            for (k = 0; k < 8; k++) {
+                out[i+k] = w >> (56 - k*8);
+            }
+        }
+    } else {
+        for (i = 0; i < hsh; i += 4) {
+            uint32_t w = H->w32[i >> 2];
+
+            if (le) {
+                out[i+0] = w;
+                out[i+1] = w >> 8;
+                out[i+2] = w >> 16;
+                out[i+3] = w >> 24;
+            } else {
+                out[i+0] = w >> 24;
+                out[i+1] = w >> 16;
+                out[i+2] = w >> 8;
+                out[i+3] = w;
+            }
+        }
+    }
+}
+
+/**
+ * \brief Calculate a digest of a buffer.
+ *
+ * \param alg The digest algorithm identifier, TEE_ALG_MD5 or TEE_ALG_SHA*.
+ * \param buf A pointer to the input.
+ * \param len The length of the input.
+ * \param out A pointer to the digest output buffer.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_UNSUPPORTED_DIGEST if the
+ *   algorithm is unknown.
+ */
+
+int crypto_digest( uint32_t alg, const void *buf, size_t len, uint8_t *out ) {
+    return crypto_digest2(alg,NULL,0,buf,len,out);
+}
+
+/**
+ * \brief Calculate a digest of the concatenation of two buffers, e.g.
+ *   a name space and a name, without copying them together.
+ *
+ * \param alg The digest algorithm identifier, TEE_ALG_MD5 or TEE_ALG_SHA*.
+ * \param head A pointer to the first input.
+ * \param hlen The length of the first input.
+ * \param buf A pointer to the second input.
+ * \param len The length of the second input.
+ * \param out A pointer to the digest output buffer.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_UNSUPPORTED_DIGEST if the
+ *   algorithm is unknown.
+ */
+
+int crypto_digest2( uint32_t alg, const void *head, size_t hlen,
+                    const void *buf, size_t len, uint8_t *out ) {
+    const oneshot_algo_t *a;
+    oneshot_state_t H;
+
+    if ((a = oneshot_find(alg)) == NULL) {
+        return CRYPTO_ERROR_UNSUPPORTED_DIGEST;
+    }
+
+    oneshot_iv(a,&H);
+    oneshot_run(a,&H,0,head,hlen,buf,len,out);
+    return CRYPTO_SUCCESS;
+}
+
+/**
+ * \brief Calculate an HMAC of a buffer.
+ *
+ * \param alg The HMAC algorithm identifier, TEE_ALG_HMAC_*.
+ * \param key A pointer to the key.
+ * \param klen The length of the key.
+ * \param buf A pointer to the input.
+ * \param len The length of the input.
+ * \param out A pointer to the output buffer of the digest size.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_UNSUPPORTED_DIGEST if the
+ *   algorithm is unknown.
+ */
+
+int crypto_hmac( uint32_t alg, const void *key, size_t klen,
+                 const void *buf, size_t len, uint8_t *out ) {
+    uint8_t pad[ONESHOT_MAX_BLK];
+    uint8_t ihsh[ONESHOT_MAX_HSH];
+    const oneshot_algo_t *a;
+    oneshot_state_t H;
+    int n;
+
+    if ((alg & 0xf0000000) != (TEE_ALG_HMAC_MD5 & 0xf0000000) ||
+        (a = oneshot_find(alg - TEE_ALG_HMAC_MD5 + TEE_ALG_MD5)) == NULL) {
+        return CRYPTO_ERROR_UNSUPPORTED_DIGEST;
+    }
+
+    /* a key longer than the block is replaced by its digest */
+    if (klen > a->blk_size) {
+        oneshot_iv(a,&H);
+        oneshot_run(a,&H,0,NULL,0,key,klen,pad);
+        klen = a->hsh_size;
+    } else if (klen > 0) {
+        memcpy(pad,key,klen);
+    }
+
+    memset(pad+klen,0,a->blk_size-klen);
+
+    /* inner */
+    for (n = 0; n < a->blk_size; n++) {
+        pad[n] ^= 0x36;
+    }
+
+    oneshot_iv(a,&H);
+    oneshot_compress(a,&H,pad,1);
+    oneshot_run(a,&H,a->blk_size,NULL,0,buf,len,ihsh);
+
+    /* outer */
+    for (n = 0; n < a->blk_size; n++) {
+        pad[n] ^= 0x36 ^ 0x5c;
+    }
+
+    oneshot_iv(a,&H);
+    oneshot_compress(a,&H,pad,1);
+    oneshot_run(a,&H,a->blk_size,NULL,0,ihsh,a->hsh_size,out);
+
+    /* clear temporary things */
+    memset(pad,0,a->blk_size);
+    memset(ihsh,0,sizeof(ihsh));
+    memset(&H,0,sizeof(H));
+    return CRYPTO_SUCCESS;
+}
@@ -0,0 +1,27 @@
+/**
+ * \file oneshot.h
+ * \brief One-shot digest and HMAC functions. The state lives on the
+ *   stack of the call and the compression kernels are called directly,
+ *   there is no context to initialize and no operations table.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#ifndef _oneshot_h_included
+#define _oneshot_h_included
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * \brief One-shot function prototypes.
+ *
+ */
+
+int crypto_digest( uint32_t, const void *, size_t, uint8_t * );
+int crypto_digest2( uint32_t, const void *, size_t, const void *, size_t, uint8_t * );
+int crypto_hmac( uint32_t, const void *, size_t, const void *, size_t, uint8_t * );
+
+#endif /* _oneshot_h_included */
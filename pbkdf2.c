@@ -0,0 +1,417 @@
+/**
+ * \file pbkdf2.c
+ * \brief PBKDF2 key derivation over the HMAC implementation. The
+ *   password is hashed into the ipad and opad midstates once. After
+ *   the first iteration every HMAC of an output block is over exactly
+ *   one digest, thus both the inner and the outer hash are a single
+ *   padded block. The blocks are built once with their padding and
+ *   the iterations just store the previous digest into them and call
+ *   the compression function, with no context, buffering or padding
+ *   logic in the loop.
+ *
+ *   Output blocks are independent and are handed out to a pool of
+ *   threads when the derived key spans several of them.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <memory.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pbkdf2.h"
+#include "hmac.h"
+#include "md5.h"
+#include "sha1.h"
+#include "sha256.h"
+#include "sha512.h"
+#include "crypto_error.h"
+
+/* the derivation shared by the threads */
+
+typedef struct pbkdf2_s {
+    hmac_context htx;       /* keyed with the password */
+    const uint8_t *salt;
+    size_t slen;
+    uint32_t iter;
+    uint8_t *dk;
+    size_t dklen;
+    int hsz;                /* digest size */
+    uint64_t blocks;        /* number of output blocks */
+    uint64_t next;          /* next output block to derive, does not wrap */
+    pthread_mutex_t lock;
+} pbkdf2_t;
+
+/**
+ * \brief Store words into octets.
+ *
+ * \param b A pointer to the output.
+ * \param w A pointer to the words.
+ * \param n The number of words.
+ * \param le Non-zero for little endian words (MD5).
+ *
+ * \return Nothing.
+ */
+
+static inline void pbkdf2_put32( uint8_t *b, const uint32_t *w, int n, int le ) {
+    int i;
+
+    for (i = 0; i < n; i++, b += 4) {
+        if (le) {
+            b[0] = w[i];
+            b[1] = w[i] >> 8;
+            b[2] = w[i] >> 16;
+            b[3] = w[i] >> 24;
+        } else {
+            b[0] = w[i] >> 24;
+            b[1] = w[i] >> 16;
+            b[2] = w[i] >> 8;
+            b[3] = w[i];
+        }
+    }
+}
+
+static inline void pbkdf2_put64( uint8_t *b, const uint64_t *w, int n ) {
+    int i, k;
+
+    for (i = 0; i < n; i++, b += 8) {
+        for (k = 0; k < 8; k++) {
+            b[k] = w[i] >> (56 - k*8);
+        }
+    }
+}
+
+/**
+ * \brief Build the padding of a block holding one digest after a
+ *   prefix of one block, i.e. the ipad or the opad block.
+ *
+ * \param b A pointer to the block.
+ * \param blk The block size.
+ * \param hsz The digest size.
+ * \param le Non-zero for a little endian length (MD5).
+ *
+ * \return Nothing.
+ */
+
+static void pbkdf2_pad( uint8_t *b, int blk, int hsz, int le ) {
+    uint64_t bits = (uint64_t)(blk + hsz) << 3;
+    int n;
+
+    memset(b+hsz,0,blk-hsz);
+    b[hsz] = 0x80;
+
+    for (n = 0; n < 8; n++) {
+        if (le) {
+            b[blk-8+n] = bits >> (n*8);
+        } else {
+            b[blk-1-n] = bits >> (n*8);
+        }
+    }
+}
+
+/**
+ * \brief Run the iterations 2..c of an output block for the digests
+ *   with 32-bit words.
+ *
+ * \param p A pointer to the derivation.
+ * \param U A pointer to U_1 on input. Cleared on return.
+ * \param T A pointer to U_1 on input and the output block on return.
+ *
+ * \return Nothing.
+ */
+
+static void pbkdf2_iterate32( const pbkdf2_t *p, uint8_t *U, uint8_t *T ) {
+    void (*compress)( uint32_t *, const uint8_t *, size_t );
+    const uint32_t *is, *os;
+    uint8_t ib[64], ob[64];
+    uint32_t H[8], t[8];
+    int hw = p->hsz / 4;
+    int words, le = 0;
+    uint32_t j;
+    int k;
+
+    switch (p->htx.hash.md5.hdr.algorithm) {
+        case TEE_ALG_MD5:
+            compress = md5_compress;
+            is = hmac_istate(&p->htx)->H.w32;
+            os = hmac_ostate(&p->htx)->H.w32;
+            words = 4;
+            le = 1;
+            break;
+        case TEE_ALG_SHA1:
+            compress = sha1_compress;
+            is = hmac_istate(&p->htx)->H.w32;
+            os = hmac_ostate(&p->htx)->H.w32;
+            words = 5;
+            break;
+        default:
+            compress = sha256_compress;
+            is = hmac_istate(&p->htx)->H.w32;
+            os = hmac_ostate(&p->htx)->H.w32;
+            words = 8;
+            break;
+    }
+
+    pbkdf2_pad(ib,64,p->hsz,le);
+    pbkdf2_pad(ob,64,p->hsz,le);
+    memcpy(ib,U,p->hsz);
+    memset(t,0,sizeof(t));
+
+    for (j = 1; j < p->iter; j++) {
+        memcpy(H,is,words*sizeof(uint32_t));
+        compress(H,ib,1);
+        pbkdf2_put32(ob,H,hw,le);
+
+        memcpy(H,os,words*sizeof(uint32_t));
+        compress(H,ob,1);
+        pbkdf2_put32(ib,H,hw,le);
+
+        for (k = 0; k < hw; k++) {
+            t[k] ^= H[k];
+        }
+    }
+
+    /* T = U_1 ^ U_2 ^ .. ^ U_c */
+    pbkdf2_put32(U,t,hw,le);
+
+    for (k = 0; k < p->hsz; k++) {
+        T[k] ^= U[k];
+    }
+
+    memset(ib,0,sizeof(ib));
+    memset(ob,0,sizeof(ob));
+    memset(H,0,sizeof(H));
+    memset(t,0,sizeof(t));
+    memset(U,0,p->hsz);
+}
+
+/**
+ * \brief Run the iterations 2..c of an output block for SHA-384/512,
+ *   see pbkdf2_iterate32().
+ *
+ * \return Nothing.
+ */
+
+static void pbkdf2_iterate64( const pbkdf2_t *p, uint8_t *U, uint8_t *T ) {
+    const uint64_t *is = hmac_istate(&p->htx)->H.w64;
+    const uint64_t *os = hmac_ostate(&p->htx)->H.w64;
+    uint8_t ib[128], ob[128];
+    uint64_t H[8], t[8];
+    int hw = p->hsz / 8;
+    uint32_t j;
+    int k;
+
+    /* the 128-bit length, the upper half is zero */
+    pbkdf2_pad(ib,128,p->hsz,0);
+    pbkdf2_pad(ob,128,p->hsz,0);
+    memcpy(ib,U,p->hsz);
+    memset(t,0,sizeof(t));
+
+    for (j = 1; j < p->iter; j++) {
+        memcpy(H,is,sizeof(H));
+        sha512_compress(H,ib,1);
+        pbkdf2_put64(ob,H,hw);
+
+        memcpy(H,os,sizeof(H));
+        sha512_compress(H,ob,1);
+        pbkdf2_put64(ib,H,hw);
+
+        for (k = 0; k < hw; k++) {
+            t[k] ^= H[k];
+        }
+    }
+
+    pbkdf2_put64(U,t,hw);
+
+    for (k = 0; k < p->hsz; k++) {
+        T[k] ^= U[k];
+    }
+
+    memset(ib,0,sizeof(ib));
+    memset(ob,0,sizeof(ob));
+    memset(H,0,sizeof(H));
+    memset(t,0,sizeof(t));
+    memset(U,0,p->hsz);
+}
+
+/**
+ * \brief Derive one output block T_i.
+ *
+ * \param p A pointer to the derivation.
+ * \param i The block index, starting from 1.
+ *
+ * \return Nothing.
+ */
+
+static void pbkdf2_block( pbkdf2_t *p, uint32_t i ) {
+    uint8_t U[SHA512_HSH_SIZE];
+    uint8_t T[SHA512_HSH_SIZE];
+    uint8_t be[4];
+    hmac_context h;
+    crypto_context *ctx;
+    size_t off = (size_t)(i - 1) * p->hsz;
+
+    /* U_1 = PRF(P, S || INT(i)) */
+    be[0] = i >> 24;
+    be[1] = i >> 16;
+    be[2] = i >> 8;
+    be[3] = i;
+
+    ctx = crypto_clone((crypto_context *)&p->htx,(crypto_context *)&h);
+    crypto_reset(ctx,CTAG_DONE);
+    crypto_update(ctx,p->salt,p->slen);
+    crypto_update(ctx,be,4);
+    crypto_finish(ctx,U);
+    memcpy(T,U,p->hsz);
+
+    if (p->hsz > SHA256_HSH_SIZE) {
+        pbkdf2_iterate64(p,U,T);
+    } else {
+        pbkdf2_iterate32(p,U,T);
+    }
+
+    memcpy(p->dk+off,T,p->dklen - off < p->hsz ? p->dklen - off : p->hsz);
+
+    memset(&h,0,sizeof(h));
+    memset(T,0,sizeof(T));
+}
+
+/**
+ * \brief A worker thread. Derives output blocks until there are none
+ *   left.
+ *
+ * \param arg A pointer to the pbkdf2_t.
+ *
+ * \return NULL.
+ */
+
+static void *pbkdf2_worker( void *arg ) {
+    pbkdf2_t *p = (pbkdf2_t *)arg;
+    uint64_t i;
+
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        i = p->next++;
+        pthread_mutex_unlock(&p->lock);
+
+        if (i > p->blocks) {
+            break;
+        }
+
+        pbkdf2_block(p,i);
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief Derive a key with PBKDF2.
+ *
+ * \param alg The HMAC algorithm identifier of the PRF, TEE_ALG_HMAC_*,
+ *   typically TEE_ALG_HMAC_SHA1, TEE_ALG_HMAC_SHA256 or
+ *   TEE_ALG_HMAC_SHA512.
+ * \param pw A pointer to the password.
+ * \param pwlen The length of the password.
+ * \param salt A pointer to the salt.
+ * \param slen The length of the salt.
+ * \param iter The iteration count, at least 1.
+ * \param dk A pointer to the derived key output buffer.
+ * \param dklen The length of the derived key.
+ * \param threads The maximum number of threads, 0 for one per CPU. No
+ *   more threads than output blocks or PBKDF2_MAX_THREADS are used.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_UNSUPPORTED_DIGEST if the
+ *   algorithm is unknown, CRYPTO_ERROR_INVALID_ARGUMENT on a zero
+ *   iteration count, a password longer than INT_MAX or a derived key
+ *   length of zero or over (2^32-1) digests, otherwise the error of
+ *   keying the HMAC.
+ */
+
+int crypto_pbkdf2( uint32_t alg, const void *pw, size_t pwlen, const void *salt, size_t slen,
+                   uint32_t iter, uint8_t *dk, size_t dklen, int threads ) {
+    pthread_t tid[PBKDF2_MAX_THREADS];
+    pbkdf2_t p;
+    crypto_context *ctx;
+    int n, r, t = 0;
+
+    if ((ctx = hmac_init(&p.htx,alg)) == NULL) {
+        return CRYPTO_ERROR_UNSUPPORTED_DIGEST;
+    }
+
+    p.hsz = ctx->size >> 3;
+
+    /* dkLen is at most (2^32-1) * hLen, RFC 8018 section 5.2 */
+    if (iter == 0 || dklen == 0 || (dklen - 1) / p.hsz >= 0xffffffffUL || pwlen > INT_MAX) {
+        return CRYPTO_ERROR_INVALID_ARGUMENT;
+    }
+    if ((r = crypto_reset(ctx,CTAG_KEY,pw,CTAG_KEY_LEN,(int)pwlen,CTAG_DONE)) != CRYPTO_SUCCESS) {
+        memset(&p.htx,0,sizeof(p.htx));
+        return r;
+    }
+
+    p.salt = salt;
+    p.slen = slen;
+    p.iter = iter;
+    p.dk = dk;
+    p.dklen = dklen;
+    p.blocks = (dklen - 1) / p.hsz + 1;
+    p.next = 1;
+
+    if (threads <= 0) {
+        long c = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = c > 0 ? c : 1;
+    }
+    if (threads > PBKDF2_MAX_THREADS) {
+        threads = PBKDF2_MAX_THREADS;
+    }
+    if (threads > p.blocks) {
+        threads = p.blocks;
+    }
+
+    pthread_mutex_init(&p.lock,NULL);
+
+    for (n = 1; n < threads; n++) {
+        if (pthread_create(&tid[t],NULL,pbkdf2_worker,&p) == 0) {
+            t++;
+        }
+    }
+
+    pbkdf2_worker(&p);
+
+    for (n = 0; n < t; n++) {
+        pthread_join(tid[n],NULL);
+    }
+
+    pthread_mutex_destroy(&p.lock);
+
+    /* clear temporary things */
+    memset(&p.htx,0,sizeof(p.htx));
+    return CRYPTO_SUCCESS;
+}
+
+
+
+#if !defined(PARTOFLIBRARY)
+int main( int argc, char** argv )
+{
+    /* RFC 6070: P = "password", S = "salt", c = 4096, dkLen = 20
+     * 4b007901b765489abead49d926f721d065a429c1 */
+    uint8_t dk[20];
+    int n;
+
+    crypto_pbkdf2(TEE_ALG_HMAC_SHA1,"password",8,"salt",4,4096,dk,sizeof(dk),0);
+
+    for (n = 0; n < sizeof(dk); n++) {
+        printf("%02x",dk[n]);
+    }
+    printf("\n");
+
+    return 0;
+}
+#endif
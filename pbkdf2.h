@@ -0,0 +1,28 @@
+/**
+ * \file pbkdf2.h
+ * \brief PBKDF2 key derivation (RFC 8018) with HMAC as the pseudo
+ *   random function.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#ifndef _pbkdf2_h_included
+#define _pbkdf2_h_included
+
+#include <stdint.h>
+#include <stddef.h>
+#include "algorithm_types.h"
+
+#define PBKDF2_MAX_THREADS  64          /**< Upper bound of the number of threads */
+
+/**
+ * \brief PBKDF2 function prototypes.
+ *
+ */
+
+int crypto_pbkdf2( uint32_t, const void *, size_t, const void *, size_t, uint32_t,
+                   uint8_t *, size_t, int );
+
+#endif /* _pbkdf2_h_included */
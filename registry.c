@@ -0,0 +1,231 @@
+/**
+ * \file registry.c
+ * \brief A registry of the implemented algorithms keyed by the TEE_ALG_*
+ *   identifiers. The digests select their kernels from the CPU features
+ *   on the first use. crypto_registry_init() makes all of them select
+ *   up front, which keeps the selection out of the first hashes and
+ *   lets a benchmark force kernels with the CPU_KERNEL_ENV variable.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <stdatomic.h>
+
+#include "registry.h"
+#include "hmac.h"
+#include "md5.h"
+#include "sha1.h"
+#include "sha256.h"
+#include "sha512.h"
+#include "cpu_features.h"
+
+/* Kernel selection is done by compressing no blocks at all */
+
+static void sha1_select( void ) {
+    uint32_t H[5] = {0};
+    sha1_compress(H,NULL,0);
+}
+
+static void sha256_select( void ) {
+    uint32_t H[8] = {0};
+    sha256_compress(H,NULL,0);
+}
+
+static void sha512_select( void ) {
+    uint64_t H[8] = {0};
+    sha512_compress(H,NULL,0);
+}
+
+/* The init functions take their own context types, these take any
+ * memory of the context size */
+
+#define INIT_ANY(x,t) \
+    static crypto_context *x##_init_any( void *m ) { return x##_init((t *)m); }
+
+INIT_ANY(md5,md5_context_t)
+INIT_ANY(sha1,sha1_context_t)
+INIT_ANY(sha224,sha224_context_t)
+INIT_ANY(sha256,sha256_context_t)
+INIT_ANY(sha384,sha384_context_t)
+INIT_ANY(sha512,sha512_context_t)
+
+#define ALGO(a,n,t,h,b,al,in,sel) \
+    { a, n, sizeof(t), h, b, al, in##_any, sel }
+
+static const crypto_algo_t crypto_algos[] = {
+    ALGO(TEE_ALG_MD5,"MD5",md5_context_t,MD5_HSH_SIZE,MD5_BLK_SIZE,
+         md5_alloc,md5_init,NULL),
+    ALGO(TEE_ALG_SHA1,"SHA1",sha1_context_t,SHA1_HSH_SIZE,SHA1_BLK_SIZE,
+         sha1_alloc,sha1_init,sha1_select),
+    ALGO(TEE_ALG_SHA224,"SHA224",sha224_context_t,SHA224_HSH_SIZE,SHA224_BLK_SIZE,
+         sha224_alloc,sha224_init,sha256_select),
+    ALGO(TEE_ALG_SHA256,"SHA256",sha256_context_t,SHA256_HSH_SIZE,SHA256_BLK_SIZE,
+         sha256_alloc,sha256_init,sha256_select),
+    ALGO(TEE_ALG_SHA384,"SHA384",sha384_context_t,SHA384_HSH_SIZE,SHA384_BLK_SIZE,
+         sha384_alloc,sha384_init,sha512_select),
+    ALGO(TEE_ALG_SHA512,"SHA512",sha512_context_t,SHA512_HSH_SIZE,SHA512_BLK_SIZE,
+         sha512_alloc,sha512_init,sha512_select),
+};
+
+#define NUM_ALGOS (sizeof(crypto_algos)/sizeof(crypto_algos[0]))
+
+static _Atomic int registry_ready;
+
+/**
+ * \brief Probe the CPU and select the kernels of every digest. Calling
+ *   this is optional, it is done on the first crypto_alloc() or
+ *   crypto_init() anyway. Like the CPU probing the selection is
+ *   idempotent.
+ *
+ * \return Nothing.
+ */
+
+void crypto_registry_init( void ) {
+    int n;
+
+    if (atomic_load_explicit(&registry_ready,memory_order_acquire)) {
+        return;
+    }
+
+    cpu_features();
+
+    for (n = 0; n < NUM_ALGOS; n++) {
+        if (crypto_algos[n].select) {
+            crypto_algos[n].select();
+        }
+    }
+
+    atomic_store_explicit(&registry_ready,1,memory_order_release);
+}
+
+/**
+ * \brief Find the registry entry of a digest.
+ *
+ * \param alg The digest algorithm identifier.
+ *
+ * \return A pointer to the entry, NULL if the algorithm is unknown.
+ */
+
+const crypto_algo_t *crypto_find( uint32_t alg ) {
+    int n;
+
+    for (n = 0; n < NUM_ALGOS; n++) {
+        if (crypto_algos[n].algorithm == alg) {
+            return &crypto_algos[n];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief Find the registry entry of a digest by name, e.g. "SHA256".
+ *   The comparison is case insensitive.
+ *
+ * \param name The name of the digest.
+ *
+ * \return A pointer to the entry, NULL if the algorithm is unknown.
+ */
+
+const crypto_algo_t *crypto_find_name( const char *name ) {
+    int n;
+
+    for (n = 0; n < NUM_ALGOS; n++) {
+        if (!strcasecmp(crypto_algos[n].name,name)) {
+            return &crypto_algos[n];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief Reset a context, i.e. start a new calculation.
+ *
+ * \param ctx A pointer to the context.
+ * \param ... A CTAG_DONE terminated list of tags and their values,
+ *   e.g. the key for an HMAC. Digests take no tags.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_UNSUPPORTED_TAG on an
+ *   unknown or missing tag.
+ */
+
+int crypto_reset( crypto_context *ctx, ... ) {
+    va_list tags;
+    int r;
+
+    va_start(tags,ctx);
+    r = ctx->ops->reset(ctx,tags);
+    va_end(tags);
+
+    return r;
+}
+
+/**
+ * \brief Allocate a context for a digest or an HMAC.
+ *
+ * \param alg The algorithm identifier, TEE_ALG_MD5, TEE_ALG_SHA* or
+ *   TEE_ALG_HMAC_*.
+ *
+ * \return A pointer to the allocated context. NULL if a) out of memory
+ *   or b) the algorithm is not supported.
+ */
+
+crypto_context *crypto_alloc( uint32_t alg ) {
+    const crypto_algo_t *a;
+
+    crypto_registry_init();
+
+    if ((a = crypto_find(alg)) != NULL) {
+        return a->alloc();
+    }
+
+    return hmac_alloc(alg);
+}
+
+/**
+ * \brief Initialize a digest context in caller provided storage, e.g.
+ *   on stack. HMAC contexts are bigger, see crypto_init_hmac().
+ *
+ * \param alg The digest algorithm identifier, TEE_ALG_MD5 or
+ *   TEE_ALG_SHA*.
+ * \param mem A pointer to at least ctx_size octets of storage, see
+ *   crypto_find().
+ *
+ * \return A pointer to the context. NULL if the algorithm is not a
+ *   known digest.
+ */
+
+crypto_context *crypto_init( uint32_t alg, void *mem ) {
+    const crypto_algo_t *a;
+
+    crypto_registry_init();
+
+    if ((a = crypto_find(alg)) != NULL) {
+        return a->init(mem);
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief Initialize an HMAC context in caller provided storage, e.g.
+ *   on stack.
+ *
+ * \param alg The HMAC algorithm identifier, TEE_ALG_HMAC_*.
+ * \param mem A pointer to the HMAC context storage.
+ *
+ * \return A pointer to the context. NULL if the algorithm is unknown.
+ */
+
+crypto_context *crypto_init_hmac( uint32_t alg, hmac_context *mem ) {
+    crypto_registry_init();
+    return hmac_init(mem,alg);
+}
@@ -0,0 +1,49 @@
+/**
+ * \file registry.h
+ * \brief A registry of the implemented algorithms keyed by the TEE_ALG_*
+ *   identifiers. Contexts of any supported digest or HMAC can be
+ *   created without knowing the implementation.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#ifndef _registry_h_included
+#define _registry_h_included
+
+#include <stdint.h>
+#include <stddef.h>
+#include "algorithm_types.h"
+#include "hmac.h"
+
+/**
+ * \brief A registry entry of a digest algorithm.
+ */
+
+typedef struct crypto_algo_s {
+    uint32_t algorithm;     /**< TEE_ALG_* identifier */
+    const char *name;       /**< Printable name */
+    size_t ctx_size;        /**< Size of the context for crypto_init() */
+    int hsh_size;           /**< Digest size in octets */
+    int blk_size;           /**< Block size in octets */
+
+    crypto_context *(*alloc)( void );
+    crypto_context *(*init)( void * );
+    /** Runs the kernel selection, NULL if there is none */
+    void (*select)( void );
+} crypto_algo_t;
+
+/**
+ * \brief Registry function prototypes.
+ *
+ */
+
+const crypto_algo_t *crypto_find( uint32_t );
+const crypto_algo_t *crypto_find_name( const char * );
+void crypto_registry_init( void );
+crypto_context *crypto_alloc( uint32_t );
+crypto_context *crypto_init( uint32_t, void * );
+crypto_context *crypto_init_hmac( uint32_t, hmac_context * );
+
+#endif /* _registry_h_included */
@@ -16,15 +16,27 @@
 
 #include <memory.h>
 #include <assert.h>
+#include <stdatomic.h>
 #include "sha1.h"
 #include "crypto_error.h"
+#include "cpu_features.h"
+#include "midstate.h"
+#include "multibuf.h"
+
+/* SHA-1 initial hash value */
+
+const uint32_t sha1_iv[5] = {
+    0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+};
 
 /* potential candidate for inline asm */
 #define ROL(n,w) (((w) << n) | ((w) >> (32-n)))
-#define MSK(n) (n & 0xf)
+#define MSK(n) ((n) & 0xf)
 
 /**
  * \brief Extract a BIG_ENDIAN unsigned long word out of the buffer.
+ *   With GCC the word is loaded at once and byte swapped on little
+ *   endian hosts. The buffer needs not be aligned.
  *
  * \param b A pointer to the buffer. The buffer must have
  *   at least 4 octets of space.
@@ -32,12 +44,21 @@
  * \return The extracted unsigned long word.
  */
 
-static inline uint32_t getlong( uint8_t *b ) {
+static inline uint32_t getlong( const uint8_t *b ) {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__)
+    uint32_t l;
+    memcpy(&l,b,sizeof(l));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    l = __builtin_bswap32(l);
+#endif
+    return l;
+#else
     uint32_t l = *b++;
     l = l << 8 | *b++;
     l = l << 8 | *b++;
     l = l << 8 | *b++;
     return l;
+#endif
 }
 
 /**
@@ -63,59 +84,396 @@ static inline uint8_t *putlong( uint8_t *b, uint32_t l ) {
  * \brief Update the SHA-1 hash value. The implementation is based
  *   on the RFC3174 Method 2, i.e. the memory efficient version.
  *
+ * \param H A pointer to the intermediate hash value H[5].
+ * \param p A pointer to the input blocks.
+ * \param n The number of SHA1_BLK_SIZE blocks to process.
+ *
+ * \return Nothing.
+ */
+
+static void sha1_blocks_generic( uint32_t *H, const uint8_t *p, size_t n ) {
+    uint32_t W[16];
+    int i;
+
+    while (n-- > 0) {
+        uint32_t A = H[0];
+        uint32_t B = H[1];
+        uint32_t C = H[2];
+        uint32_t D = H[3];
+        uint32_t E = H[4];
+
+        /* intialize the W[].. 16 first long words */
+
+        for (i = 0; i < 16; i++) {
+            W[i] = getlong(p + i*4);
+        }
+        /* method 2 from RFC3174 */
+        for (i = 0; i < 80; i++) {
+            uint32_t t;
+            int s = MSK(i);
+
+            if (i >= 16) {
+                W[s] = ROL(1,W[MSK(s+13)] ^ W[MSK(s+8)] ^ W[MSK(s+2)] ^ W[s]);
+            }
+
+            t = ROL(5,A) + E + W[s];
+
+            if (i < 20) {
+                t = t + 0x5A827999 + ((B & C) | (~B & D)); 
+            } else if (i < 40) {
+                t = t + 0x6ED9EBA1 + (B ^ C ^ D);
+            } else if (i < 60) {
+                t = t + 0x8F1BBCDC + ((B & C) | (B & D) | (C & D));
+            } else {
+                t = t + 0xCA62C1D6 + (B ^ C ^ D);
+            }
+
+            E = D;
+            D = C;
+            C = ROL(30,B);
+            B = A;
+            A = t;
+        }
+
+        H[0] += A;
+        H[1] += B;
+        H[2] += C;
+        H[3] += D;
+        H[4] += E;
+        p += SHA1_BLK_SIZE;
+    }
+}
+
+#if defined(CPU_X86_KERNELS)
+
+/* Four rounds k*4..k*4+3 using the Intel SHA extensions. The message
+ * schedule for the following rounds is interleaved with the rounds.
+ * En is the E value used for these rounds and Eo receives the E for
+ * the next four rounds. Mc holds W[k*4..k*4+3], Mn the words for the
+ * next four rounds and Mp/Mpp the words that are still being expanded.
+ * The conditions are constant and get folded by the compiler.
+ */
+
+#define SHA1_NI_4ROUNDS(k,En,Eo,Mc,Mn,Mp,Mpp) \
+    En = _mm_sha1nexte_epu32(En,Mc); \
+    Eo = ABCD; \
+    if ((k) >= 3 && (k) <= 18) Mn = _mm_sha1msg2_epu32(Mn,Mc); \
+    ABCD = _mm_sha1rnds4_epu32(ABCD,En,(k)/5); \
+    if ((k) >= 1 && (k) <= 16) Mp = _mm_sha1msg1_epu32(Mp,Mc); \
+    if ((k) >= 2 && (k) <= 17) Mpp = _mm_xor_si128(Mpp,Mc);
+
+/**
+ * \brief Update the SHA-1 hash value using the SHA1RNDS4, SHA1NEXTE,
+ *   SHA1MSG1 and SHA1MSG2 instructions.
+ *
+ * \param H A pointer to the intermediate hash value H[5].
+ * \param p A pointer to the input blocks.
+ * \param n The number of SHA1_BLK_SIZE blocks to process.
+ *
+ * \return Nothing.
+ */
+
+__attribute__((target("sha,sse4.1")))
+static void sha1_blocks_shani( uint32_t *H, const uint8_t *p, size_t n ) {
+    __m128i ABCD, ABCD_SAVE, E0, E0_SAVE, E1;
+    __m128i M0, M1, M2, M3;
+    const __m128i MASK = _mm_set_epi64x(0x0001020304050607ULL,0x08090a0b0c0d0e0fULL);
+
+    ABCD = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)H),0x1b);
+    E0 = _mm_set_epi32(H[4],0,0,0);
+
+    while (n-- > 0) {
+        ABCD_SAVE = ABCD;
+        E0_SAVE = E0;
+
+        M0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p+0)),MASK);
+        M1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p+16)),MASK);
+        M2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p+32)),MASK);
+        M3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p+48)),MASK);
+
+        /* rounds 0-3 */
+        E0 = _mm_add_epi32(E0,M0);
+        E1 = ABCD;
+        ABCD = _mm_sha1rnds4_epu32(ABCD,E0,0);
+
+        SHA1_NI_4ROUNDS( 1,E1,E0,M1,M2,M0,M3);
+        SHA1_NI_4ROUNDS( 2,E0,E1,M2,M3,M1,M0);
+        SHA1_NI_4ROUNDS( 3,E1,E0,M3,M0,M2,M1);
+        SHA1_NI_4ROUNDS( 4,E0,E1,M0,M1,M3,M2);
+        SHA1_NI_4ROUNDS( 5,E1,E0,M1,M2,M0,M3);
+        SHA1_NI_4ROUNDS( 6,E0,E1,M2,M3,M1,M0);
+        SHA1_NI_4ROUNDS( 7,E1,E0,M3,M0,M2,M1);
+        SHA1_NI_4ROUNDS( 8,E0,E1,M0,M1,M3,M2);
+        SHA1_NI_4ROUNDS( 9,E1,E0,M1,M2,M0,M3);
+        SHA1_NI_4ROUNDS(10,E0,E1,M2,M3,M1,M0);
+        SHA1_NI_4ROUNDS(11,E1,E0,M3,M0,M2,M1);
+        SHA1_NI_4ROUNDS(12,E0,E1,M0,M1,M3,M2);
+        SHA1_NI_4ROUNDS(13,E1,E0,M1,M2,M0,M3);
+        SHA1_NI_4ROUNDS(14,E0,E1,M2,M3,M1,M0);
+        SHA1_NI_4ROUNDS(15,E1,E0,M3,M0,M2,M1);
+        SHA1_NI_4ROUNDS(16,E0,E1,M0,M1,M3,M2);
+        SHA1_NI_4ROUNDS(17,E1,E0,M1,M2,M0,M3);
+        SHA1_NI_4ROUNDS(18,E0,E1,M2,M3,M1,M0);
+        SHA1_NI_4ROUNDS(19,E1,E0,M3,M0,M2,M1);
+
+        E0 = _mm_sha1nexte_epu32(E0,E0_SAVE);
+        ABCD = _mm_add_epi32(ABCD,ABCD_SAVE);
+        p += SHA1_BLK_SIZE;
+    }
+
+    _mm_storeu_si128((__m128i *)H,_mm_shuffle_epi32(ABCD,0x1b));
+    H[4] = _mm_extract_epi32(E0,3);
+}
+
+#undef SHA1_NI_4ROUNDS
+#endif
+
+/* The kernel is selected on the first use. Until then the pointer
+ * refers to the selector itself. The pointer is atomic since threads
+ * may select concurrently, every selector stores the same kernel.
+ */
+
+static void sha1_blocks_select( uint32_t *, const uint8_t *, size_t );
+static void (*_Atomic sha1_kernel)( uint32_t *, const uint8_t *, size_t ) = sha1_blocks_select;
+
+static inline void sha1_blocks( uint32_t *H, const uint8_t *p, size_t n ) {
+    atomic_load_explicit(&sha1_kernel,memory_order_relaxed)(H,p,n);
+}
+
+/**
+ * \brief Pick the fastest SHA-1 kernel the CPU supports and process
+ *   the given blocks with it.
+ *
+ * \param H A pointer to the intermediate hash value H[5].
+ * \param p A pointer to the input blocks.
+ * \param n The number of SHA1_BLK_SIZE blocks to process.
+ *
+ * \return Nothing.
+ */
+
+static void sha1_blocks_select( uint32_t *H, const uint8_t *p, size_t n ) {
+    void (*f)( uint32_t *, const uint8_t *, size_t ) = sha1_blocks_generic;
+#if defined(CPU_X86_KERNELS)
+    uint32_t req = CPU_FEATURE_SHA | CPU_FEATURE_SSE41 | CPU_FEATURE_SSSE3;
+
+    if ((cpu_features() & req) == req) {
+        f = sha1_blocks_shani;
+    }
+#endif
+    atomic_store_explicit(&sha1_kernel,f,memory_order_relaxed);
+    f(H,p,n);
+}
+
+/**
+ * \brief Update the SHA-1 hash value with the block in the context
+ *   buffer.
+ *
  * \param ctx A pointer to the sha1_context_t.
  *
  * \return Nothing.
  */
 
 static void sha1_update_block( sha1_context_t *ctx ) {
-    uint32_t W[16];
-    uint32_t A = ctx->H[0];
-    uint32_t B = ctx->H[1];
-    uint32_t C = ctx->H[2];
-    uint32_t D = ctx->H[3];
-    uint32_t E = ctx->H[4];
+    sha1_blocks(ctx->H,ctx->buf,1);
+}
+
+/**
+ * \brief Process blocks with the selected SHA-1 kernel. This is the
+ *   exported kernel interface for hashing full blocks without a
+ *   context.
+ *
+ * \param H A pointer to the intermediate hash value H[5].
+ * \param p A pointer to the input blocks.
+ * \param n The number of SHA1_BLK_SIZE blocks to process.
+ *
+ * \return Nothing.
+ */
 
+void sha1_compress( uint32_t *H, const uint8_t *p, size_t n ) {
+    sha1_blocks(H,p,n);
+}
+
+#if defined(CPU_X86_KERNELS)
+
+/* SHA-1 rounds for 8 and 16 lanes. The lane state is transposed, see
+ * multibuf.h, so every vector holds one word of every lane.
+ */
+
+#define MB8_ROL(x,n) _mm256_or_si256(_mm256_slli_epi32(x,n),_mm256_srli_epi32(x,32-(n)))
+#define MB8_ADD(a,b) _mm256_add_epi32(a,b)
+
+/**
+ * \brief Compress one block in each of the 8 lanes using AVX2.
+ *
+ * \param S A pointer to the transposed lane state.
+ * \param p A pointer to 8 block pointers, one per lane.
+ *
+ * \return Nothing.
+ */
+
+__attribute__((target("avx2")))
+static void sha1_x8_avx2( uint32_t *S, const uint8_t *const *p ) {
+    __m256i W[16];
+    __m256i A, B, C, D, E;
     int i;
 
-    /* intialize the W[].. 16 first long words */
+    mb_load_x8(W,p,1);
+
+    A = _mm256_loadu_si256((const __m256i *)&S[0*MB_MAX_LANES]);
+    B = _mm256_loadu_si256((const __m256i *)&S[1*MB_MAX_LANES]);
+    C = _mm256_loadu_si256((const __m256i *)&S[2*MB_MAX_LANES]);
+    D = _mm256_loadu_si256((const __m256i *)&S[3*MB_MAX_LANES]);
+    E = _mm256_loadu_si256((const __m256i *)&S[4*MB_MAX_LANES]);
 
-    for (i = 0; i < 16; i++) {
-        W[i] = getlong(ctx->buf + i*4);
-    }
-    /* method 2 from RFC3174 */
     for (i = 0; i < 80; i++) {
-        uint32_t t;
+        __m256i t, f;
         int s = MSK(i);
 
         if (i >= 16) {
-            W[s] = ROL(1,W[MSK(s+13)] ^ W[MSK(s+8)] ^ W[MSK(s+2)] ^ W[s]);
+            t = _mm256_xor_si256(_mm256_xor_si256(W[MSK(s+13)],W[MSK(s+8)]),
+                                 _mm256_xor_si256(W[MSK(s+2)],W[s]));
+            W[s] = MB8_ROL(t,1);
+        }
+        if (i < 20) {
+            f = _mm256_or_si256(_mm256_and_si256(B,C),_mm256_andnot_si256(B,D));
+            t = _mm256_set1_epi32(0x5A827999);
+        } else if (i < 40) {
+            f = _mm256_xor_si256(_mm256_xor_si256(B,C),D);
+            t = _mm256_set1_epi32(0x6ED9EBA1);
+        } else if (i < 60) {
+            f = _mm256_or_si256(_mm256_and_si256(B,C),_mm256_and_si256(D,_mm256_or_si256(B,C)));
+            t = _mm256_set1_epi32(0x8F1BBCDC);
+        } else {
+            f = _mm256_xor_si256(_mm256_xor_si256(B,C),D);
+            t = _mm256_set1_epi32(0xCA62C1D6);
         }
 
-        t = ROL(5,A) + E + W[s];
+        t = MB8_ADD(MB8_ADD(MB8_ROL(A,5),E),MB8_ADD(MB8_ADD(t,f),W[s]));
+        E = D;
+        D = C;
+        C = MB8_ROL(B,30);
+        B = A;
+        A = t;
+    }
+
+#define MB8_STORE(n,v) _mm256_storeu_si256((__m256i *)&S[(n)*MB_MAX_LANES], \
+        MB8_ADD(v,_mm256_loadu_si256((const __m256i *)&S[(n)*MB_MAX_LANES])))
+    MB8_STORE(0,A);
+    MB8_STORE(1,B);
+    MB8_STORE(2,C);
+    MB8_STORE(3,D);
+    MB8_STORE(4,E);
+#undef MB8_STORE
+}
 
+#undef MB8_ROL
+#undef MB8_ADD
+
+#define MB16_ADD(a,b) _mm512_add_epi32(a,b)
+
+/**
+ * \brief Compress one block in each of the 16 lanes using AVX-512.
+ *
+ * \param S A pointer to the transposed lane state.
+ * \param p A pointer to 16 block pointers, one per lane.
+ *
+ * \return Nothing.
+ */
+
+__attribute__((target("avx512f,avx512bw")))
+static void sha1_x16_avx512( uint32_t *S, const uint8_t *const *p ) {
+    __m512i W[16];
+    __m512i A, B, C, D, E;
+    int i;
+
+    mb_load_x16(W,p,1);
+
+    A = _mm512_loadu_si512((const void *)&S[0*MB_MAX_LANES]);
+    B = _mm512_loadu_si512((const void *)&S[1*MB_MAX_LANES]);
+    C = _mm512_loadu_si512((const void *)&S[2*MB_MAX_LANES]);
+    D = _mm512_loadu_si512((const void *)&S[3*MB_MAX_LANES]);
+    E = _mm512_loadu_si512((const void *)&S[4*MB_MAX_LANES]);
+
+    for (i = 0; i < 80; i++) {
+        __m512i t, f;
+        int s = MSK(i);
+
+        if (i >= 16) {
+            t = _mm512_ternarylogic_epi32(W[MSK(s+13)],W[MSK(s+8)],W[MSK(s+2)],0x96);
+            W[s] = _mm512_rol_epi32(_mm512_xor_si512(t,W[s]),1);
+        }
+
+        /* Ch is 0xca, Parity 0x96 and Maj 0xe8 as ternary logic truth tables */
         if (i < 20) {
-            t = t + 0x5A827999 + ((B & C) | (~B & D)); 
+            f = _mm512_ternarylogic_epi32(B,C,D,0xca);
+            t = _mm512_set1_epi32(0x5A827999);
         } else if (i < 40) {
-            t = t + 0x6ED9EBA1 + (B ^ C ^ D);
+            f = _mm512_ternarylogic_epi32(B,C,D,0x96);
+            t = _mm512_set1_epi32(0x6ED9EBA1);
         } else if (i < 60) {
-            t = t + 0x8F1BBCDC + ((B & C) | (B & D) | (C & D));
+            f = _mm512_ternarylogic_epi32(B,C,D,0xe8);
+            t = _mm512_set1_epi32(0x8F1BBCDC);
         } else {
-            t = t + 0xCA62C1D6 + (B ^ C ^ D);
+            f = _mm512_ternarylogic_epi32(B,C,D,0x96);
+            t = _mm512_set1_epi32(0xCA62C1D6);
         }
 
+        t = MB16_ADD(MB16_ADD(_mm512_rol_epi32(A,5),E),MB16_ADD(MB16_ADD(t,f),W[s]));
         E = D;
         D = C;
-        C = ROL(30,B);
+        C = _mm512_rol_epi32(B,30);
         B = A;
         A = t;
     }
 
-    ctx->H[0] += A;
-    ctx->H[1] += B;
-    ctx->H[2] += C;
-    ctx->H[3] += D;
-    ctx->H[4] += E;
+#define MB16_STORE(n,v) _mm512_storeu_si512((void *)&S[(n)*MB_MAX_LANES], \
+        MB16_ADD(v,_mm512_loadu_si512((const void *)&S[(n)*MB_MAX_LANES])))
+    MB16_STORE(0,A);
+    MB16_STORE(1,B);
+    MB16_STORE(2,C);
+    MB16_STORE(3,D);
+    MB16_STORE(4,E);
+#undef MB16_STORE
+}
+
+#undef MB16_ADD
+#endif
+
+/**
+ * \brief Fill in the multi-buffer description of SHA-1 using the
+ *   fastest lane kernel the CPU supports.
+ *
+ * \param a A pointer to the description to fill in.
+ * \param alg TEE_ALG_SHA1.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_UNSUPPORTED_DIGEST otherwise.
+ */
+
+int sha1_mb_setup( mb_algo_t *a, uint32_t alg ) {
+    if (alg != TEE_ALG_SHA1) {
+        return CRYPTO_ERROR_UNSUPPORTED_DIGEST;
+    }
+
+    a->algorithm = alg;
+    a->words = 5;
+    a->out_words = 5;
+    a->big_endian = 1;
+    a->iv = sha1_iv;
+    a->lanes = 1;
+    a->single = sha1_compress;
+    a->blocks = NULL;
+
+#if defined(CPU_X86_KERNELS)
+    if (cpu_features() & CPU_FEATURE_AVX512) {
+        a->lanes = 16;
+        a->blocks = sha1_x16_avx512;
+    } else if (cpu_features() & CPU_FEATURE_AVX2) {
+        /* 8 AVX2 lanes are still slightly ahead of one SHA-NI lane */
+        a->lanes = 8;
+        a->blocks = sha1_x8_avx2;
+    }
+#endif
+    return CRYPTO_SUCCESS;
 }
 
 
@@ -126,7 +484,7 @@ static void sha1_update_block( sha1_context_t *ctx ) {
  * \paramm ctx A pointer to the sha1_context.
  */
 
-static int sha1_reset( crypto_context *hdr, ... ) {
+static int sha1_reset( crypto_context *hdr, va_list tags ) {
 	/* Note that we must not override the hdr->context value.. */
 
 	assert(hdr);
@@ -134,11 +492,7 @@ static int sha1_reset( crypto_context *hdr, ... ) {
 	ctx->index = 0;
 
     /* Initialize intermediate hash values */
-    ctx->H[0] = 0x67452301;
-    ctx->H[1] = 0xEFCDAB89;
-    ctx->H[2] = 0x98BADCFE;
-    ctx->H[3] = 0x10325476;
-    ctx->H[4] = 0xC3D2E1F0;
+    memcpy(ctx->H,sha1_iv,sizeof(sha1_iv));
 
 	return CRYPTO_SUCCESS;
 }
@@ -151,35 +505,43 @@ static int sha1_reset( crypto_context *hdr, ... ) {
  *   initialized prior calling this function, otherwise the result is
  *   unpredictable.
  * \param buf A pointer to input octet buffer.
- * \param len The length of the input buffer. Must be greater or equal to 0.
+ * \param len The length of the input buffer.
  *
  * \return Nothing.
  */
 
-static void sha1_update( crypto_context *hdr, const void *buf, int len ) {
+static void sha1_update( crypto_context *hdr, const void *buf, size_t len ) {
     sha1_context_t *ctx = (sha1_context_t *)hdr;
-	int pos = 0;
-    uint8_t *b = (uint8_t *)buf;
+    const uint8_t *b = (const uint8_t *)buf;
+    size_t idx;
 
     assert(ctx);
-    assert(len >= 0);
 
-    while (len > 0) {
-        int idx = ctx->index & SHA1_BLK_MASK;
-        int sze = SHA1_BLK_SIZE-idx;
+    idx = ctx->index & SHA1_BLK_MASK;
+    ctx->index += len;
+
+    if (idx > 0) {
+        /* complete the partial block in the context first */
+        size_t sze = SHA1_BLK_SIZE-idx;
 
         if (sze > len) {
-            sze = len;
+            memcpy(ctx->buf+idx,b,len);
+            return;
         }
 
-        memcpy(ctx->buf+idx,b+pos,sze);
+        memcpy(ctx->buf+idx,b,sze);
+        sha1_update_block( ctx );
+        b += sze;
         len -= sze;
-        pos += sze;
-        ctx->index += sze;
-        
-        if (idx+sze == SHA1_BLK_SIZE) {
-            sha1_update_block( ctx );
-        }
+    }
+    if (len >= SHA1_BLK_SIZE) {
+        /* all full blocks directly from the caller buffer */
+        sha1_blocks(ctx->H,b,len / SHA1_BLK_SIZE);
+        b += len & ~SHA1_BLK_MASK;
+        len &= SHA1_BLK_MASK;
+    }
+    if (len > 0) {
+        memcpy(ctx->buf,b,len);
     }
 }
 
@@ -196,7 +558,7 @@ static void sha1_update( crypto_context *hdr, const void *buf, int len ) {
 static void sha1_finish( crypto_context *hdr, uint8_t *out ) {
 	sha1_context_t *ctx = (sha1_context_t *)hdr;
 	int idx = ctx->index & SHA1_BLK_MASK;
-    int64_t flen = ctx->index * 8;
+    uint64_t flen = ctx->index * 8;
     int32_t hlen = flen >> 32;
     int32_t llen = flen;
 
@@ -233,14 +595,62 @@ static void sha1_finish( crypto_context *hdr, uint8_t *out ) {
  */
 
 static void sha1_free( crypto_context *ctx) {
-	if (ctx) {
+	if (ctx && !(ctx->flags & CFLAG_STATIC_ALLOC)) {
 		free(ctx);
 	}
 }
 
-static void sha1_free_dummy( crypto_context *ctx) {
+/**
+ * \brief Copy the SHA-1 context including the state of the calculation
+ *   so far. The copy is independent of the original.
+ *
+ * \param hdr A pointer to the context to copy.
+ * \param dst A pointer to the storage for the copy, or NULL to allocate
+ *   the copy from the heap.
+ *
+ * \return A pointer to the copy. NULL if the allocation failed.
+ */
+
+static crypto_context *sha1_clone( const crypto_context *hdr, crypto_context *dst ) {
+	if (dst == NULL) {
+		if ((dst = malloc(sizeof(sha1_context_t))) == NULL) {
+			return NULL;
+		}
+		memcpy(dst,hdr,sizeof(sha1_context_t));
+		dst->flags &= ~CFLAG_STATIC_ALLOC;
+	} else {
+		memcpy(dst,hdr,sizeof(sha1_context_t));
+		dst->flags |= CFLAG_STATIC_ALLOC;
+	}
+	return dst;
 }
 
+/**
+ * \brief Export and import the SHA-1 intermediate state as a blob,
+ *   see midstate.h for the format.
+ *
+ */
+
+static int sha1_export( const crypto_context *hdr, uint8_t *out, size_t *len ) {
+	const sha1_context_t *ctx = (const sha1_context_t *)hdr;
+	return midstate_export(hdr,ctx->index,ctx->H,5,4,ctx->buf,out,len);
+}
+
+static int sha1_import( crypto_context *hdr, const uint8_t *in, size_t len ) {
+	sha1_context_t *ctx = (sha1_context_t *)hdr;
+	return midstate_import(hdr,&ctx->index,ctx->H,5,4,ctx->buf,in,len);
+}
+
+static const crypto_ops sha1_ops = {
+	sha1_reset,
+	sha1_update,
+	sha1_finish,
+	sha1_clone,
+	sha1_export,
+	sha1_import,
+	sha1_free
+};
+
 /**
  * \brief Allocate and initialize the minumum of the SHA1 context.
  *   This is supposed to be the only exported function.
@@ -257,7 +667,7 @@ crypto_context *sha1_alloc( void ) {
 	}
 
 	sha1_init((sha1_context_t *)ctx);
-	ctx->free = sha1_free;
+	ctx->flags &= ~CFLAG_STATIC_ALLOC;
 	return ctx;
 }
 
@@ -278,10 +688,8 @@ crypto_context *sha1_init( sha1_context_t *stx ) {
 	ctx->size = SHA1_HSH_SIZE << 3;
 	ctx->block_size = SHA1_BLK_SIZE;
 	
-	ctx->reset = sha1_reset;
-	ctx->update = sha1_update;
-	ctx->finish = sha1_finish;
-	ctx->free = sha1_free_dummy;
+	ctx->flags = CFLAG_STATIC_ALLOC;
+	ctx->ops = &sha1_ops;
 	return ctx;
 }
 
@@ -305,9 +713,9 @@ int main( int argc, char** argv )
     crypto_context *ctx = sha1_alloc();
     uint8_t hash[SHA1_HSH_SIZE];
 	
-	ctx->reset(ctx);
-    ctx->update(ctx,argv[1],strlen(argv[1]));
-	ctx->finish(ctx,hash);
+	crypto_reset(ctx);
+    crypto_update(ctx,argv[1],strlen(argv[1]));
+	crypto_finish(ctx,hash);
 
 
     for (n = 0; n < SHA1_HSH_SIZE; n++) {
@@ -315,15 +723,15 @@ int main( int argc, char** argv )
     }
     printf("\n");
 
-	ctx->reset(ctx);
-    ctx->update(ctx,argv[1],strlen(argv[1]));
-	ctx->finish(ctx,hash);
+	crypto_reset(ctx);
+    crypto_update(ctx,argv[1],strlen(argv[1]));
+	crypto_finish(ctx,hash);
     for (n = 0; n < SHA1_HSH_SIZE; n++) {
         printf("%02x",hash[n]);
     }
     printf("\n");
 
-	ctx->free(ctx);
+	crypto_free(ctx);
 
     return 0;
 }
@@ -12,6 +12,7 @@
 #define _sha1_h_included
 
 #include <stdint.h>
+#include <stddef.h>
 #include "algorithm_types.h"
 
 /* */
@@ -24,7 +25,7 @@
 
 typedef struct sha1_context_s {
 	crypto_context hdr;
-	int64_t index;      /* number of octets processed so far */
+	uint64_t index;     /* number of octets processed so far */
     uint32_t H[5];
     uint8_t buf[SHA1_BLK_SIZE];
 } sha1_context_t;
@@ -37,4 +38,13 @@ typedef struct sha1_context_s {
 crypto_context *sha1_alloc( void );
 crypto_context *sha1_init( sha1_context_t * );
 
+/* Compress n full blocks straight from a buffer into H[], i.e. no
+ * padding or buffering. */
+
+void sha1_compress( uint32_t *, const uint8_t *, size_t );
+
+/* Initial hash values, for use with the compress function */
+
+extern const uint32_t sha1_iv[5];
+
 #endif /* _sha1_h_included */
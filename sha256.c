@@ -15,8 +15,17 @@
 #include <stdlib.h>
 
 #include <memory.h>
+#include <assert.h>
+#include <stdatomic.h>
 #include "sha256.h"
 #include "crypto_error.h"
+#include "cpu_features.h"
+#include "midstate.h"
+#include "multibuf.h"
+
+#if defined(CPU_X86_KERNELS)
+#include <immintrin.h>
+#endif
 
 /* potential candidate for inline asm */
 #define ROR(n,w) (((w) >> (n)) | ((w) << (32-(n))))
@@ -44,8 +53,22 @@ static const uint32_t k[] = {
 	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
 };
 
+/* SHA-256 and SHA-224 initial hash values */
+
+const uint32_t sha256_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+const uint32_t sha224_iv[8] = {
+    0xc1059ed8, 0x367cd507, 0x3070dd17, 0xf70e5939,
+    0xffc00b31, 0x68581511, 0x64f98fa7, 0xbefa4fa4
+};
+
 /**
  * \brief Extract a BIG_ENDIAN unsigned long word out of the buffer.
+ *   With GCC the word is loaded at once and byte swapped on little
+ *   endian hosts. The buffer needs not be aligned.
  *
  * \param b A pointer to the buffer. The buffer must have
  *   at least 4 octets of space.
@@ -53,12 +76,21 @@ static const uint32_t k[] = {
  * \return The extracted unsigned long word.
  */
 
-static inline uint32_t getlong( uint8_t *b ) {
+static inline uint32_t getlong( const uint8_t *b ) {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__)
+    uint32_t l;
+    memcpy(&l,b,sizeof(l));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    l = __builtin_bswap32(l);
+#endif
+    return l;
+#else
     uint32_t l = *b++;
     l = l << 8 | *b++;
     l = l << 8 | *b++;
     l = l << 8 | *b++;
     return l;
+#endif
 }
 
 /**
@@ -86,65 +118,560 @@ static inline uint8_t *putlong( uint8_t *b, uint32_t l ) {
  *   circular buffer manner. Also all transformation and reading
  *   the input buffer is done in one loop.
  *
+ * \param[inout] HH A pointer to the intermediate hash value H[8].
+ * \param[in] p A pointer to the input blocks.
+ * \param[in] n The number of SHA256_BLK_SIZE blocks to process.
+ *
+ * \return Nothing.
+ */
+
+static void sha2xx_blocks_generic( uint32_t *HH, const uint8_t *p, size_t n ) {
+    uint32_t W[16];
+    int i;
+
+    while (n-- > 0) {
+        uint32_t A = HH[0];
+        uint32_t B = HH[1];
+        uint32_t C = HH[2];
+        uint32_t D = HH[3];
+        uint32_t E = HH[4];
+        uint32_t F = HH[5];
+        uint32_t G = HH[6];
+        uint32_t H = HH[7];
+
+        for (i = 0; i < 64; i++) {
+            uint32_t t1, t2, s1, ch, s0, maj;
+            uint32_t w = 0;
+
+            if (i < 16) {
+                w = W[i] = getlong(p + i*4);
+            } else {
+                uint32_t s0, s1, t;
+#define MODI(x) (x & 0x0f)
+                t = W[MODI(i-15)]; s0 = ROR(7,t) ^ ROR(18,t) ^ LSR(3,t); 
+                t = W[MODI(i-2)];  s1 = ROR(17,t) ^ ROR(19,t) ^ LSR(10,t);
+                w = W[MODI(i-16)] + s0 + W[MODI(i-7)] + s1;
+                W[MODI(i)] = w;
+#undef MODI
+            }
+        
+            s1 = ROR(6,E) ^ ROR(11,E) ^ ROR(25,E);
+            ch = (E & F) ^ (~E & G);
+            t1 = H + s1 + ch + k[i] + w;
+
+            s0 = ROR(2,A) ^ ROR(13,A) ^ ROR(22,A);
+            maj = (A & (B ^ C)) ^ (B & C);  /* == (A & B) ^ (A & C)  ^ (B & C); */
+            t2 = s0 + maj;
+    
+            H = G;
+            G = F;
+            F = E;
+            E = D + t1;
+            D = C;
+            C = B;
+            B = A;
+            A = t1 + t2;
+        }
+
+        HH[0] += A;
+        HH[1] += B;
+        HH[2] += C;
+        HH[3] += D;
+        HH[4] += E;
+        HH[5] += F;
+        HH[6] += G;
+        HH[7] += H;
+        p += SHA256_BLK_SIZE;
+    }
+}
+
+#if defined(CPU_X86_KERNELS)
+
+/* Four rounds r*4..r*4+3 using the Intel SHA extensions. Each SHA256RNDS2
+ * does two rounds, the W+K for the latter two are in the upper half of MSG.
+ * Mc holds W[r*4..r*4+3], Mp the previous four and Mn the next four words,
+ * which get expanded here. The conditions are constant and get folded by
+ * the compiler.
+ */
+
+#define SHA256_NI_4ROUNDS(r,Mc,Mp,Mn) \
+    MSG = _mm_add_epi32(Mc,_mm_loadu_si128((const __m128i *)&k[(r)*4])); \
+    S1 = _mm_sha256rnds2_epu32(S1,S0,MSG); \
+    if ((r) >= 3 && (r) <= 14) { \
+        Mn = _mm_add_epi32(Mn,_mm_alignr_epi8(Mc,Mp,4)); \
+        Mn = _mm_sha256msg2_epu32(Mn,Mc); \
+    } \
+    MSG = _mm_shuffle_epi32(MSG,0x0e); \
+    S0 = _mm_sha256rnds2_epu32(S0,S1,MSG); \
+    if ((r) >= 1 && (r) <= 12) Mp = _mm_sha256msg1_epu32(Mp,Mc);
+
+/**
+ * \brief Update the SHA-224 or SHA-256 hash value using the SHA256RNDS2,
+ *   SHA256MSG1 and SHA256MSG2 instructions.
+ *
+ * \param[inout] H A pointer to the intermediate hash value H[8].
+ * \param[in] p A pointer to the input blocks.
+ * \param[in] n The number of SHA256_BLK_SIZE blocks to process.
+ *
+ * \return Nothing.
+ */
+
+__attribute__((target("sha,sse4.1")))
+static void sha2xx_blocks_shani( uint32_t *H, const uint8_t *p, size_t n ) {
+    __m128i S0, S1, S0_SAVE, S1_SAVE, MSG, TMP;
+    __m128i M0, M1, M2, M3;
+    const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,0x0405060700010203ULL);
+
+    /* the instructions want the state as ABEF and CDGH */
+    TMP = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&H[0]),0xb1);
+    S1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&H[4]),0x1b);
+    S0 = _mm_alignr_epi8(TMP,S1,8);
+    S1 = _mm_blend_epi16(S1,TMP,0xf0);
+
+    while (n-- > 0) {
+        S0_SAVE = S0;
+        S1_SAVE = S1;
+
+        M0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p+0)),MASK);
+        M1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p+16)),MASK);
+        M2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p+32)),MASK);
+        M3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p+48)),MASK);
+
+        SHA256_NI_4ROUNDS( 0,M0,M3,M1);
+        SHA256_NI_4ROUNDS( 1,M1,M0,M2);
+        SHA256_NI_4ROUNDS( 2,M2,M1,M3);
+        SHA256_NI_4ROUNDS( 3,M3,M2,M0);
+        SHA256_NI_4ROUNDS( 4,M0,M3,M1);
+        SHA256_NI_4ROUNDS( 5,M1,M0,M2);
+        SHA256_NI_4ROUNDS( 6,M2,M1,M3);
+        SHA256_NI_4ROUNDS( 7,M3,M2,M0);
+        SHA256_NI_4ROUNDS( 8,M0,M3,M1);
+        SHA256_NI_4ROUNDS( 9,M1,M0,M2);
+        SHA256_NI_4ROUNDS(10,M2,M1,M3);
+        SHA256_NI_4ROUNDS(11,M3,M2,M0);
+        SHA256_NI_4ROUNDS(12,M0,M3,M1);
+        SHA256_NI_4ROUNDS(13,M1,M0,M2);
+        SHA256_NI_4ROUNDS(14,M2,M1,M3);
+        SHA256_NI_4ROUNDS(15,M3,M2,M0);
+
+        S0 = _mm_add_epi32(S0,S0_SAVE);
+        S1 = _mm_add_epi32(S1,S1_SAVE);
+        p += SHA256_BLK_SIZE;
+    }
+
+    /* back to ABCD and EFGH */
+    TMP = _mm_shuffle_epi32(S0,0x1b);
+    S1 = _mm_shuffle_epi32(S1,0xb1);
+    _mm_storeu_si128((__m128i *)&H[0],_mm_blend_epi16(TMP,S1,0xf0));
+    _mm_storeu_si128((__m128i *)&H[4],_mm_alignr_epi8(S1,TMP,8));
+}
+
+/**
+ * \brief Iterate SHA-224 or SHA-256 over its own digest, see
+ *   sha256_iterate(). The digest stays in registers, it is turned from
+ *   the ABEF/CDGH state form directly into the first message words and
+ *   the padding words are constants.
+ *
+ * \param[inout] X A pointer to the digest words.
+ * \param[in] iv A pointer to the initial hash value.
+ * \param[in] hw The number of digest words, 7 or 8.
+ * \param[in] n The number of passes.
+ *
+ * \return Nothing.
+ */
+
+__attribute__((target("sha,sse4.1")))
+static void sha2xx_iterate_shani( uint32_t *X, const uint32_t *iv, int hw, uint64_t n ) {
+    __m128i S0, S1, IV0, IV1, MSG, TMP;
+    __m128i M0, M1, M2, M3, D0, D1, P2, P3;
+
+    TMP = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&iv[0]),0xb1);
+    IV1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&iv[4]),0x1b);
+    IV0 = _mm_alignr_epi8(TMP,IV1,8);
+    IV1 = _mm_blend_epi16(IV1,TMP,0xf0);
+
+    /* W[hw] = 0x80000000, W[15] = the length in bits */
+    D0 = _mm_loadu_si128((const __m128i *)&X[0]);
+    D1 = _mm_set_epi32(hw == 8 ? X[7] : 0x80000000,X[6],X[5],X[4]);
+    P2 = _mm_set_epi32(0,0,0,hw == 8 ? 0x80000000 : 0);
+    P3 = _mm_set_epi32(hw*32,0,0,0);
+
+    while (n-- > 0) {
+        S0 = IV0;
+        S1 = IV1;
+        M0 = D0;
+        M1 = D1;
+        M2 = P2;
+        M3 = P3;
+
+        SHA256_NI_4ROUNDS( 0,M0,M3,M1);
+        SHA256_NI_4ROUNDS( 1,M1,M0,M2);
+        SHA256_NI_4ROUNDS( 2,M2,M1,M3);
+        SHA256_NI_4ROUNDS( 3,M3,M2,M0);
+        SHA256_NI_4ROUNDS( 4,M0,M3,M1);
+        SHA256_NI_4ROUNDS( 5,M1,M0,M2);
+        SHA256_NI_4ROUNDS( 6,M2,M1,M3);
+        SHA256_NI_4ROUNDS( 7,M3,M2,M0);
+        SHA256_NI_4ROUNDS( 8,M0,M3,M1);
+        SHA256_NI_4ROUNDS( 9,M1,M0,M2);
+        SHA256_NI_4ROUNDS(10,M2,M1,M3);
+        SHA256_NI_4ROUNDS(11,M3,M2,M0);
+        SHA256_NI_4ROUNDS(12,M0,M3,M1);
+        SHA256_NI_4ROUNDS(13,M1,M0,M2);
+        SHA256_NI_4ROUNDS(14,M2,M1,M3);
+        SHA256_NI_4ROUNDS(15,M3,M2,M0);
+
+        S0 = _mm_add_epi32(S0,IV0);
+        S1 = _mm_add_epi32(S1,IV1);
+
+        /* back to ABCD and EFGH, which are the next message words */
+        TMP = _mm_shuffle_epi32(S0,0x1b);
+        S1 = _mm_shuffle_epi32(S1,0xb1);
+        D0 = _mm_blend_epi16(TMP,S1,0xf0);
+        D1 = _mm_alignr_epi8(S1,TMP,8);
+
+        if (hw == 7) {
+            D1 = _mm_insert_epi32(D1,0x80000000,3);
+        }
+    }
+
+    _mm_storeu_si128((__m128i *)&X[0],D0);
+    X[4] = _mm_extract_epi32(D1,0);
+    X[5] = _mm_extract_epi32(D1,1);
+    X[6] = _mm_extract_epi32(D1,2);
+
+    if (hw == 8) {
+        X[7] = _mm_extract_epi32(D1,3);
+    }
+}
+
+#undef SHA256_NI_4ROUNDS
+#endif
+
+/* The kernel is selected on the first use. Until then the pointer
+ * refers to the selector itself. The pointer is atomic since threads
+ * may select concurrently, every selector stores the same kernel.
+ */
+
+static void sha2xx_blocks_select( uint32_t *, const uint8_t *, size_t );
+static void (*_Atomic sha2xx_kernel)( uint32_t *, const uint8_t *, size_t ) = sha2xx_blocks_select;
+
+static inline void sha2xx_blocks( uint32_t *H, const uint8_t *p, size_t n ) {
+    atomic_load_explicit(&sha2xx_kernel,memory_order_relaxed)(H,p,n);
+}
+
+/**
+ * \brief Pick the fastest SHA-224/256 kernel the CPU supports and make
+ *   it the selected kernel.
+ *
+ * \return A pointer to the kernel.
+ */
+
+static void (*sha2xx_blocks_pick( void ))( uint32_t *, const uint8_t *, size_t ) {
+    void (*f)( uint32_t *, const uint8_t *, size_t ) = sha2xx_blocks_generic;
+#if defined(CPU_X86_KERNELS)
+    uint32_t req = CPU_FEATURE_SHA | CPU_FEATURE_SSE41 | CPU_FEATURE_SSSE3;
+
+    if ((cpu_features() & req) == req) {
+        f = sha2xx_blocks_shani;
+    }
+#endif
+    atomic_store_explicit(&sha2xx_kernel,f,memory_order_relaxed);
+    return f;
+}
+
+/**
+ * \brief Select the kernel on the first use and process the given
+ *   blocks with it.
+ *
+ * \param[inout] H A pointer to the intermediate hash value H[8].
+ * \param[in] p A pointer to the input blocks.
+ * \param[in] n The number of SHA256_BLK_SIZE blocks to process.
+ *
+ * \return Nothing.
+ */
+
+static void sha2xx_blocks_select( uint32_t *H, const uint8_t *p, size_t n ) {
+    sha2xx_blocks_pick()(H,p,n);
+}
+
+/**
+ * \brief Process blocks with the selected SHA-224/256 kernel. This is
+ *   the exported kernel interface for hashing full blocks without
+ *   a context.
+ *
+ * \param[inout] H A pointer to the intermediate hash value H[8].
+ * \param[in] p A pointer to the input blocks.
+ * \param[in] n The number of SHA256_BLK_SIZE blocks to process.
+ *
+ * \return Nothing.
+ */
+
+void sha256_compress( uint32_t *H, const uint8_t *p, size_t n ) {
+    sha2xx_blocks(H,p,n);
+}
+
+/**
+ * \brief Iterate SHA-224 or SHA-256 over its own digest n times, i.e.
+ *   X = H(X) where X is a digest. The digest is given as words, i.e.
+ *   as the intermediate hash value of the previous pass.
+ *
+ * \param[inout] X A pointer to the digest words.
+ * \param[in] words The number of digest words, 7 for SHA-224 and 8 for
+ *   SHA-256.
+ * \param[in] n The number of passes.
+ *
+ * \return Nothing.
+ */
+
+void sha256_iterate( uint32_t *X, int words, uint64_t n ) {
+    const uint32_t *iv = words == 7 ? sha224_iv : sha256_iv;
+    uint8_t b[SHA256_BLK_SIZE];
+    uint32_t H[8];
+    int w;
+#if defined(CPU_X86_KERNELS)
+    void (*f)( uint32_t *, const uint8_t *, size_t ) =
+        atomic_load_explicit(&sha2xx_kernel,memory_order_relaxed);
+
+    if (f == sha2xx_blocks_select) {
+        f = sha2xx_blocks_pick();
+    }
+    if (f == sha2xx_blocks_shani) {
+        sha2xx_iterate_shani(X,iv,words,n);
+        return;
+    }
+#endif
+
+    /* the block of one digest, the length is 224 or 256 bits */
+    memset(b,0,sizeof(b));
+    b[words*4] = 0x80;
+    b[SHA256_BLK_SIZE-2] = words*32 >> 8;
+    b[SHA256_BLK_SIZE-1] = words*32;
+
+    while (n-- > 0) {
+        for (w = 0; w < words; w++) {
+            b[w*4+0] = X[w] >> 24;
+            b[w*4+1] = X[w] >> 16;
+            b[w*4+2] = X[w] >> 8;
+            b[w*4+3] = X[w];
+        }
+
+        memcpy(H,iv,sizeof(H));
+        sha2xx_blocks(H,b,1);
+        memcpy(X,H,words*sizeof(uint32_t));
+    }
+}
+
+/**
+ * \brief Update the SHA-224 or SHA-256 hash value with the block
+ *   in the context buffer.
+ *
  * \param[in] ctx A pointer to the sha256_context_t.
  *
  * \return Nothing.
  */
 
 static void sha2xx_update_block( sha256_context_t *ctx ) {
-    uint32_t W[16];
-    uint32_t A = ctx->H[0];
-    uint32_t B = ctx->H[1];
-    uint32_t C = ctx->H[2];
-    uint32_t D = ctx->H[3];
-    uint32_t E = ctx->H[4];
-    uint32_t F = ctx->H[5];
-    uint32_t G = ctx->H[6];
-    uint32_t H = ctx->H[7];
+    sha2xx_blocks(ctx->H,ctx->buf,1);
+}
+
+#if defined(CPU_X86_KERNELS)
+
+/* SHA-224/256 round functions for 8 and 16 lanes. The lane state is
+ * transposed, see multibuf.h, so every vector holds one word of
+ * every lane.
+ */
+
+#define MB8_ROR(x,n) _mm256_or_si256(_mm256_srli_epi32(x,n),_mm256_slli_epi32(x,32-(n)))
+#define MB8_XOR3(a,b,c) _mm256_xor_si256(_mm256_xor_si256(a,b),c)
+#define MB8_ADD(a,b) _mm256_add_epi32(a,b)
+
+/**
+ * \brief Compress one block in each of the 8 lanes using AVX2.
+ *
+ * \param[inout] S A pointer to the transposed lane state.
+ * \param[in] p A pointer to 8 block pointers, one per lane.
+ *
+ * \return Nothing.
+ */
+
+__attribute__((target("avx2")))
+static void sha2xx_x8_avx2( uint32_t *S, const uint8_t *const *p ) {
+    __m256i W[16];
+    __m256i A, B, C, D, E, F, G, H;
     int i;
 
-	for (i = 0; i < 64; i++) {
-        uint32_t t1, t2, s1, ch, s0, maj;
-        uint32_t w = 0;
+    mb_load_x8(W,p,1);
+
+    A = _mm256_loadu_si256((const __m256i *)&S[0*MB_MAX_LANES]);
+    B = _mm256_loadu_si256((const __m256i *)&S[1*MB_MAX_LANES]);
+    C = _mm256_loadu_si256((const __m256i *)&S[2*MB_MAX_LANES]);
+    D = _mm256_loadu_si256((const __m256i *)&S[3*MB_MAX_LANES]);
+    E = _mm256_loadu_si256((const __m256i *)&S[4*MB_MAX_LANES]);
+    F = _mm256_loadu_si256((const __m256i *)&S[5*MB_MAX_LANES]);
+    G = _mm256_loadu_si256((const __m256i *)&S[6*MB_MAX_LANES]);
+    H = _mm256_loadu_si256((const __m256i *)&S[7*MB_MAX_LANES]);
+
+    for (i = 0; i < 64; i++) {
+        __m256i w, t1, t2, s0, s1;
 
         if (i < 16) {
-            w = W[i] = getlong(ctx->buf + i*4);
+            w = W[i];
         } else {
-            uint32_t s0, s1, t;
-#define MODI(x) (x & 0x0f)
-            t = W[MODI(i-15)]; s0 = ROR(7,t) ^ ROR(18,t) ^ LSR(3,t); 
-            t = W[MODI(i-2)];  s1 = ROR(17,t) ^ ROR(19,t) ^ LSR(10,t);
-            w = W[MODI(i-16)] + s0 + W[MODI(i-7)] + s1;
-            W[MODI(i)] = w;
-#undef MODI
+            __m256i t = W[(i-15) & 15];
+            s0 = MB8_XOR3(MB8_ROR(t,7),MB8_ROR(t,18),_mm256_srli_epi32(t,3));
+            t = W[(i-2) & 15];
+            s1 = MB8_XOR3(MB8_ROR(t,17),MB8_ROR(t,19),_mm256_srli_epi32(t,10));
+            w = MB8_ADD(MB8_ADD(W[(i-16) & 15],s0),MB8_ADD(W[(i-7) & 15],s1));
+            W[i & 15] = w;
         }
-        
-        s1 = ROR(6,E) ^ ROR(11,E) ^ ROR(25,E);
-        ch = (E & F) ^ (~E & G);
-        t1 = H + s1 + ch + k[i] + w;
 
-        s0 = ROR(2,A) ^ ROR(13,A) ^ ROR(22,A);
-        maj = (A & (B ^ C)) ^ (B & C);  /* == (A & B) ^ (A & C)  ^ (B & C); */
-        t2 = s0 + maj;
-    
+        s1 = MB8_XOR3(MB8_ROR(E,6),MB8_ROR(E,11),MB8_ROR(E,25));
+        t1 = _mm256_xor_si256(_mm256_and_si256(E,F),_mm256_andnot_si256(E,G));
+        t1 = MB8_ADD(MB8_ADD(H,s1),MB8_ADD(t1,MB8_ADD(_mm256_set1_epi32(k[i]),w)));
+        s0 = MB8_XOR3(MB8_ROR(A,2),MB8_ROR(A,13),MB8_ROR(A,22));
+        t2 = _mm256_xor_si256(_mm256_and_si256(A,_mm256_xor_si256(B,C)),_mm256_and_si256(B,C));
+        t2 = MB8_ADD(s0,t2);
+
         H = G;
         G = F;
         F = E;
-        E = D + t1;
+        E = MB8_ADD(D,t1);
         D = C;
         C = B;
         B = A;
-        A = t1 + t2;
+        A = MB8_ADD(t1,t2);
     }
 
-    ctx->H[0] += A;
-    ctx->H[1] += B;
-    ctx->H[2] += C;
-    ctx->H[3] += D;
-    ctx->H[4] += E;
-    ctx->H[5] += F;
-    ctx->H[6] += G;
-    ctx->H[7] += H;
+#define MB8_STORE(n,v) _mm256_storeu_si256((__m256i *)&S[(n)*MB_MAX_LANES], \
+        MB8_ADD(v,_mm256_loadu_si256((const __m256i *)&S[(n)*MB_MAX_LANES])))
+    MB8_STORE(0,A);
+    MB8_STORE(1,B);
+    MB8_STORE(2,C);
+    MB8_STORE(3,D);
+    MB8_STORE(4,E);
+    MB8_STORE(5,F);
+    MB8_STORE(6,G);
+    MB8_STORE(7,H);
+#undef MB8_STORE
+}
+
+#undef MB8_ROR
+#undef MB8_XOR3
+#undef MB8_ADD
+
+#define MB16_XOR3(a,b,c) _mm512_ternarylogic_epi32(a,b,c,0x96)
+#define MB16_ADD(a,b) _mm512_add_epi32(a,b)
+
+/**
+ * \brief Compress one block in each of the 16 lanes using AVX-512.
+ *
+ * \param[inout] S A pointer to the transposed lane state.
+ * \param[in] p A pointer to 16 block pointers, one per lane.
+ *
+ * \return Nothing.
+ */
+
+__attribute__((target("avx512f,avx512bw")))
+static void sha2xx_x16_avx512( uint32_t *S, const uint8_t *const *p ) {
+    __m512i W[16];
+    __m512i A, B, C, D, E, F, G, H;
+    int i;
+
+    mb_load_x16(W,p,1);
+
+    A = _mm512_loadu_si512((const void *)&S[0*MB_MAX_LANES]);
+    B = _mm512_loadu_si512((const void *)&S[1*MB_MAX_LANES]);
+    C = _mm512_loadu_si512((const void *)&S[2*MB_MAX_LANES]);
+    D = _mm512_loadu_si512((const void *)&S[3*MB_MAX_LANES]);
+    E = _mm512_loadu_si512((const void *)&S[4*MB_MAX_LANES]);
+    F = _mm512_loadu_si512((const void *)&S[5*MB_MAX_LANES]);
+    G = _mm512_loadu_si512((const void *)&S[6*MB_MAX_LANES]);
+    H = _mm512_loadu_si512((const void *)&S[7*MB_MAX_LANES]);
+
+    for (i = 0; i < 64; i++) {
+        __m512i w, t1, t2, s0, s1;
+
+        if (i < 16) {
+            w = W[i];
+        } else {
+            __m512i t = W[(i-15) & 15];
+            s0 = MB16_XOR3(_mm512_ror_epi32(t,7),_mm512_ror_epi32(t,18),_mm512_srli_epi32(t,3));
+            t = W[(i-2) & 15];
+            s1 = MB16_XOR3(_mm512_ror_epi32(t,17),_mm512_ror_epi32(t,19),_mm512_srli_epi32(t,10));
+            w = MB16_ADD(MB16_ADD(W[(i-16) & 15],s0),MB16_ADD(W[(i-7) & 15],s1));
+            W[i & 15] = w;
+        }
+
+        /* Ch is 0xca and Maj 0xe8 as ternary logic truth tables */
+        s1 = MB16_XOR3(_mm512_ror_epi32(E,6),_mm512_ror_epi32(E,11),_mm512_ror_epi32(E,25));
+        t1 = _mm512_ternarylogic_epi32(E,F,G,0xca);
+        t1 = MB16_ADD(MB16_ADD(H,s1),MB16_ADD(t1,MB16_ADD(_mm512_set1_epi32(k[i]),w)));
+        s0 = MB16_XOR3(_mm512_ror_epi32(A,2),_mm512_ror_epi32(A,13),_mm512_ror_epi32(A,22));
+        t2 = MB16_ADD(s0,_mm512_ternarylogic_epi32(A,B,C,0xe8));
+
+        H = G;
+        G = F;
+        F = E;
+        E = MB16_ADD(D,t1);
+        D = C;
+        C = B;
+        B = A;
+        A = MB16_ADD(t1,t2);
+    }
+
+#define MB16_STORE(n,v) _mm512_storeu_si512((void *)&S[(n)*MB_MAX_LANES], \
+        MB16_ADD(v,_mm512_loadu_si512((const void *)&S[(n)*MB_MAX_LANES])))
+    MB16_STORE(0,A);
+    MB16_STORE(1,B);
+    MB16_STORE(2,C);
+    MB16_STORE(3,D);
+    MB16_STORE(4,E);
+    MB16_STORE(5,F);
+    MB16_STORE(6,G);
+    MB16_STORE(7,H);
+#undef MB16_STORE
+}
+
+#undef MB16_XOR3
+#undef MB16_ADD
+#endif
+
+/**
+ * \brief Fill in the multi-buffer description of SHA-224 or SHA-256
+ *   using the fastest lane kernel the CPU supports.
+ *
+ * \param[out] a A pointer to the description to fill in.
+ * \param[in] alg Either TEE_ALG_SHA224 or TEE_ALG_SHA256.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_UNSUPPORTED_DIGEST otherwise.
+ */
+
+int sha2xx_mb_setup( mb_algo_t *a, uint32_t alg ) {
+    if (alg != TEE_ALG_SHA224 && alg != TEE_ALG_SHA256) {
+        return CRYPTO_ERROR_UNSUPPORTED_DIGEST;
+    }
+
+    a->algorithm = alg;
+    a->words = 8;
+    a->out_words = alg == TEE_ALG_SHA224 ? 7 : 8;
+    a->big_endian = 1;
+    a->iv = alg == TEE_ALG_SHA224 ? sha224_iv : sha256_iv;
+    a->lanes = 1;
+    a->single = sha256_compress;
+    a->blocks = NULL;
+
+#if defined(CPU_X86_KERNELS)
+    /* 8 AVX2 lanes do not quite keep up with one SHA-NI lane */
+    if (cpu_features() & CPU_FEATURE_AVX512) {
+        a->lanes = 16;
+        a->blocks = sha2xx_x16_avx512;
+    } else if ((cpu_features() & CPU_FEATURE_AVX2) && !(cpu_features() & CPU_FEATURE_SHA)) {
+        a->lanes = 8;
+        a->blocks = sha2xx_x8_avx2;
+    }
+#endif
+    return CRYPTO_SUCCESS;
 }
 
 
@@ -155,32 +682,18 @@ static void sha2xx_update_block( sha256_context_t *ctx ) {
  * \paramm ctx A pointer to the sha1_context.
  */
 
-static int sha2xx_reset( crypto_context *hdr, ... ) {
+static int sha2xx_reset( crypto_context *hdr, va_list tags ) {
 	/* Note that we must not override the hdr->context value.. */
 
 	sha256_context_t *ctx = (sha256_context_t *)hdr;
 	ctx->index = 0;
 
     if (hdr->algorithm == TEE_ALG_SHA256) {
-    /* Initialize intermediate hash values for SHA-256 */
-        ctx->H[0] = 0x6a09e667;
-        ctx->H[1] = 0xbb67ae85;
-        ctx->H[2] = 0x3c6ef372;
-        ctx->H[3] = 0xa54ff53a;
-        ctx->H[4] = 0x510e527f;
-        ctx->H[5] = 0x9b05688c;
-        ctx->H[6] = 0x1f83d9ab;
-        ctx->H[7] = 0x5be0cd19;
+        /* Initialize intermediate hash values for SHA-256 */
+        memcpy(ctx->H,sha256_iv,sizeof(sha256_iv));
     } else {
         /* Initialize intermediate hash values for SHA-224 */
-        ctx->H[0] = 0xc1059ed8;
-        ctx->H[1] = 0x367cd507;
-        ctx->H[2] = 0x3070dd17;
-        ctx->H[3] = 0xf70e5939;
-        ctx->H[4] = 0xffc00b31;
-        ctx->H[5] = 0x68581511;
-        ctx->H[6] = 0x64f98fa7;
-        ctx->H[7] = 0xbefa4fa4;
+        memcpy(ctx->H,sha224_iv,sizeof(sha224_iv));
     }
 	return CRYPTO_SUCCESS;
 }
@@ -192,32 +705,43 @@ static int sha2xx_reset( crypto_context *hdr, ... ) {
  *   initialized prior calling this function, otherwise the result is
  *   unpredictable.
  * \param buf A pointer to input octet buffer.
- * \param len The length of the input buffer. Must be greater or equal to 0.
+ * \param len The length of the input buffer.
  *
  * \return Nothing.
  */
 
-static void sha2xx_update( crypto_context *hdr, const void *buf, int len ) {
+static void sha2xx_update( crypto_context *hdr, const void *buf, size_t len ) {
     sha256_context_t *ctx = (sha256_context_t *)hdr;
-	int pos = 0;
-    uint8_t *b = (uint8_t *)buf;
+    const uint8_t *b = (const uint8_t *)buf;
+    size_t idx;
 
-    while (len > 0) {
-        int idx = ctx->index & SHA256_BLK_MASK;
-        int sze = SHA256_BLK_SIZE-idx;
+    assert(ctx);
+
+    idx = ctx->index & SHA256_BLK_MASK;
+    ctx->index += len;
+
+    if (idx > 0) {
+        /* complete the partial block in the context first */
+        size_t sze = SHA256_BLK_SIZE-idx;
 
         if (sze > len) {
-            sze = len;
+            memcpy(ctx->buf+idx,b,len);
+            return;
         }
 
-        memcpy(ctx->buf+idx,b+pos,sze);
+        memcpy(ctx->buf+idx,b,sze);
+        sha2xx_update_block( ctx );
+        b += sze;
         len -= sze;
-        pos += sze;
-        ctx->index += sze;
-        
-        if (idx+sze == SHA256_BLK_SIZE) {
-            sha2xx_update_block( ctx );
-        }
+    }
+    if (len >= SHA256_BLK_SIZE) {
+        /* all full blocks directly from the caller buffer */
+        sha2xx_blocks(ctx->H,b,len / SHA256_BLK_SIZE);
+        b += len & ~SHA256_BLK_MASK;
+        len &= SHA256_BLK_MASK;
+    }
+    if (len > 0) {
+        memcpy(ctx->buf,b,len);
     }
 }
 
@@ -234,7 +758,7 @@ static void sha2xx_update( crypto_context *hdr, const void *buf, int len ) {
 static void sha2xx_finish( crypto_context *hdr, uint8_t *out ) {
 	sha256_context_t *ctx = (sha256_context_t *)hdr;
 	int idx = ctx->index & SHA256_BLK_MASK;
-    int64_t flen = ctx->index * 8;
+    uint64_t flen = ctx->index * 8;
     int32_t hlen = flen >> 32;
     int32_t llen = flen;
     int max = hdr->algorithm == TEE_ALG_SHA224 ? 7 : 8; 
@@ -270,14 +794,62 @@ static void sha2xx_finish( crypto_context *hdr, uint8_t *out ) {
  */
 
 static void sha2xx_free( crypto_context *ctx ) {
-	if (ctx) {
+	if (ctx && !(ctx->flags & CFLAG_STATIC_ALLOC)) {
 		free(ctx);
 	}
 }
 
-static void sha2xx_free_dummy( crypto_context *ctx ) {
+/**
+ * \brief Copy the SHA-224/256 context including the state of the calculation
+ *   so far. The copy is independent of the original.
+ *
+ * \param hdr A pointer to the context to copy.
+ * \param dst A pointer to the storage for the copy, or NULL to allocate
+ *   the copy from the heap.
+ *
+ * \return A pointer to the copy. NULL if the allocation failed.
+ */
+
+static crypto_context *sha2xx_clone( const crypto_context *hdr, crypto_context *dst ) {
+	if (dst == NULL) {
+		if ((dst = malloc(sizeof(sha256_context_t))) == NULL) {
+			return NULL;
+		}
+		memcpy(dst,hdr,sizeof(sha256_context_t));
+		dst->flags &= ~CFLAG_STATIC_ALLOC;
+	} else {
+		memcpy(dst,hdr,sizeof(sha256_context_t));
+		dst->flags |= CFLAG_STATIC_ALLOC;
+	}
+	return dst;
 }
 
+/**
+ * \brief Export and import the SHA-224/256 intermediate state as a blob,
+ *   see midstate.h for the format.
+ *
+ */
+
+static int sha2xx_export( const crypto_context *hdr, uint8_t *out, size_t *len ) {
+	const sha256_context_t *ctx = (const sha256_context_t *)hdr;
+	return midstate_export(hdr,ctx->index,ctx->H,8,4,ctx->buf,out,len);
+}
+
+static int sha2xx_import( crypto_context *hdr, const uint8_t *in, size_t len ) {
+	sha256_context_t *ctx = (sha256_context_t *)hdr;
+	return midstate_import(hdr,&ctx->index,ctx->H,8,4,ctx->buf,in,len);
+}
+
+static const crypto_ops sha2xx_ops = {
+	sha2xx_reset,
+	sha2xx_update,
+	sha2xx_finish,
+	sha2xx_clone,
+	sha2xx_export,
+	sha2xx_import,
+	sha2xx_free
+};
+
 /**
  * \brief Allocate and initialize the minumum of the SHA1 context.
  *   This is supposed to be the only exported function.
@@ -297,7 +869,7 @@ crypto_context *sha256_alloc( void ) {
 	}
 
 	sha256_init((sha256_context_t *)ctx);
-	ctx->free = sha2xx_free;
+	ctx->flags &= ~CFLAG_STATIC_ALLOC;
 	return ctx;
 }
 
@@ -309,7 +881,7 @@ crypto_context *sha224_alloc( void ) {
 	}
 
 	sha224_init((sha224_context_t *)ctx);
-	ctx->free = sha2xx_free;
+	ctx->flags &= ~CFLAG_STATIC_ALLOC;
 	return ctx;
 }
 
@@ -326,13 +898,11 @@ static crypto_context *sha2xx_init( crypto_context *ctx, uint32_t algo ) {
 	memset(ctx,0,sizeof(sha256_context_t));
 	
 	ctx->algorithm = algo;
-	ctx->size = SHA256_HSH_SIZE << 3;
+	ctx->size = (algo == TEE_ALG_SHA224 ? SHA224_HSH_SIZE : SHA256_HSH_SIZE) << 3;
 	ctx->block_size = SHA256_BLK_SIZE;
 	
-	ctx->reset = sha2xx_reset;
-	ctx->update = sha2xx_update;
-	ctx->finish = sha2xx_finish;
-	ctx->free = sha2xx_free_dummy;
+	ctx->flags = CFLAG_STATIC_ALLOC;
+	ctx->ops = &sha2xx_ops;
 	return ctx;
 }
 
@@ -356,29 +926,29 @@ int main( int argc, char** argv )
     crypto_context *ctx = sha256_alloc();
     uint8_t hash[SHA256_HSH_SIZE];
 	
-	ctx->reset(ctx);
-    ctx->update(ctx,argv[1],strlen(argv[1]));
-	ctx->finish(ctx,hash);
+	crypto_reset(ctx);
+    crypto_update(ctx,argv[1],strlen(argv[1]));
+	crypto_finish(ctx,hash);
 
 
     for (n = 0; n < SHA256_HSH_SIZE; n++) {
         printf("%02x",hash[n]);
     }
     printf("\n");
-    ctx->free(ctx);
+    crypto_free(ctx);
 
     sha224_context_t sha224;
     ctx = sha224_init(&sha224);
 
-	ctx->reset(ctx);
-    ctx->update(ctx,argv[1],strlen(argv[1]));
-	ctx->finish(ctx,hash);
+	crypto_reset(ctx);
+    crypto_update(ctx,argv[1],strlen(argv[1]));
+	crypto_finish(ctx,hash);
     for (n = 0; n < SHA224_HSH_SIZE; n++) {
         printf("%02x",hash[n]);
     }
     printf("\n");
 
-	ctx->free(ctx);
+	crypto_free(ctx);
 
     return 0;
 }
@@ -12,6 +12,7 @@
 #define _sha256_h_included
 
 #include <stdint.h>
+#include <stddef.h>
 #include "algorithm_types.h"
 
 #define SHA224_BLK_SIZE		64
@@ -25,7 +26,7 @@
 
 typedef struct sha256_context_s {
 	crypto_context hdr;
-    int64_t index;      /* number of octets processed so far */
+    uint64_t index;     /* number of octets processed so far */
     uint32_t H[8];		/* be prepared for all SHA-224/256 */
     uint8_t buf[SHA256_BLK_SIZE];	/* lets take the maximum */
 } sha256_context_t;
@@ -42,5 +43,16 @@ crypto_context *sha256_init( sha256_context_t * );
 crypto_context *sha224_alloc( void );
 crypto_context *sha224_init( sha224_context_t * );
 
+/* Compress n full blocks straight from a buffer into H[], i.e. no
+ * padding or buffering. SHA-224 uses the SHA-256 kernel. */
+
+void sha256_compress( uint32_t *, const uint8_t *, size_t );
+void sha256_iterate( uint32_t *, int, uint64_t );
+
+/* Initial hash values, for use with the compress function */
+
+extern const uint32_t sha256_iv[8];
+extern const uint32_t sha224_iv[8];
+
 
 #endif /* _sha256_h_included */
@@ -0,0 +1,647 @@
+/**
+ * \file sha512.c
+ * \brief A simple and memory efficient implementation of the
+ *   SHA-512 and SHA-384 digests. The implementation is based on the
+ *   RFC6234. Only the very primitive interface to calculate a digest
+ *   is provided for an arbitrary size input. Also input varying length
+ *   blocks are supported.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <memory.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include "sha512.h"
+#include "crypto_error.h"
+#include "cpu_features.h"
+#include "midstate.h"
+
+#if defined(CPU_X86_KERNELS)
+#include <immintrin.h>
+#endif
+
+/* potential candidate for inline asm */
+#define ROR(n,w) (((w) >> (n)) | ((w) << (64-(n))))
+#define LSR(n,w) ((w) >> (n))
+
+/* SHA-384 & 512 constants: */
+
+static const uint64_t k[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL,
+    0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+    0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+    0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+    0xd807aa98a3030242ULL, 0x12835b0145706fbeULL,
+    0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL,
+    0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+    0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+    0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL,
+    0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL,
+    0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+    0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+    0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+    0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL,
+    0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL,
+    0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+    0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+    0xd192e819d6ef5218ULL, 0xd69906245565a910ULL,
+    0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL,
+    0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+    0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+    0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+    0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL,
+    0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL,
+    0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+    0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+    0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+    0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL,
+    0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL,
+    0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+    0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+    0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+/* SHA-512 and SHA-384 initial hash values */
+
+const uint64_t sha512_iv[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+    0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+const uint64_t sha384_iv[8] = {
+    0xcbbb9d5dc1059ed8ULL, 0x629a292a367cd507ULL,
+    0x9159015a3070dd17ULL, 0x152fecd8f70e5939ULL,
+    0x67332667ffc00b31ULL, 0x8eb44a8768581511ULL,
+    0xdb0c2e0d64f98fa7ULL, 0x47b5481dbefa4fa4ULL
+};
+
+/**
+ * \brief Extract a BIG_ENDIAN unsigned long long word out of the buffer.
+ *   With GCC the word is loaded at once and byte swapped on little
+ *   endian hosts. The buffer needs not be aligned.
+ *
+ * \param b A pointer to the buffer. The buffer must have
+ *   at least 8 octets of space.
+ *
+ * \return The extracted unsigned long long word.
+ */
+
+static inline uint64_t getlonglong( const uint8_t *b ) {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__)
+    uint64_t l;
+    memcpy(&l,b,sizeof(l));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    l = __builtin_bswap64(l);
+#endif
+    return l;
+#else
+    uint64_t l = 0;
+    int n;
+
+    for (n = 0; n < 8; n++) {
+        l = l << 8 | *b++;
+    }
+    return l;
+#endif
+}
+
+/**
+ * \brief Insert a BIG_ENDIAN unsigned long long into the buffer. 
+ *
+ * \param b A pointer to the output buffer. The buffer must have
+ *   at least 8 octets of space.
+ * \param l The unsigned long long word to insert.
+ *
+ * \return A pointer to the buffer immediately following the newly
+ *   inserted unsigned long long word.
+ */
+
+static inline uint8_t *putlonglong( uint8_t *b, uint64_t l ) {
+    int n;
+
+    for (n = 56; n >= 0; n -= 8) {
+        *b++ = l >> n;
+    }
+    return b;
+}
+
+/* The round itself is shared by the kernels. WK is W[i]+K[i]. */
+
+#define SHA512_ROUND(WK) do { \
+        uint64_t t1, t2; \
+        t1 = H + (ROR(14,E) ^ ROR(18,E) ^ ROR(41,E)) + ((E & F) ^ (~E & G)) + (WK); \
+        t2 = (ROR(28,A) ^ ROR(34,A) ^ ROR(39,A)) + ((A & (B ^ C)) ^ (B & C)); \
+        H = G; \
+        G = F; \
+        F = E; \
+        E = D + t1; \
+        D = C; \
+        C = B; \
+        B = A; \
+        A = t1 + t2; \
+    } while (0)
+
+/**
+ * \brief Update the SHA-384 or SHA-512 hash value. This is a 
+ *   memory efficient implementation using the W[] in a 
+ *   circular buffer manner.
+ *
+ * \param[inout] HH A pointer to the intermediate hash value H[8].
+ * \param[in] p A pointer to the input blocks.
+ * \param[in] n The number of SHA512_BLK_SIZE blocks to process.
+ *
+ * \return Nothing.
+ */
+
+static void sha5xx_blocks_generic( uint64_t *HH, const uint8_t *p, size_t n ) {
+    uint64_t W[16];
+    int i;
+
+    while (n-- > 0) {
+        uint64_t A = HH[0];
+        uint64_t B = HH[1];
+        uint64_t C = HH[2];
+        uint64_t D = HH[3];
+        uint64_t E = HH[4];
+        uint64_t F = HH[5];
+        uint64_t G = HH[6];
+        uint64_t H = HH[7];
+
+        for (i = 0; i < 80; i++) {
+            uint64_t w;
+
+            if (i < 16) {
+                w = W[i] = getlonglong(p + i*8);
+            } else {
+                uint64_t s0, s1, t;
+#define MODI(x) ((x) & 0x0f)
+                t = W[MODI(i-15)]; s0 = ROR(1,t) ^ ROR(8,t) ^ LSR(7,t);
+                t = W[MODI(i-2)];  s1 = ROR(19,t) ^ ROR(61,t) ^ LSR(6,t);
+                w = W[MODI(i-16)] + s0 + W[MODI(i-7)] + s1;
+                W[MODI(i)] = w;
+#undef MODI
+            }
+
+            SHA512_ROUND(k[i] + w);
+        }
+
+        HH[0] += A;
+        HH[1] += B;
+        HH[2] += C;
+        HH[3] += D;
+        HH[4] += E;
+        HH[5] += F;
+        HH[6] += G;
+        HH[7] += H;
+        p += SHA512_BLK_SIZE;
+    }
+}
+
+#if defined(CPU_X86_KERNELS)
+
+#define SCH_ROR(x,n) _mm_or_si128(_mm_srli_epi64(x,n),_mm_slli_epi64(x,64-(n)))
+
+/* Two rounds using the schedule words in X[j] and, while the rounds run,
+ * the two words 16 positions later into X[j]. X[] is a ring of eight
+ * vectors holding W[i..i+15], two words each, thus W[i-2..i-1] needed
+ * by sigma1 is always a whole vector and the two new words do not
+ * depend on each other.
+ */
+
+#define SHA512_SSSE3_2ROUNDS(j,t,sched) do { \
+        __m128i wk = _mm_add_epi64(X[j],_mm_loadu_si128((const __m128i *)&k[t])); \
+        _mm_store_si128((__m128i *)WK,wk); \
+        if (sched) { \
+            __m128i w15 = _mm_alignr_epi8(X[((j)+1)&7],X[j],8); \
+            __m128i w7 = _mm_alignr_epi8(X[((j)+5)&7],X[((j)+4)&7],8); \
+            __m128i w2 = X[((j)+7)&7]; \
+            w15 = _mm_xor_si128(_mm_xor_si128(SCH_ROR(w15,1),SCH_ROR(w15,8)),_mm_srli_epi64(w15,7)); \
+            w2 = _mm_xor_si128(_mm_xor_si128(SCH_ROR(w2,19),SCH_ROR(w2,61)),_mm_srli_epi64(w2,6)); \
+            X[j] = _mm_add_epi64(_mm_add_epi64(X[j],w15),_mm_add_epi64(w7,w2)); \
+        } \
+        SHA512_ROUND(WK[0]); \
+        SHA512_ROUND(WK[1]); \
+    } while (0)
+
+#define SHA512_SSSE3_16ROUNDS(t,sched) do { \
+        SHA512_SSSE3_2ROUNDS(0,(t)+0,sched); \
+        SHA512_SSSE3_2ROUNDS(1,(t)+2,sched); \
+        SHA512_SSSE3_2ROUNDS(2,(t)+4,sched); \
+        SHA512_SSSE3_2ROUNDS(3,(t)+6,sched); \
+        SHA512_SSSE3_2ROUNDS(4,(t)+8,sched); \
+        SHA512_SSSE3_2ROUNDS(5,(t)+10,sched); \
+        SHA512_SSSE3_2ROUNDS(6,(t)+12,sched); \
+        SHA512_SSSE3_2ROUNDS(7,(t)+14,sched); \
+    } while (0)
+
+/**
+ * \brief Update the SHA-384 or SHA-512 hash value. The message schedule
+ *   is calculated with vector instructions two words at a time and
+ *   interleaved with the scalar rounds, which takes the schedule off
+ *   the critical path of the rounds. The words are never stored and
+ *   reloaded, only the W+K pairs go through memory. The vectors are
+ *   128 bits wide, SSSE3 is needed for pshufb and palignr.
+ *
+ * \param[inout] HH A pointer to the intermediate hash value H[8].
+ * \param[in] p A pointer to the input blocks.
+ * \param[in] n The number of SHA512_BLK_SIZE blocks to process.
+ *
+ * \return Nothing.
+ */
+
+__attribute__((target("ssse3")))
+static void sha5xx_blocks_ssse3( uint64_t *HH, const uint8_t *p, size_t n ) {
+    const __m128i BSWAP = _mm_set_epi8(8,9,10,11,12,13,14,15,0,1,2,3,4,5,6,7);
+    __attribute__((aligned(16))) uint64_t WK[2];
+    __m128i X[8];
+    int i, t;
+
+    while (n-- > 0) {
+        uint64_t A = HH[0];
+        uint64_t B = HH[1];
+        uint64_t C = HH[2];
+        uint64_t D = HH[3];
+        uint64_t E = HH[4];
+        uint64_t F = HH[5];
+        uint64_t G = HH[6];
+        uint64_t H = HH[7];
+
+        for (i = 0; i < 8; i++) {
+            X[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + i*16)),BSWAP);
+        }
+        for (t = 0; t < 64; t += 16) {
+            SHA512_SSSE3_16ROUNDS(t,1);
+        }
+        SHA512_SSSE3_16ROUNDS(64,0);
+
+        HH[0] += A;
+        HH[1] += B;
+        HH[2] += C;
+        HH[3] += D;
+        HH[4] += E;
+        HH[5] += F;
+        HH[6] += G;
+        HH[7] += H;
+        p += SHA512_BLK_SIZE;
+    }
+}
+
+#undef SHA512_SSSE3_16ROUNDS
+#undef SHA512_SSSE3_2ROUNDS
+#undef SCH_ROR
+#endif
+
+/* The kernel is selected on the first use. Until then the pointer
+ * refers to the selector itself. The pointer is atomic since threads
+ * may select concurrently, every selector stores the same kernel.
+ */
+
+static void sha5xx_blocks_select( uint64_t *, const uint8_t *, size_t );
+static void (*_Atomic sha5xx_kernel)( uint64_t *, const uint8_t *, size_t ) = sha5xx_blocks_select;
+
+static inline void sha5xx_blocks( uint64_t *H, const uint8_t *p, size_t n ) {
+    atomic_load_explicit(&sha5xx_kernel,memory_order_relaxed)(H,p,n);
+}
+
+/**
+ * \brief Pick the fastest SHA-384/512 kernel the CPU supports and
+ *   process the given blocks with it.
+ *
+ * \param[inout] H A pointer to the intermediate hash value H[8].
+ * \param[in] p A pointer to the input blocks.
+ * \param[in] n The number of SHA512_BLK_SIZE blocks to process.
+ *
+ * \return Nothing.
+ */
+
+static void sha5xx_blocks_select( uint64_t *H, const uint8_t *p, size_t n ) {
+    void (*f)( uint64_t *, const uint8_t *, size_t ) = sha5xx_blocks_generic;
+#if defined(CPU_X86_KERNELS)
+    if (cpu_features() & CPU_FEATURE_SSSE3) {
+        f = sha5xx_blocks_ssse3;
+    }
+#endif
+    atomic_store_explicit(&sha5xx_kernel,f,memory_order_relaxed);
+    f(H,p,n);
+}
+
+/**
+ * \brief Process blocks with the selected SHA-384/512 kernel. This is
+ *   the exported kernel interface for hashing full blocks without
+ *   a context.
+ *
+ * \param[inout] H A pointer to the intermediate hash value H[8].
+ * \param[in] p A pointer to the input blocks.
+ * \param[in] n The number of SHA512_BLK_SIZE blocks to process.
+ *
+ * \return Nothing.
+ */
+
+void sha512_compress( uint64_t *H, const uint8_t *p, size_t n ) {
+    sha5xx_blocks(H,p,n);
+}
+
+/**
+ * \brief Update the SHA-384 or SHA-512 hash value with the block
+ *   in the context buffer.
+ *
+ * \param[in] ctx A pointer to the sha512_context_t.
+ *
+ * \return Nothing.
+ */
+
+static void sha5xx_update_block( sha512_context_t *ctx ) {
+    sha5xx_blocks(ctx->H,ctx->buf,1);
+}
+
+
+/**
+ * \brief Initialize the SHA512 context for streamed hash
+ *   calculation.
+ *
+ * \paramm ctx A pointer to the sha512_context.
+ */
+
+static int sha5xx_reset( crypto_context *hdr, va_list tags ) {
+	/* Note that we must not override the hdr->context value.. */
+
+	sha512_context_t *ctx = (sha512_context_t *)hdr;
+	ctx->index = 0;
+
+    if (hdr->algorithm == TEE_ALG_SHA512) {
+        /* Initialize intermediate hash values for SHA-512 */
+        memcpy(ctx->H,sha512_iv,sizeof(sha512_iv));
+    } else {
+        /* Initialize intermediate hash values for SHA-384 */
+        memcpy(ctx->H,sha384_iv,sizeof(sha384_iv));
+    }
+	return CRYPTO_SUCCESS;
+}
+
+/**
+ * \brief Update the hash value. This function can be called multiple times.
+ *
+ * \param ctx A pointer to the sha512_context. The context must have been
+ *   initialized prior calling this function, otherwise the result is
+ *   unpredictable.
+ * \param buf A pointer to input octet buffer.
+ * \param len The length of the input buffer.
+ *
+ * \return Nothing.
+ */
+
+static void sha5xx_update( crypto_context *hdr, const void *buf, size_t len ) {
+    sha512_context_t *ctx = (sha512_context_t *)hdr;
+    const uint8_t *b = (const uint8_t *)buf;
+    size_t idx;
+
+    assert(ctx);
+
+    idx = ctx->index & SHA512_BLK_MASK;
+    ctx->index += len;
+
+    if (idx > 0) {
+        /* complete the partial block in the context first */
+        size_t sze = SHA512_BLK_SIZE-idx;
+
+        if (sze > len) {
+            memcpy(ctx->buf+idx,b,len);
+            return;
+        }
+
+        memcpy(ctx->buf+idx,b,sze);
+        sha5xx_update_block( ctx );
+        b += sze;
+        len -= sze;
+    }
+    if (len >= SHA512_BLK_SIZE) {
+        /* all full blocks directly from the caller buffer */
+        sha5xx_blocks(ctx->H,b,len / SHA512_BLK_SIZE);
+        b += len & ~SHA512_BLK_MASK;
+        len &= SHA512_BLK_MASK;
+    }
+    if (len > 0) {
+        memcpy(ctx->buf,b,len);
+    }
+}
+
+/**
+ * \brief Return the SHA512 hash of the input data so far. Note 
+ *   that calling this function resets the context. The message
+ *   length is a 128 bit number of bits.
+ *
+ * \param ctx A pointer to the SHA512 context.
+ * \param hsh A pointer to a buffer of size SHA512_HSH_SIZE.
+ *
+ * \return Nothing.
+ */
+
+static void sha5xx_finish( crypto_context *hdr, uint8_t *out ) {
+	sha512_context_t *ctx = (sha512_context_t *)hdr;
+	int idx = ctx->index & SHA512_BLK_MASK;
+    uint64_t hlen = ctx->index >> 61;
+    uint64_t llen = ctx->index << 3;
+    int max = hdr->algorithm == TEE_ALG_SHA384 ? 6 : 8; 
+
+    ctx->buf[idx++] = 0x80;
+    
+    if (idx > SHA512_BLK_SIZE-16) {
+        while (idx < SHA512_BLK_SIZE) {
+            ctx->buf[idx++] = 0;
+        }
+        sha5xx_update_block(ctx);
+        idx = 0;
+    }
+
+    while (idx < SHA512_BLK_SIZE-16) { 
+        ctx->buf[idx++] = 0;
+    }
+    
+    putlonglong(putlonglong(ctx->buf+idx,hlen),llen);
+    sha5xx_update_block(ctx);
+
+    for (idx = 0; idx < max; idx++) {
+        out = putlonglong(out,ctx->H[idx]);
+    }
+}
+
+/**
+ * \brief Free the sha512_context initialized and allocates using sha512_alloc().
+ *
+ * \param ctx A pointer to the SHA-384/512 context.
+ *
+ * \return Nothing.
+ */
+
+static void sha5xx_free( crypto_context *ctx ) {
+	if (ctx && !(ctx->flags & CFLAG_STATIC_ALLOC)) {
+		free(ctx);
+	}
+}
+
+/**
+ * \brief Copy the SHA-384/512 context including the state of the calculation
+ *   so far. The copy is independent of the original.
+ *
+ * \param hdr A pointer to the context to copy.
+ * \param dst A pointer to the storage for the copy, or NULL to allocate
+ *   the copy from the heap.
+ *
+ * \return A pointer to the copy. NULL if the allocation failed.
+ */
+
+static crypto_context *sha5xx_clone( const crypto_context *hdr, crypto_context *dst ) {
+	if (dst == NULL) {
+		if ((dst = malloc(sizeof(sha512_context_t))) == NULL) {
+			return NULL;
+		}
+		memcpy(dst,hdr,sizeof(sha512_context_t));
+		dst->flags &= ~CFLAG_STATIC_ALLOC;
+	} else {
+		memcpy(dst,hdr,sizeof(sha512_context_t));
+		dst->flags |= CFLAG_STATIC_ALLOC;
+	}
+	return dst;
+}
+
+/**
+ * \brief Export and import the SHA-384/512 intermediate state as a blob,
+ *   see midstate.h for the format.
+ *
+ */
+
+static int sha5xx_export( const crypto_context *hdr, uint8_t *out, size_t *len ) {
+	const sha512_context_t *ctx = (const sha512_context_t *)hdr;
+	return midstate_export(hdr,ctx->index,ctx->H,8,8,ctx->buf,out,len);
+}
+
+static int sha5xx_import( crypto_context *hdr, const uint8_t *in, size_t len ) {
+	sha512_context_t *ctx = (sha512_context_t *)hdr;
+	return midstate_import(hdr,&ctx->index,ctx->H,8,8,ctx->buf,in,len);
+}
+
+static const crypto_ops sha5xx_ops = {
+	sha5xx_reset,
+	sha5xx_update,
+	sha5xx_finish,
+	sha5xx_clone,
+	sha5xx_export,
+	sha5xx_import,
+	sha5xx_free
+};
+
+/**
+ * \brief Allocate and initialize the minumum of the SHA512 context.
+ *
+ * \return A pointer to the allocated and minimally intialized sha512_context.
+ *   NULL if the allocation failed.
+ */
+
+crypto_context *sha512_alloc( void ) {
+	crypto_context *ctx = malloc(sizeof(sha512_context_t));
+
+	if (ctx == NULL) {
+		return NULL;
+	}
+
+	sha512_init((sha512_context_t *)ctx);
+	ctx->flags &= ~CFLAG_STATIC_ALLOC;
+	return ctx;
+}
+
+crypto_context *sha384_alloc( void ) {
+	crypto_context *ctx = malloc(sizeof(sha384_context_t));
+
+	if (ctx == NULL) {
+		return NULL;
+	}
+
+	sha384_init((sha384_context_t *)ctx);
+	ctx->flags &= ~CFLAG_STATIC_ALLOC;
+	return ctx;
+}
+
+/**
+ * \brief Initialize sha512_context when located in a heap.
+ *
+ * \param stx A pointer to the SHA512 context to initialize.
+ *
+ * \return A pointer to crypto_context (which points to the
+ *   input parameter sha512_context.
+ */
+
+static crypto_context *sha5xx_init( crypto_context *ctx, uint32_t algo ) {
+	memset(ctx,0,sizeof(sha512_context_t));
+	
+	ctx->algorithm = algo;
+	ctx->size = (algo == TEE_ALG_SHA384 ? SHA384_HSH_SIZE : SHA512_HSH_SIZE) << 3;
+	ctx->block_size = SHA512_BLK_SIZE;
+	
+	ctx->flags = CFLAG_STATIC_ALLOC;
+	ctx->ops = &sha5xx_ops;
+	return ctx;
+}
+
+
+
+crypto_context *sha512_init( sha512_context_t *stx ) {
+	return sha5xx_init( (crypto_context *)stx, TEE_ALG_SHA512);
+}
+
+crypto_context *sha384_init( sha384_context_t *stx ) {
+    return sha5xx_init( (crypto_context *)stx, TEE_ALG_SHA384);
+}
+
+
+
+
+#if !defined(PARTOFLIBRARY)
+int main( int argc, char** argv )
+{
+    int n;
+    crypto_context *ctx = sha512_alloc();
+    uint8_t hash[SHA512_HSH_SIZE];
+	
+	crypto_reset(ctx);
+    crypto_update(ctx,argv[1],strlen(argv[1]));
+	crypto_finish(ctx,hash);
+
+
+    for (n = 0; n < SHA512_HSH_SIZE; n++) {
+        printf("%02x",hash[n]);
+    }
+    printf("\n");
+    crypto_free(ctx);
+
+    sha384_context_t sha384;
+    ctx = sha384_init(&sha384);
+
+	crypto_reset(ctx);
+    crypto_update(ctx,argv[1],strlen(argv[1]));
+	crypto_finish(ctx,hash);
+    for (n = 0; n < SHA384_HSH_SIZE; n++) {
+        printf("%02x",hash[n]);
+    }
+    printf("\n");
+
+	crypto_free(ctx);
+
+    return 0;
+}
+#endif
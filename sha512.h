@@ -0,0 +1,57 @@
+/**
+ * \file sha512.h
+ * \brief Context definitions and function prototypes for the
+ *   SHA-512 and SHA-384 hash functions.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#ifndef _sha512_h_included
+#define _sha512_h_included
+
+#include <stdint.h>
+#include <stddef.h>
+#include "algorithm_types.h"
+
+#define SHA384_BLK_SIZE		128
+#define SHA512_BLK_SIZE		128
+#define SHA384_BLK_MASK		127
+#define SHA512_BLK_MASK		127
+#define SHA512_HSH_SIZE     64
+#define SHA384_HSH_SIZE     48
+
+/* Basic inplace block SHA-384/512 calculation */
+
+typedef struct sha512_context_s {
+	crypto_context hdr;
+    uint64_t index;     /* number of octets processed so far */
+    uint64_t H[8];		/* be prepared for all SHA-384/512 */
+    uint8_t buf[SHA512_BLK_SIZE];
+} sha512_context_t;
+
+typedef sha512_context_t sha384_context_t;
+
+/**
+ * \brief Prototypes for SHA512 calculation.
+ *
+ */
+
+crypto_context *sha512_alloc( void );
+crypto_context *sha512_init( sha512_context_t * );
+crypto_context *sha384_alloc( void );
+crypto_context *sha384_init( sha384_context_t * );
+
+/* Compress n full blocks straight from a buffer into H[], i.e. no
+ * padding or buffering. SHA-384 uses the SHA-512 kernel. */
+
+void sha512_compress( uint64_t *, const uint8_t *, size_t );
+
+/* Initial hash values, for use with the compress function */
+
+extern const uint64_t sha512_iv[8];
+extern const uint64_t sha384_iv[8];
+
+
+#endif /* _sha512_h_included */
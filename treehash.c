@@ -0,0 +1,391 @@
+/**
+ * \file treehash.c
+ * \brief SHA-256 tree hashing of large inputs, see treehash.h for the
+ *   format. The leaves are handed out to a pool of threads one chunk
+ *   at a time, the interior nodes are then combined on the calling
+ *   thread, which is cheap as there is one node per leaf chunk.
+ *   Files are mapped as a whole, other descriptors are read in
+ *   batches of one chunk per thread.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <memory.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "treehash.h"
+#include "filedigest.h"
+#include "sha256.h"
+#include "crypto_error.h"
+
+/* one batch of leaves shared by the workers */
+
+typedef struct tree_work_s {
+    const uint8_t *data;    /* the input of the batch */
+    size_t len;
+    size_t chunk;
+    uint8_t *leaf;          /* leaf digests of the batch */
+    size_t n;               /* number of leaves in the batch */
+    size_t next;            /* next leaf to hash */
+    pthread_mutex_t lock;
+} tree_work_t;
+
+/* The leaf domain prefix, 0x00 padded to a full block. Keeps the chunks
+ * block aligned, thus they are compressed directly from the input. */
+
+static const uint8_t tree_leaf_prefix[SHA256_BLK_SIZE];
+
+/**
+ * \brief Calculate a leaf digest.
+ *
+ * \param p A pointer to the chunk.
+ * \param len The length of the chunk.
+ * \param out A pointer to the TREE_HSH_SIZE output buffer.
+ *
+ * \return Nothing.
+ */
+
+static void tree_leaf( const uint8_t *p, size_t len, uint8_t *out ) {
+    sha256_context_t stx;
+    crypto_context *ctx = sha256_init(&stx);
+
+    crypto_reset(ctx);
+    crypto_update(ctx,tree_leaf_prefix,SHA256_BLK_SIZE);
+    crypto_update(ctx,p,len);
+    crypto_finish(ctx,out);
+}
+
+/**
+ * \brief Calculate an interior node digest. The output may overlap
+ *   with the left child.
+ *
+ * \param l A pointer to the left child digest.
+ * \param r A pointer to the right child digest.
+ * \param out A pointer to the TREE_HSH_SIZE output buffer.
+ *
+ * \return Nothing.
+ */
+
+static void tree_node( const uint8_t *l, const uint8_t *r, uint8_t *out ) {
+    static const uint8_t node = 0x01;
+    sha256_context_t stx;
+    crypto_context *ctx = sha256_init(&stx);
+
+    crypto_reset(ctx);
+    crypto_update(ctx,&node,1);
+    crypto_update(ctx,l,TREE_HSH_SIZE);
+    crypto_update(ctx,r,TREE_HSH_SIZE);
+    crypto_finish(ctx,out);
+}
+
+/**
+ * \brief Combine the leaves into the root. Pairing the nodes level by
+ *   level and lifting an odd last node up unchanged builds the same
+ *   tree as the RFC6962 split at the largest power of two.
+ *
+ * \param h A pointer to n leaf digests. Overwritten.
+ * \param n The number of leaves, at least one.
+ * \param out A pointer to the TREE_HSH_SIZE output buffer.
+ *
+ * \return Nothing.
+ */
+
+static void tree_root( uint8_t *h, size_t n, uint8_t *out ) {
+    while (n > 1) {
+        size_t i, m = 0;
+
+        for (i = 0; i+1 < n; i += 2) {
+            tree_node(h+i*TREE_HSH_SIZE,h+(i+1)*TREE_HSH_SIZE,h+m*TREE_HSH_SIZE);
+            m++;
+        }
+        if (i < n) {
+            memmove(h+m*TREE_HSH_SIZE,h+i*TREE_HSH_SIZE,TREE_HSH_SIZE);
+            m++;
+        }
+        n = m;
+    }
+
+    memcpy(out,h,TREE_HSH_SIZE);
+}
+
+/**
+ * \brief A worker thread. Hashes leaves of the batch until there are
+ *   none left.
+ *
+ * \param arg A pointer to the tree_work_t.
+ *
+ * \return NULL.
+ */
+
+static void *tree_worker( void *arg ) {
+    tree_work_t *w = (tree_work_t *)arg;
+    size_t i, off, len;
+
+    for (;;) {
+        pthread_mutex_lock(&w->lock);
+        i = w->next++;
+        pthread_mutex_unlock(&w->lock);
+
+        if (i >= w->n) {
+            break;
+        }
+
+        off = i * w->chunk;
+        len = w->len - off < w->chunk ? w->len - off : w->chunk;
+        tree_leaf(w->data+off,len,w->leaf+i*TREE_HSH_SIZE);
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief Hash the leaves of one batch using up to the given number of
+ *   threads, the calling thread included. Failing to start a thread
+ *   just leaves more work for the others.
+ *
+ * \param w A pointer to the batch.
+ * \param threads The maximum number of threads, at most
+ *   TREE_MAX_THREADS.
+ *
+ * \return Nothing.
+ */
+
+static void tree_run( tree_work_t *w, int threads ) {
+    pthread_t tid[TREE_MAX_THREADS];
+    int n, t = 0;
+
+    w->next = 0;
+    pthread_mutex_init(&w->lock,NULL);
+
+    for (n = 1; n < threads && n < w->n; n++) {
+        if (pthread_create(&tid[t],NULL,tree_worker,w) == 0) {
+            t++;
+        }
+    }
+
+    tree_worker(w);
+
+    for (n = 0; n < t; n++) {
+        pthread_join(tid[n],NULL);
+    }
+
+    pthread_mutex_destroy(&w->lock);
+}
+
+/**
+ * \brief Check the parameters and fill in the defaults. The number of
+ *   threads is limited to TREE_MAX_THREADS.
+ *
+ * \param chunk A pointer to the chunk size.
+ * \param threads A pointer to the number of threads.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_INVALID_ARGUMENT if the
+ *   chunk size is not a multiple of the SHA-256 block size.
+ */
+
+static int tree_params( size_t *chunk, int *threads ) {
+    if (*chunk == 0) {
+        *chunk = TREE_CHUNK_SIZE;
+    }
+    if (*chunk & SHA256_BLK_MASK) {
+        return CRYPTO_ERROR_INVALID_ARGUMENT;
+    }
+    if (*threads <= 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        *threads = n > 0 ? n : 1;
+    }
+    if (*threads > TREE_MAX_THREADS) {
+        *threads = TREE_MAX_THREADS;
+    }
+
+    return CRYPTO_SUCCESS;
+}
+
+/**
+ * \brief Calculate the SHA-256 tree hash of a buffer.
+ *
+ * \param buf A pointer to the input.
+ * \param len The length of the input.
+ * \param chunk The leaf chunk size, a multiple of 64, or 0 for the
+ *   default TREE_CHUNK_SIZE.
+ * \param threads The number of threads to use, 0 for one per CPU.
+ * \param out A pointer to the TREE_HSH_SIZE output buffer.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_INVALID_ARGUMENT on a bad
+ *   chunk size, CRYPTO_ERROR_NO_MEMORY if out of memory.
+ */
+
+int sha256_tree( const void *buf, size_t len, size_t chunk, int threads, uint8_t *out ) {
+    tree_work_t w;
+    int r;
+
+    if ((r = tree_params(&chunk,&threads)) != CRYPTO_SUCCESS) {
+        return r;
+    }
+
+    w.data = (const uint8_t *)buf;
+    w.len = len;
+    w.chunk = chunk;
+    w.n = len > 0 ? (len - 1) / chunk + 1 : 1;
+
+    if ((w.leaf = malloc(w.n * TREE_HSH_SIZE)) == NULL) {
+        return CRYPTO_ERROR_NO_MEMORY;
+    }
+    if (threads > w.n) {
+        threads = w.n;
+    }
+
+    tree_run(&w,threads);
+    tree_root(w.leaf,w.n,out);
+
+    free(w.leaf);
+    return CRYPTO_SUCCESS;
+}
+
+/**
+ * \brief Read until the buffer is full or the end of file.
+ *
+ * \param fd An open file descriptor.
+ * \param buf A pointer to the buffer.
+ * \param len The size of the buffer.
+ *
+ * \return The number of octets read, -1 on error.
+ */
+
+static ssize_t tree_read( int fd, uint8_t *buf, size_t len ) {
+    size_t got = 0;
+    ssize_t n;
+
+    while (got < len) {
+        if ((n = read(fd,buf+got,len-got)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        got += n;
+    }
+
+    return got;
+}
+
+/**
+ * \brief Calculate the SHA-256 tree hash of a file descriptor from the
+ *   current file offset to the end of file. Regular files are mapped,
+ *   otherwise one chunk per thread is read at a time and hashed in
+ *   parallel.
+ *
+ * \param fd An open file descriptor.
+ * \param chunk The leaf chunk size, see sha256_tree().
+ * \param threads The number of threads, see sha256_tree().
+ * \param out A pointer to the TREE_HSH_SIZE output buffer.
+ *
+ * \return CRYPTO_SUCCESS if OK, CRYPTO_ERROR_IO on a read error,
+ *   CRYPTO_ERROR_INVALID_ARGUMENT if the chunks of all the threads do
+ *   not fit into memory at once, otherwise see sha256_tree().
+ */
+
+int sha256_tree_fd( int fd, size_t chunk, int threads, uint8_t *out ) {
+    tree_work_t w;
+    file_map_t m;
+    uint8_t *buf, *leaf;
+    size_t n = 0, max = 0;
+    ssize_t len;
+    int r;
+
+    if ((r = tree_params(&chunk,&threads)) != CRYPTO_SUCCESS) {
+        return r;
+    }
+    if (file_map(fd,&m) == CRYPTO_SUCCESS) {
+        r = sha256_tree(m.data,m.len,chunk,threads,out);
+        lseek(fd,m.len,SEEK_CUR);
+        file_unmap(&m);
+        return r;
+    }
+
+    /* one chunk per thread is read at a time */
+    if (chunk > SIZE_MAX / threads) {
+        return CRYPTO_ERROR_INVALID_ARGUMENT;
+    }
+    if ((buf = malloc(chunk * threads)) == NULL) {
+        return CRYPTO_ERROR_NO_MEMORY;
+    }
+
+    w.leaf = NULL;
+    w.chunk = chunk;
+    w.data = buf;
+
+    do {
+        if ((len = tree_read(fd,buf,chunk * threads)) < 0) {
+            r = CRYPTO_ERROR_IO;
+            break;
+        }
+        if (len == 0 && n > 0) {
+            break;
+        }
+        if (n + threads > max) {
+            max = max ? max * 2 : 64 + threads;
+
+            if ((leaf = realloc(w.leaf,max * TREE_HSH_SIZE)) == NULL) {
+                r = CRYPTO_ERROR_NO_MEMORY;
+                break;
+            }
+            w.leaf = leaf;
+        }
+
+        /* the leaves of a batch are appended after the previous ones */
+        w.leaf += n * TREE_HSH_SIZE;
+        w.len = len;
+        w.n = len > 0 ? (len - 1) / chunk + 1 : 1;
+        tree_run(&w,threads);
+        w.leaf -= n * TREE_HSH_SIZE;
+        n += w.n;
+    } while (len == chunk * threads);
+
+    if (r == CRYPTO_SUCCESS) {
+        tree_root(w.leaf,n,out);
+    }
+
+    free(w.leaf);
+    free(buf);
+    return r;
+}
+
+
+
+#if !defined(PARTOFLIBRARY)
+#include <fcntl.h>
+
+int main( int argc, char** argv )
+{
+    uint8_t hash[TREE_HSH_SIZE];
+    int fd = 0;
+    int n, r;
+
+    if (argc > 1 && (fd = open(argv[1],O_RDONLY)) < 0) {
+        printf("Cannot open %s\n",argv[1]);
+        return 1;
+    }
+    if ((r = sha256_tree_fd(fd,0,0,hash)) != CRYPTO_SUCCESS) {
+        printf("Error %d\n",r);
+        return 1;
+    }
+
+    for (n = 0; n < TREE_HSH_SIZE; n++) {
+        printf("%02x",hash[n]);
+    }
+    printf("\n");
+
+    return 0;
+}
+#endif
@@ -0,0 +1,51 @@
+/**
+ * \file treehash.h
+ * \brief SHA-256 tree hashing of large inputs. The input is split into
+ *   fixed size leaf chunks which are hashed in parallel and combined
+ *   into a single root digest.
+ *
+ *   The format, for a chunk size C which must be a non-zero multiple
+ *   of 64 octets (the default is TREE_CHUNK_SIZE):
+ *
+ *   - The input is split into n = max(1,ceil(len/C)) chunks D[0..n-1].
+ *     All chunks are C octets except the last one, which may be
+ *     shorter. An empty input is a single empty chunk.
+ *   - A leaf is LEAF(D[i]) = SHA-256(P || D[i]), where P is a 64 octet
+ *     block of all zeroes, i.e. the leaf domain prefix 0x00 padded to
+ *     a full block.
+ *   - An interior node is NODE(L,R) = SHA-256(0x01 || L || R), where L
+ *     and R are the 32 octet child digests.
+ *   - The tree is the RFC6962 (Certificate Transparency) Merkle tree:
+ *     for n > 1 the root of D[0..n-1] is NODE(root(D[0..k-1]),
+ *     root(D[k..n-1])) where k is the largest power of two smaller
+ *     than n. For n = 1 the root is the leaf itself.
+ *
+ *   The chunk size is a parameter of the format, the same input with
+ *   a different chunk size gives a different root.
+ * \author Jouni Korhonen
+ * \version 0.1 (initial)
+ * \date 2026-10-16
+ * \copyright Not GPL
+ */
+
+#ifndef _treehash_h_included
+#define _treehash_h_included
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TREE_CHUNK_SIZE     (1 << 20)   /**< Default leaf chunk size */
+#define TREE_HSH_SIZE       32          /**< Size of the leaf, node and root digests */
+#define TREE_MAX_THREADS    64          /**< Upper bound of the number of threads */
+
+/**
+ * \brief Tree hash function prototypes. A chunk size of 0 selects
+ *   TREE_CHUNK_SIZE and 0 threads one thread per online CPU. At most
+ *   TREE_MAX_THREADS threads are used.
+ *
+ */
+
+int sha256_tree( const void *, size_t, size_t, int, uint8_t * );
+int sha256_tree_fd( int, size_t, int, uint8_t * );
+
+#endif /* _treehash_h_included */
@@ -19,6 +19,7 @@
 #include "uuid.h"
 #include "sha1.h"
 #include "md5.h"
+#include "oneshot.h"
 #include "synchronization.h"
 #include "rand.h"
 
@@ -145,12 +146,13 @@ int uuid_create_v2(uuid_t *u, int32_t uid, int32_t gid, const struct uuid_timeva
  * \param[out] u A pointer to the UUID.
  * \param[in] h A pointer to the hash value.
  * \param[in] v Version to put into the UUID.
+ * \param[in] alg TEE_ALG_MD5 for version 3, TEE_ALG_SHA1 for version 5.
  * \return UUID_SUCCESS if OK. A negative value of UUID_ERROR_INVALID_PARAMETER
  *   when there are issues with the input parameters.
  */
 
 static int fill_v3v5( uuid_t *u, const uuid_t *ns,
-					const void *n, int l, int v, crypto_context *ctx ) {
+					const void *n, int l, int v, uint32_t alg ) {
     uint8_t hsh[SHA1_HSH_SIZE];		/* SHA1_HSH_SIZE > MD5_HSH_SIZE */
 	uint8_t buf[UUID_SIZE];
 	uint8_t *uu, x;
@@ -164,11 +166,7 @@ static int fill_v3v5( uuid_t *u, const uuid_t *ns,
 	uuid_serialize(buf,ns);
 	
 	/* calculate MD5 or SHA-1 */
-	ctx->reset(ctx);
-    ctx->update(ctx,buf,UUID_SIZE);
-    ctx->update(ctx,n,l);
-    ctx->finish(ctx,hsh);
-    ctx->free(ctx);
+	crypto_digest2(alg,buf,UUID_SIZE,n,l,hsh);
     
 	/* copy the hash over the destination UUID */
 	memcpy(u,hsh,sizeof(uuid_t));
@@ -237,11 +235,7 @@ int uuid_create_v1( uuid_t *u, const struct uuid_timeval *tv, const uint8_t *mac
  */
 
 int uuid_create_v3(uuid_t *u, const uuid_t *ns, const void *n, int l ) {
-    md5_context_t stx;
-    crypto_context *ctx;
-
-    ctx = md5_init(&stx); 
-    return fill_v3v5( u, ns, n, l, 3, ctx );
+    return fill_v3v5( u, ns, n, l, 3, TEE_ALG_MD5 );
 }
 
 /**
@@ -281,11 +275,7 @@ int uuid_create_v4( uuid_t *u, uint32_t seed ) {
  */
 
 int uuid_create_v5(uuid_t *u, const uuid_t *ns, const void *n, int l ) {
-    sha1_context_t stx;
-    crypto_context *ctx;
-
-    ctx = sha1_init(&stx); 
-    return fill_v3v5( u, ns, n, l, 5, ctx );
+    return fill_v3v5( u, ns, n, l, 5, TEE_ALG_SHA1 );
 }
 
 /**